@@ -0,0 +1,311 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include <climits>
+#include <cstring>
+
+#include "compressedfile.h"
+
+// Size of the buffers the compressed data goes through
+#define COMPRESSED_BUFFER_SIZE (1 << 17)
+// Levels that favour speed, the files are mostly written once and read
+// many times
+#define GZIP_LEVEL "wb6"
+#define ZSTD_LEVEL 3
+
+CompressedFile::CompressedFile() {
+  compression = NONE;
+  writing = false;
+  failed = false;
+  file = 0;
+  gzipFile = 0;
+  zstdContext = 0;
+  zstdBufferPos = 0;
+  zstdBufferSize = 0;
+  zstdRemaining = 0;
+  zstdOutputPending = false;
+  bytesRead = 0;
+}
+
+CompressedFile::~CompressedFile() {
+  close();
+}
+
+CompressedFile::Compression CompressedFile::detectCompression(
+    const char *data, size_t size) {
+  const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data);
+  if (size >= 2 && bytes[0] == 0x1F && bytes[1] == 0x8B)
+    return GZIP;
+  if (size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xB5 &&
+      bytes[2] == 0x2F && bytes[3] == 0xFD)
+    return ZSTD;
+  return NONE;
+}
+
+CompressedFile::Compression CompressedFile::compressionFromFileName(
+    const ::std::string& fileName) {
+  ::std::string name = fileName;
+  for (size_t i = 0; i < name.size(); i++)
+    name[i] = tolower(name[i]);
+  if (name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0)
+    return GZIP;
+  if (name.size() > 4 && name.compare(name.size() - 4, 4, ".zst") == 0)
+    return ZSTD;
+  return NONE;
+}
+
+bool CompressedFile::isSupported(Compression compression) {
+#ifdef HAVE_ZSTD
+  return true;
+#else
+  return compression != ZSTD;
+#endif
+}
+
+bool CompressedFile::openForReading(const ::std::string& fileName) {
+  close();
+  file = fopen(fileName.c_str(), "rb");
+  if (file == 0)
+    return false;
+  char magic[4];
+  size_t magicSize = fread(magic, 1, sizeof(magic), file);
+  rewind(file);
+  compression = detectCompression(magic, magicSize);
+  if (!isSupported(compression)) {
+    close();
+    return false;
+  }
+  if (compression == GZIP) {
+    fclose(file);
+    file = 0;
+    gzipFile = gzopen(fileName.c_str(), "rb");
+    if (gzipFile == 0) {
+      close();
+      return false;
+    }
+    gzbuffer(gzipFile, COMPRESSED_BUFFER_SIZE);
+  } else if (compression == ZSTD) {
+#ifdef HAVE_ZSTD
+    zstdContext = ZSTD_createDStream();
+    ZSTD_initDStream(static_cast<ZSTD_DStream*>(zstdContext));
+    zstdBuffer.resize(COMPRESSED_BUFFER_SIZE);
+#endif
+  }
+  return true;
+}
+
+bool CompressedFile::openForWriting(const ::std::string& fileName,
+                                    Compression compression) {
+  close();
+  if (!isSupported(compression))
+    return false;
+  this->compression = compression;
+  writing = true;
+  if (compression == GZIP) {
+    gzipFile = gzopen(fileName.c_str(), GZIP_LEVEL);
+    if (gzipFile == 0) {
+      close();
+      return false;
+    }
+    gzbuffer(gzipFile, COMPRESSED_BUFFER_SIZE);
+    return true;
+  }
+  file = fopen(fileName.c_str(), "wb");
+  if (file == 0) {
+    close();
+    return false;
+  }
+  if (compression == ZSTD) {
+#ifdef HAVE_ZSTD
+    zstdContext = ZSTD_createCStream();
+    ZSTD_initCStream(static_cast<ZSTD_CStream*>(zstdContext), ZSTD_LEVEL);
+    zstdBuffer.resize(ZSTD_CStreamOutSize());
+#endif
+  }
+  return true;
+}
+
+int64_t CompressedFile::read(char *data, int64_t size) {
+  if (writing || failed)
+    return -1;
+  if (compression == ZSTD)
+    return readZstd(data, size);
+  int64_t total = 0;
+  while (total < size) {
+    // gzread() reads at most INT_MAX bytes at a time
+    unsigned int count = static_cast<unsigned int>(
+        ::std::min(size - total, static_cast<int64_t>(INT_MAX)));
+    int64_t read;
+    if (compression == GZIP) {
+      read = gzread(gzipFile, data + total, count);
+      // A stream cut short ends like the file does, but leaves an error
+      // behind, Z_BUF_ERROR when the last block or the trailer is missing
+      int error = Z_OK;
+      if (read == 0)
+        gzerror(gzipFile, &error);
+      if (error != Z_OK)
+        read = -1;
+    } else {
+      read = fread(data + total, 1, count, file);
+      bytesRead += read;
+      if (read == 0 && ferror(file))
+        read = -1;
+    }
+    if (read < 0) {
+      failed = true;
+      return -1;
+    }
+    if (read == 0)
+      break;
+    total += read;
+  }
+  return total;
+}
+
+bool CompressedFile::write(const char *data, int64_t size) {
+  if (!writing || failed)
+    return false;
+  if (compression == ZSTD) {
+    failed = !writeZstd(data, size, false);
+    return !failed;
+  }
+  while (size > 0) {
+    unsigned int count = static_cast<unsigned int>(
+        ::std::min(size, static_cast<int64_t>(INT_MAX)));
+    bool written;
+    if (compression == GZIP)
+      written = gzwrite(gzipFile, data, count) == static_cast<int>(count);
+    else
+      written = fwrite(data, 1, count, file) == count;
+    if (!written) {
+      failed = true;
+      return false;
+    }
+    data += count;
+    size -= count;
+  }
+  return true;
+}
+
+bool CompressedFile::close() {
+  bool closed = !failed;
+  if (writing && compression == ZSTD && file != 0 && !failed)
+    closed = writeZstd(0, 0, true);
+  if (gzipFile != 0 && gzclose(gzipFile) != Z_OK && writing)
+    closed = false;
+  if (file != 0 && fclose(file) != 0 && writing)
+    closed = false;
+#ifdef HAVE_ZSTD
+  if (zstdContext != 0) {
+    if (writing)
+      ZSTD_freeCStream(static_cast<ZSTD_CStream*>(zstdContext));
+    else
+      ZSTD_freeDStream(static_cast<ZSTD_DStream*>(zstdContext));
+  }
+#endif
+  compression = NONE;
+  writing = false;
+  failed = false;
+  file = 0;
+  gzipFile = 0;
+  zstdContext = 0;
+  ::std::vector<char>().swap(zstdBuffer);
+  zstdBufferPos = 0;
+  zstdBufferSize = 0;
+  zstdRemaining = 0;
+  zstdOutputPending = false;
+  bytesRead = 0;
+  return closed;
+}
+
+int64_t CompressedFile::getBytesRead() const {
+  if (compression == GZIP && gzipFile != 0)
+    return gzoffset(gzipFile);
+  return bytesRead;
+}
+
+int64_t CompressedFile::readZstd(char *data, int64_t size) {
+#ifdef HAVE_ZSTD
+  ZSTD_DStream *stream = static_cast<ZSTD_DStream*>(zstdContext);
+  int64_t total = 0;
+  while (total < size) {
+    // The decompressor may hold data back when the output is full, so it
+    // is flushed before more input is read
+    if (zstdBufferPos == zstdBufferSize && !zstdOutputPending) {
+      zstdBufferSize = fread(&zstdBuffer[0], 1, zstdBuffer.size(), file);
+      zstdBufferPos = 0;
+      bytesRead += zstdBufferSize;
+      if (zstdBufferSize == 0) {
+        // A truncated frame is an error, not the end of the file
+        if (ferror(file) || zstdRemaining != 0) {
+          failed = true;
+          return -1;
+        }
+        break;
+      }
+    }
+    ZSTD_inBuffer input = {&zstdBuffer[0], zstdBufferSize, zstdBufferPos};
+    ZSTD_outBuffer output = {data + total, static_cast<size_t>(size - total),
+                             0};
+    // Non-zero while a frame hasn't been decompressed up to its end
+    zstdRemaining = ZSTD_decompressStream(stream, &output, &input);
+    if (ZSTD_isError(zstdRemaining)) {
+      failed = true;
+      return -1;
+    }
+    zstdBufferPos = input.pos;
+    zstdOutputPending = output.pos == output.size;
+    total += output.pos;
+  }
+  return total;
+#else
+  (void)data;
+  (void)size;
+  return -1;
+#endif
+}
+
+bool CompressedFile::writeZstd(const char *data, int64_t size, bool end) {
+#ifdef HAVE_ZSTD
+  ZSTD_CStream *stream = static_cast<ZSTD_CStream*>(zstdContext);
+  ZSTD_inBuffer input = {data, static_cast<size_t>(size), 0};
+  size_t remaining;
+  do {
+    ZSTD_outBuffer output = {&zstdBuffer[0], zstdBuffer.size(), 0};
+    remaining = ZSTD_compressStream2(stream, &output, &input,
+                                     end ? ZSTD_e_end : ZSTD_e_continue);
+    if (ZSTD_isError(remaining))
+      return false;
+    if (fwrite(&zstdBuffer[0], 1, output.pos, file) != output.pos)
+      return false;
+  } while (end ? remaining != 0 : input.pos < input.size);
+  return true;
+#else
+  (void)data;
+  (void)size;
+  (void)end;
+  return false;
+#endif
+}
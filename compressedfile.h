@@ -0,0 +1,86 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef COMPRESSEDFILE_H
+#define COMPRESSEDFILE_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct gzFile_s;
+
+// CompressedFile Class - A file read or written sequentially through gzip or
+// zstd (de)compression, or as is if it isn't compressed
+// The data is (de)compressed on the fly, a block at a time, so that it never
+// goes through a temporary file. zstd is only available if the program is
+// built with HAVE_ZSTD.
+class CompressedFile {
+ public:
+  enum Compression {NONE, GZIP, ZSTD};
+  CompressedFile();
+  ~CompressedFile();
+  // Guesses the compression of a file from its first bytes
+  static Compression detectCompression(const char *data, size_t size);
+  // Guesses the compression to use from the extension of a file name
+  static Compression compressionFromFileName(const ::std::string& fileName);
+  static bool isSupported(Compression compression);
+  // Opens a file for reading, its compression is detected from its content.
+  // Returns false if the file can't be opened or its compression isn't
+  // supported.
+  bool openForReading(const ::std::string& fileName);
+  // Opens a file for writing, returns false if it can't be done
+  bool openForWriting(const ::std::string& fileName, Compression compression);
+  // Reads up to size bytes, less only at the end of the file. Returns the
+  // number of bytes read, or -1 if the file is corrupted.
+  int64_t read(char *data, int64_t size);
+  // Returns false if the data couldn't be written
+  bool write(const char *data, int64_t size);
+  // Finishes the compressed stream and closes the file. Returns false if
+  // anything couldn't be written.
+  bool close();
+  Compression getCompression() const { return compression; };
+  // Returns the number of bytes read so far from the file itself, which is
+  // less than what read() returned if the file is compressed
+  int64_t getBytesRead() const;
+
+ private:
+  CompressedFile(const CompressedFile&);
+  CompressedFile& operator=(const CompressedFile&);
+  int64_t readZstd(char *data, int64_t size);
+  bool writeZstd(const char *data, int64_t size, bool end);
+  Compression compression;
+  bool writing;
+  bool failed;
+  FILE *file;
+  gzFile_s *gzipFile;
+  void *zstdContext;
+  ::std::vector<char> zstdBuffer;
+  size_t zstdBufferPos;
+  size_t zstdBufferSize;
+  size_t zstdRemaining;
+  bool zstdOutputPending;
+  int64_t bytesRead;
+};
+
+#endif  // COMPRESSEDFILE_H
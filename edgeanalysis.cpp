@@ -0,0 +1,232 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <math.h>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <vector>
+
+#include "edgeanalysis.h"
+#include "indexedmesh.h"
+#include "parallel.h"
+#include "partitionsort.h"
+
+// The partitions of the sorted edges are measured in this many groups, on
+// all cores. It must not depend on the number of threads.
+#define EDGE_NUM_GROUPS 16
+// The median is selected from the upper then the lower bits of the lengths
+#define EDGE_RADIX_BITS 16
+#define EDGE_RADIX_SIZE (1 << EDGE_RADIX_BITS)
+
+namespace {
+
+typedef struct {
+  int64_t numEdges;
+  int64_t numDegenerate;
+  double sum;
+  float shortest;
+  float shortestNonZero;
+  float longest;
+} EdgeSums;
+
+// The bits of a length, in the same order as the lengths themselves since
+// they are positive
+uint32_t getBits(float length) {
+  uint32_t bits;
+  memcpy(&bits, &length, sizeof(bits));
+  return bits;
+}
+
+float getLength(uint32_t bits) {
+  float length;
+  memcpy(&length, &bits, sizeof(length));
+  return length;
+}
+
+// Finds the bin of counts holding the rank-th value, and turns rank into
+// its rank within the bin
+int findBin(const ::std::vector<int64_t>& counts, int64_t *rank) {
+  int bin = 0;
+  while (bin + 1 < static_cast<int>(counts.size()) && *rank >= counts[bin])
+    *rank -= counts[bin++];
+  return bin;
+}
+
+}  // namespace
+
+EdgeAnalysis::EdgeAnalysis() {
+  numEdges = 0;
+  numDegenerate = 0;
+  shortest = shortestNonZero = longest = 0.0;
+  mean = 0.0;
+  median = 0.0;
+  ::std::fill(binCounts, binCounts + NUM_BINS, 0);
+}
+
+void EdgeAnalysis::analyze(const IndexedMesh *mesh) {
+  *this = EdgeAnalysis();
+  int64_t numFacets = mesh->getNumTriangles();
+  if (numFacets <= 0)
+    return;
+  const uint32_t *indices = mesh->getIndices();
+  const StlFile::Vertex *vertices = mesh->getVertices();
+  // The lower vertex of an edge is in the upper bits of its key, so that
+  // the facets on both sides of the edge give it the same key
+  ::std::vector<uint64_t> keys;
+  ::std::vector<int64_t> starts;
+  partitionSort(numFacets, [indices](int64_t facet, uint64_t records[]) {
+    for (int j = 0; j < 3; j++) {
+      uint32_t a = indices[3 * facet + j];
+      uint32_t b = indices[3 * facet + (j + 1) % 3];
+      records[j] = (static_cast<uint64_t>(::std::min(a, b)) << 32) |
+                   ::std::max(a, b);
+    }
+    return 3;
+  }, [](uint64_t key) {
+    return mixBits(key);
+  }, &keys, &starts);
+  // Calls measure(length) for each distinct edge of the partitions of a
+  // group. The equal keys are in the same partition.
+  const int partitionsPerGroup = PARTITION_SORT_NUM_PARTITIONS /
+                                 EDGE_NUM_GROUPS;
+  auto forEdges = [&](int group, auto measure) {
+    for (int p = group * partitionsPerGroup;
+         p < (group + 1) * partitionsPerGroup; p++) {
+      for (int64_t i = starts[p]; i < starts[p + 1]; i++) {
+        if (i > starts[p] && keys[i] == keys[i - 1])
+          continue;
+        const StlFile::Vertex &a = vertices[keys[i] >> 32];
+        const StlFile::Vertex &b = vertices[keys[i] & 0xffffffff];
+        float dx = b.x - a.x;
+        float dy = b.y - a.y;
+        float dz = b.z - a.z;
+        measure(sqrtf(dx * dx + dy * dy + dz * dz));
+      }
+    }
+  };
+
+  // First pass: the sums, the extremes, and the counts of the upper bits of
+  // the lengths
+  ::std::vector<EdgeSums> groupSums(EDGE_NUM_GROUPS);
+  ::std::vector<uint32_t> groupCounts(
+      static_cast<size_t>(EDGE_NUM_GROUPS) * EDGE_RADIX_SIZE, 0);
+  Parallel::run(EDGE_NUM_GROUPS, [&](int group) {
+    EdgeSums &sums = groupSums[group];
+    sums.numEdges = 0;
+    sums.numDegenerate = 0;
+    sums.sum = 0.0;
+    sums.shortest = FLT_MAX;
+    sums.shortestNonZero = FLT_MAX;
+    sums.longest = 0.0;
+    uint32_t *counts = &groupCounts[group * EDGE_RADIX_SIZE];
+    forEdges(group, [&](float length) {
+      sums.numEdges++;
+      sums.sum += length;
+      sums.shortest = ::std::min(sums.shortest, length);
+      sums.longest = ::std::max(sums.longest, length);
+      if (length > 0.0)
+        sums.shortestNonZero = ::std::min(sums.shortestNonZero, length);
+      else
+        sums.numDegenerate++;
+      counts[getBits(length) >> EDGE_RADIX_BITS]++;
+    });
+  });
+  // Merged in order, so that the mean doesn't depend on the threads
+  shortest = shortestNonZero = FLT_MAX;
+  double sum = 0.0;
+  ::std::vector<int64_t> upperCounts(EDGE_RADIX_SIZE, 0);
+  for (int group = 0; group < EDGE_NUM_GROUPS; group++) {
+    const EdgeSums &sums = groupSums[group];
+    numEdges += sums.numEdges;
+    numDegenerate += sums.numDegenerate;
+    sum += sums.sum;
+    shortest = ::std::min(shortest, sums.shortest);
+    shortestNonZero = ::std::min(shortestNonZero, sums.shortestNonZero);
+    longest = ::std::max(longest, sums.longest);
+    for (int i = 0; i < EDGE_RADIX_SIZE; i++)
+      upperCounts[i] += groupCounts[group * EDGE_RADIX_SIZE + i];
+  }
+  mean = sum / numEdges;
+  if (numDegenerate == numEdges)
+    shortestNonZero = 0.0;
+
+  // The median of an even number of edges is the mean of the middle two,
+  // whose upper bits are known by now
+  int64_t ranks[2] = {(numEdges - 1) / 2, numEdges / 2};
+  int upperBits[2];
+  for (int k = 0; k < 2; k++)
+    upperBits[k] = findBin(upperCounts, &ranks[k]);
+  // Second pass: the histogram, and the counts of the lower bits of the
+  // lengths having the upper bits of the middle two
+  float logShortest = shortestNonZero > 0.0 ? log(shortestNonZero) : 0.0;
+  float logRange = shortestNonZero > 0.0 ? log(longest) - logShortest : 0.0;
+  float scale = logRange > 0.0 ? NUM_BINS / logRange : 0.0;
+  ::std::vector<int64_t> groupBins(
+      static_cast<size_t>(EDGE_NUM_GROUPS) * NUM_BINS, 0);
+  groupCounts.assign(static_cast<size_t>(EDGE_NUM_GROUPS) * 2 *
+                     EDGE_RADIX_SIZE, 0);
+  Parallel::run(EDGE_NUM_GROUPS, [&](int group) {
+    int64_t *bins = &groupBins[group * NUM_BINS];
+    uint32_t *counts = &groupCounts[group * 2 * EDGE_RADIX_SIZE];
+    forEdges(group, [&](float length) {
+      if (length > 0.0) {
+        int bin = static_cast<int>((log(length) - logShortest) * scale);
+        bins[::std::max(0, ::std::min(bin, NUM_BINS - 1))]++;
+      }
+      uint32_t bits = getBits(length);
+      for (int k = 0; k < 2; k++) {
+        if (static_cast<int>(bits >> EDGE_RADIX_BITS) == upperBits[k])
+          counts[k * EDGE_RADIX_SIZE + (bits & (EDGE_RADIX_SIZE - 1))]++;
+      }
+    });
+  });
+  float middle[2];
+  for (int k = 0; k < 2; k++) {
+    ::std::vector<int64_t> lowerCounts(EDGE_RADIX_SIZE, 0);
+    for (int group = 0; group < EDGE_NUM_GROUPS; group++) {
+      const uint32_t *counts =
+          &groupCounts[(group * 2 + k) * EDGE_RADIX_SIZE];
+      for (int i = 0; i < EDGE_RADIX_SIZE; i++)
+        lowerCounts[i] += counts[i];
+    }
+    int lowerBits = findBin(lowerCounts, &ranks[k]);
+    middle[k] = getLength((static_cast<uint32_t>(upperBits[k]) <<
+                           EDGE_RADIX_BITS) | lowerBits);
+  }
+  median = (middle[0] + middle[1]) / 2.0;
+  for (int group = 0; group < EDGE_NUM_GROUPS; group++) {
+    for (int bin = 0; bin < NUM_BINS; bin++)
+      binCounts[bin] += groupBins[group * NUM_BINS + bin];
+  }
+}
+
+float EdgeAnalysis::getBinLimit(int bin) const {
+  if (shortestNonZero <= 0.0)
+    return 0.0;
+  if (bin <= 0)
+    return shortestNonZero;
+  if (bin >= NUM_BINS)
+    return longest;
+  float logShortest = log(shortestNonZero);
+  float logRange = log(longest) - logShortest;
+  return exp(logShortest + logRange * bin / NUM_BINS);
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef EDGEANALYSIS_H
+#define EDGEANALYSIS_H
+
+#include <stdint.h>
+#include <vector>
+
+class IndexedMesh;
+
+// EdgeAnalysis Class - Lengths of the edges of a welded mesh
+// Each edge is measured once however many facets share it, the edges being
+// sorted by their vertices in parallel to find the distinct ones. The
+// histogram is log scaled, its bins being evenly spaced on a log scale from
+// the shortest edge that isn't degenerate to the longest one. The median is
+// selected from histograms of the bits of the lengths, without keeping
+// them.
+class EdgeAnalysis {
+ public:
+  static const int NUM_BINS = 24;
+  EdgeAnalysis();
+  void analyze(const IndexedMesh *mesh);
+  int64_t getNumEdges() const { return numEdges; };
+  // Edges whose ends were welded together, left out of the histogram
+  int64_t getNumDegenerate() const { return numDegenerate; };
+  float getShortest() const { return shortest; };
+  float getLongest() const { return longest; };
+  double getMean() const { return mean; };
+  float getMedian() const { return median; };
+  // Lower limit of a bin, getBinLimit(NUM_BINS) is the longest edge
+  float getBinLimit(int bin) const;
+  int64_t getBinCount(int bin) const { return binCounts[bin]; };
+
+ private:
+  // Stores the results into its entries and restores them as they are
+  friend class MeshCache;
+  int64_t numEdges;
+  int64_t numDegenerate;
+  float shortest;
+  float shortestNonZero;
+  float longest;
+  double mean;
+  float median;
+  int64_t binCounts[NUM_BINS];
+};
+
+#endif  // EDGEANALYSIS_H
@@ -20,16 +20,49 @@
 
 #include <QtGui/QtGui>
 #include <exception>
+#include <vector>
 
 #include "glmdichild.h"
+#include "levelworker.h"
+#include "repairworker.h"
+#include "meshrepair.h"
+#include "meshsection.h"
+#include "meshshells.h"
+#include "meshslicer.h"
+#include "meshvalidation.h"
+#include "statsworker.h"
+#include "stlloader.h"
+
+// The fractions of the facets kept by the levels of detail
+static const double LEVEL_FRACTIONS[] = {0.5, 0.1, 0.01};
 
 GLMdiChild::GLMdiChild(QWidget *parent) : GLWidget(parent) {
   stlFile = new StlFile;
+  loader = 0;
+  statsWorker = 0;
+  levelWorker = 0;
+  repairWorker = 0;
+  numPoints = -1;
+  edgesAnalysed = false;
+  validated = false;
+  shellsFound = false;
+  section = 0;
+  level = 0;
+  pendingLevel = 0;
+  previewShown = false;
+  loadingPercent = 0;
+  loadedFacets = 0;
   setAttribute(Qt::WA_DeleteOnClose);
   isUntitled = true;
 }
 
 GLMdiChild::~GLMdiChild() {
+  // The threads must be done with the file before it is deleted
+  stopLoading();
+  stopStats();
+  stopLevels();
+  stopRepair();
+  delete section;
   delete stlFile;
 }
 
@@ -41,43 +74,319 @@ void GLMdiChild::newFile() {
 }
 
 bool GLMdiChild::loadFile(const QString &fileName) {
-  try {
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-    // Open the file and make an object from its content
-    stlFile->open(fileName.toStdString());
-    makeObjectFromStlFile(stlFile);
-    updateGL();
-    setCurrentFile(fileName);
-    QApplication::restoreOverrideCursor();
-    return true;
-  } catch (::std::bad_alloc) {
-    QApplication::restoreOverrideCursor();
+  if (loader != 0)
+    return false;
+  // Remember the file being loaded, so that it isn't opened twice
+  curFile = QFileInfo(fileName).canonicalFilePath();
+  setWindowTitle(tr("%1 (loading)").arg(userFriendlyCurrentFile()));
+  loadingPercent = 0;
+  loadedFacets = 0;
+  previewShown = false;
+  // Read the file in a worker thread, the object is made from its content
+  // in this thread once the reading is done
+  loader = new StlLoader(stlFile, fileName, this);
+  connect(loader, SIGNAL(progressChanged(qlonglong, qlonglong)), this,
+          SLOT(updateLoadingProgress(qlonglong, qlonglong)));
+  connect(loader, SIGNAL(previewReady()), this, SLOT(showPreview()));
+  connect(loader, SIGNAL(finished()), this, SLOT(finishLoading()));
+  loader->start();
+  return true;
+}
+
+void GLMdiChild::cancelLoading() {
+  if (loader != 0)
+    loader->cancel();
+}
+
+void GLMdiChild::updateLoadingProgress(qlonglong bytesRead,
+                                       qlonglong facetsRead) {
+  if (loader == 0)
+    return;
+  if (loader->fileSize() > 0)
+    loadingPercent = static_cast<int>(bytesRead * 100 / loader->fileSize());
+  loadedFacets = facetsRead;
+  emit loadingProgressChanged(loadingPercent, loadedFacets);
+}
+
+void GLMdiChild::showPreview() {
+  if (loader == 0)
+    return;
+  // The worker thread is done with the preview, it is reading the file now
+  makeObjectFromStlFile(loader->previewFile());
+  loader->previewFile()->close();
+  previewShown = true;
+  updateGL();
+}
+
+void GLMdiChild::finishLoading() {
+  QString fileName = loader->fileName();
+  QString errorMessage = loader->errorMessage();
+  bool cancelled = loader->wasCancelled();
+  loader->deleteLater();
+  loader = 0;
+  if (cancelled) {
+    emit loadingFinished(false);
+    return;
+  }
+  if (!errorMessage.isEmpty()) {
     QMessageBox msgBox;
-    msgBox.setText("Problem allocating memory.");
+    msgBox.setText(errorMessage);
     msgBox.exec();
+    emit loadingFinished(false);
+    return;
+  }
+  ::std::vector<StlFile::Warning> warnings = stlFile->getWarnings();
+  for (size_t i = 0; i < warnings.size(); i++) {
+    QErrorMessage errMessage;
+    errMessage.showMessage(QString::fromStdString(warnings[i].message));
+    errMessage.exec();
+  }
+  // The display list can only be made in the GUI thread
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  // Replace the preview without moving the view the user may have changed
+  level = 0;
+  makeObjectFromStlFile(stlFile, !previewShown);
+  previewShown = false;
+  updateGL();
+  setCurrentFile(fileName);
+  QApplication::restoreOverrideCursor();
+  emit loadingFinished(true);
+  startStats();
+}
+
+StlFile::Stats GLMdiChild::getStats() const {
+  // The file is only read here, the stats worker doesn't change its stats
+  // but the repair does
+  StlFile::Stats stats = isRepairing() ? repairedStats : stlFile->getStats();
+  stats.numPoints = numPoints;
+  return stats;
+}
+
+const EdgeAnalysis* GLMdiChild::getEdgeAnalysis() const {
+  return edgesAnalysed ? stlFile->getEdgeAnalysis() : 0;
+}
+
+const MeshValidation* GLMdiChild::getValidation() const {
+  return validated ? stlFile->getValidation() : 0;
+}
+
+const MeshShells* GLMdiChild::getShells() const {
+  return shellsFound ? stlFile->getShells() : 0;
+}
+
+void GLMdiChild::setShellsHidden(const QList<int> &shells, bool hidden) {
+  for (int i = 0; i < shells.size(); i++) {
+    if (shells[i] >= 0 && shells[i] < hiddenShells.size())
+      hiddenShells[shells[i]] = hidden;
+  }
+  updateObject();
+}
+
+void GLMdiChild::isolateShells(const QList<int> &shells) {
+  hiddenShells.fill(true);
+  setShellsHidden(shells, false);
+}
+
+void GLMdiChild::showAllShells() {
+  hiddenShells.fill(false);
+  updateObject();
+}
+
+bool GLMdiChild::exportShells(const QList<int> &shells) {
+  const MeshShells *meshShells = getShells();
+  if (meshShells == 0 || shells.isEmpty())
     return false;
-  } catch (StlFile::wrong_header_size) {
+  QFileInfo fi(curFile);
+  QString name = fi.path() + "/" + strippedName(curFile).section('.', 0, 0);
+  if (shells.size() == 1)
+    name += QString("_shell%1.stl").arg(shells[0] + 1);
+  else
+    name += "_shells.stl";
+  QString filterBin = tr("STL Files, binary (*.stl)");
+  QString filterAscii = tr("STL Files, ASCII (*.stl)");
+  QString filterAll = tr("All files (*.*)");
+  QString filterSel = filterBin;
+  QString fileName = QFileDialog::getSaveFileName(
+      this, tr("Export Shells"), name,
+      filterBin + ";;" + filterAscii + ";;" + filterAll, &filterSel);
+  if (fileName.isEmpty())
+    return false;
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  try {
+    // The shells are written in the order they were selected in
+    ::std::vector<StlFile::Facet> facets;
+    const StlFile::Facet *allFacets = stlFile->getFacets();
+    const uint32_t *order = meshShells->getFacets();
+    for (int i = 0; i < shells.size(); i++) {
+      for (int64_t j = meshShells->getFirstFacet(shells[i]);
+           j < meshShells->getFirstFacet(shells[i] + 1); j++)
+        facets.push_back(allFacets[order[j]]);
+    }
+    StlFile part;
+    part.setFacets(facets.data(), facets.size());
+    part.setFormat(filterSel == filterAscii ? StlFile::ASCII
+                                            : StlFile::BINARY);
+    part.write(fileName.toStdString());
+  } catch (const ::std::bad_alloc&) {
     QApplication::restoreOverrideCursor();
     QMessageBox msgBox;
-    msgBox.setText("The file " + fileName + " has a wrong size.");
+    msgBox.setText(tr("Problem allocating memory."));
     msgBox.exec();
     return false;
-  } catch (StlFile::error_opening_file) { // ::std::ios_base::failure
+  } catch (const ::std::exception&) {
     QApplication::restoreOverrideCursor();
     QMessageBox msgBox;
-    msgBox.setText("The file " + fileName + " could not be opened.");
+    msgBox.setText("Unable to write in " + fileName + ".");
     msgBox.exec();
     return false;
-  } catch (...) {
+  }
+  QApplication::restoreOverrideCursor();
+  return true;
+}
+
+void GLMdiChild::updateObject() {
+  // The facets are being reoriented, they're shown once they are
+  if (isRepairing())
+    return;
+  if (level > 0) {
+    // The reduced facets don't belong to the shells anymore
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    makeObjectFromStlFile(stlFile->getLevel(level), false);
+    updateGL();
     QApplication::restoreOverrideCursor();
+    emit statsChanged();
+    return;
+  }
+  const MeshShells *shells = getShells();
+  ::std::vector<unsigned char> hidden;
+  if (shells != 0 && hiddenShells.contains(true)) {
+    hidden.resize(stlFile->getStats().numFacets);
+    const uint32_t *facetShells = shells->getFacetShells();
+    for (size_t i = 0; i < hidden.size(); i++)
+      hidden[i] = hiddenShells[facetShells[i]];
+  }
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  makeObjectFromStlFile(stlFile, false, hidden.empty() ? 0 : &hidden[0]);
+  if (validated) {
+    // The defects of the hidden shells aren't shown either
+    const uint8_t *flags = stlFile->getValidation()->getFacetFlags();
+    ::std::vector<unsigned char> shown(flags,
+                                       flags + stlFile->getStats().numFacets);
+    for (size_t i = 0; i < hidden.size(); i++) {
+      if (hidden[i])
+        shown[i] = 0;
+    }
+    makeHighlightFromFacets(stlFile, &shown[0]);
+  }
+  updateGL();
+  QApplication::restoreOverrideCursor();
+  emit statsChanged();
+}
+
+void GLMdiChild::clearStats() {
+  numPoints = -1;
+  edgesAnalysed = false;
+  validated = false;
+  shellsFound = false;
+  hiddenShells.clear();
+}
+
+void GLMdiChild::startStats() {
+  clearStats();
+  statsWorker = new StatsWorker(stlFile, this);
+  connect(statsWorker, SIGNAL(pointsCounted(qlonglong)), this,
+          SLOT(setNumPoints(qlonglong)));
+  connect(statsWorker, SIGNAL(validated()), this, SLOT(setValidated()));
+  connect(statsWorker, SIGNAL(edgesAnalysed()), this,
+          SLOT(setEdgesAnalysed()));
+  connect(statsWorker, SIGNAL(shellsFound()), this, SLOT(setShellsFound()));
+  connect(statsWorker, SIGNAL(finished()), this, SLOT(finishStats()));
+  statsWorker->start();
+}
+
+void GLMdiChild::setNumPoints(qlonglong numPoints) {
+  this->numPoints = numPoints;
+  emit statsChanged();
+}
+
+void GLMdiChild::setValidated() {
+  validated = true;
+  // The defective facets are highlighted in the view
+  makeHighlightFromFacets(stlFile, stlFile->getValidation()->getFacetFlags());
+  updateGL();
+  emit statsChanged();
+}
+
+void GLMdiChild::setEdgesAnalysed() {
+  edgesAnalysed = true;
+  emit statsChanged();
+}
+
+void GLMdiChild::setShellsFound() {
+  shellsFound = true;
+  hiddenShells.fill(false, stlFile->getShells()->getNumShells());
+  emit statsChanged();
+}
+
+void GLMdiChild::finishStats() {
+  QString errorMessage = statsWorker->errorMessage();
+  statsWorker->deleteLater();
+  statsWorker = 0;
+  if (!errorMessage.isEmpty()) {
     QMessageBox msgBox;
-    msgBox.setText("Error unknown.");
+    msgBox.setText(tr("Some statistics of %1 could not be computed.\n%2")
+                   .arg(userFriendlyCurrentFile()).arg(errorMessage));
     msgBox.exec();
-    return false;
+  }
+  emit statsChanged();
+}
+
+void GLMdiChild::stopStats() {
+  if (statsWorker != 0) {
+    statsWorker->disconnect(this);
+    // Waits for the worker thread to be done, it can't be interrupted
+    delete statsWorker;
+    statsWorker = 0;
+  }
+}
+
+void GLMdiChild::finishLevels() {
+  QString errorMessage = levelWorker->errorMessage();
+  levelWorker->deleteLater();
+  levelWorker = 0;
+  if (!errorMessage.isEmpty()) {
+    QMessageBox msgBox;
+    msgBox.setText(tr("The levels of detail of %1 could not be made.\n%2")
+                   .arg(userFriendlyCurrentFile()).arg(errorMessage));
+    msgBox.exec();
+    emit statsChanged();
+    return;
+  }
+  if (!setLevel(pendingLevel))
+    emit statsChanged();
+}
+
+void GLMdiChild::stopLevels() {
+  if (levelWorker != 0) {
+    levelWorker->disconnect(this);
+    // Waits for the worker thread to be done, it can't be interrupted
+    delete levelWorker;
+    levelWorker = 0;
+  }
+}
+
+void GLMdiChild::stopLoading() {
+  if (loader != 0) {
+    loader->disconnect(this);
+    // Waits for the worker thread to give up the file
+    delete loader;
+    loader = 0;
   }
 }
 
 bool GLMdiChild::save() {
+  if (isRepairing())
+    return false;
   if (isUntitled) {
     return saveAs();
   } else {
@@ -86,26 +395,48 @@ bool GLMdiChild::save() {
 }
 
 bool GLMdiChild::saveAs() {
-  if (!isUntitled) {
+  if (!isUntitled && !isRepairing()) {
     QString filterBin = tr("STL Files, binary (*.stl)");
     QString filterAscii = tr("STL Files, ASCII (*.stl)");
+    QString filterBinGzip = tr("STL Files, binary, gzip (*.stl.gz)");
+    QString filterAsciiGzip = tr("STL Files, ASCII, gzip (*.stl.gz)");
+    QString filterBinZstd = tr("STL Files, binary, zstd (*.stl.zst)");
+    QString filterAsciiZstd = tr("STL Files, ASCII, zstd (*.stl.zst)");
     QString filterAll = tr("All files (*.*)");
+    QString filters = filterBin + ";;" + filterAscii + ";;" + filterBinGzip +
+                      ";;" + filterAsciiGzip;
+    if (CompressedFile::isSupported(CompressedFile::ZSTD))
+      filters += ";;" + filterBinZstd + ";;" + filterAsciiZstd;
+    filters += ";;" + filterAll;
     QString filterSel;
-    // Set the current file type as default
-    if (stlFile->getStats().type == StlFile::ASCII)
-      filterSel = filterAscii;
+    // Set the current file type and compression as default
+    bool isAscii = stlFile->getStats().type == StlFile::ASCII;
+    CompressedFile::Compression compression =
+        CompressedFile::compressionFromFileName(curFile.toStdString());
+    if (compression == CompressedFile::GZIP)
+      filterSel = isAscii ? filterAsciiGzip : filterBinGzip;
+    else if (compression == CompressedFile::ZSTD)
+      filterSel = isAscii ? filterAsciiZstd : filterBinZstd;
     else
-      filterSel = filterBin;
+      filterSel = isAscii ? filterAscii : filterBin;
     QString fileName = QFileDialog::getSaveFileName(
-        this, tr("Save As"), curFile,
-        filterBin + ";;" + filterAscii + ";;" + filterAll, &filterSel);
+        this, tr("Save As"), curFile, filters, &filterSel);
     if (fileName.isEmpty())
       return false;
     // Change the current file type to the one chosen by the user
-    if (filterSel == filterBin)
+    if (filterSel == filterBin || filterSel == filterBinGzip ||
+        filterSel == filterBinZstd)
       stlFile->setFormat(StlFile::BINARY);
-    else if (filterSel == filterAscii)
+    else if (filterSel == filterAscii || filterSel == filterAsciiGzip ||
+             filterSel == filterAsciiZstd)
       stlFile->setFormat(StlFile::ASCII);
+    // The compression is given by the extension of the file
+    if ((filterSel == filterBinGzip || filterSel == filterAsciiGzip) &&
+        !fileName.endsWith(".gz", Qt::CaseInsensitive))
+      fileName += ".gz";
+    else if ((filterSel == filterBinZstd || filterSel == filterAsciiZstd) &&
+             !fileName.endsWith(".zst", Qt::CaseInsensitive))
+      fileName += ".zst";
     // Save the file
     return saveFile(fileName);
   }
@@ -126,6 +457,12 @@ bool GLMdiChild::saveFile(const QString &fileName) {
     msgBox.setText("Unable to write in " + fileName + ".");
     msgBox.exec();
     return false;
+  } catch (StlFile::error_writing_file) {
+    QApplication::restoreOverrideCursor();
+    QMessageBox msgBox;
+    msgBox.setText("Unable to write in " + fileName + ".");
+    msgBox.exec();
+    return false;
   } catch (...) {
     QApplication::restoreOverrideCursor();
     QMessageBox msgBox;
@@ -158,13 +495,266 @@ bool GLMdiChild::saveImage() {
   return true;
 }
 
+bool GLMdiChild::repair() {
+  // The workers can't be interrupted, the repair would wait for them
+  if (isLoading() || isComputingStats() || isMakingLevels() ||
+      isRepairing() || stlFile->getFacets() == 0)
+    return false;
+  // The section reads the mesh the repair replaces
+  delete section;
+  section = 0;
+  clearSection();
+  // The levels are dropped with the mesh they were made from
+  level = 0;
+  // The stats are computed again once the facets are reoriented
+  clearStats();
+  repairedStats = stlFile->getStats();
+  // The facets are reoriented in a worker thread, finishRepair() shows them
+  // once it is done
+  repairWorker = new RepairWorker(stlFile, this);
+  connect(repairWorker, SIGNAL(finished()), this, SLOT(finishRepair()));
+  repairWorker->start();
+  emit statsChanged();
+  return true;
+}
+
+void GLMdiChild::finishRepair() {
+  MeshRepair repair = repairWorker->getRepair();
+  QString errorMessage = repairWorker->errorMessage();
+  repairWorker->deleteLater();
+  repairWorker = 0;
+  if (!errorMessage.isEmpty()) {
+    QMessageBox msgBox;
+    msgBox.setText(tr("%1 could not be repaired.\n%2")
+                   .arg(userFriendlyCurrentFile()).arg(errorMessage));
+    msgBox.exec();
+    startStats();
+    emit statsChanged();
+    return;
+  }
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  makeObjectFromStlFile(stlFile, false);
+  updateGL();
+  QApplication::restoreOverrideCursor();
+  // The normals have been recomputed even if no facet was flipped
+  setWindowModified(true);
+  startStats();
+  emit statsChanged();
+  QString text = tr("%1 facets flipped, %2 of %3 shells turned inside out.")
+                 .arg(repair.getNumFlippedFacets())
+                 .arg(repair.getNumInvertedShells())
+                 .arg(repair.getNumShells());
+  if (repair.getNumNonOrientableShells() > 0) {
+    text += "\n" + tr("%1 shells can't be oriented consistently.")
+                   .arg(repair.getNumNonOrientableShells());
+  }
+  QMessageBox msgBox;
+  msgBox.setText(text);
+  msgBox.exec();
+}
+
+void GLMdiChild::stopRepair() {
+  if (repairWorker != 0) {
+    repairWorker->disconnect(this);
+    // Waits for the worker thread to be done, it can't be interrupted
+    delete repairWorker;
+    repairWorker = 0;
+  }
+}
+
+bool GLMdiChild::slice() {
+  if (isLoading() || isComputingStats() || isRepairing() ||
+      stlFile->getFacets() == 0)
+    return false;
+  StlFile::Stats stats = stlFile->getStats();
+  bool ok;
+  // A hundred layers by default
+  double layerHeight = QInputDialog::getDouble(
+      this, tr("Slice"), tr("Layer height:"),
+      qMax(stats.size.z / 100.0, 0.0001), 0.0001, 1000000.0, 4, &ok);
+  if (!ok)
+    return false;
+  QFileInfo fi(curFile);
+  QString name = fi.path() + "/" + strippedName(curFile).section('.', 0, 0);
+  QString filterCli = tr("CLI Files (*.cli)");
+  QString filterSvg = tr("SVG Files, one per layer (*.svg)");
+  QString filterSel = filterCli;
+  QString fileName = QFileDialog::getSaveFileName(
+      this, tr("Export Layers"), name + ".cli", filterCli + ";;" + filterSvg,
+      &filterSel);
+  if (fileName.isEmpty())
+    return false;
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  MeshSlicer slicer;
+  try {
+    slicer.slice(stlFile->getMesh(), stats.min.z, stats.max.z, layerHeight);
+    if (filterSel == filterSvg) {
+      // The layers are numbered after the name chosen
+      if (fileName.endsWith(".svg", Qt::CaseInsensitive))
+        fileName.chop(4);
+      slicer.writeSvg((fileName + "_").toStdString());
+    } else {
+      slicer.writeCli(fileName.toStdString());
+    }
+  } catch (const ::std::bad_alloc&) {
+    QApplication::restoreOverrideCursor();
+    QMessageBox msgBox;
+    msgBox.setText(tr("Problem allocating memory."));
+    msgBox.exec();
+    return false;
+  } catch (const ::std::exception& e) {
+    QApplication::restoreOverrideCursor();
+    QMessageBox msgBox;
+    msgBox.setText(QString::fromStdString(e.what()));
+    msgBox.exec();
+    return false;
+  }
+  QApplication::restoreOverrideCursor();
+  if (slicer.getNumOpenPolygons() > 0) {
+    QMessageBox msgBox;
+    msgBox.setText(tr("%1 of the %2 contours don't close, the mesh has "
+                      "holes.").arg(slicer.getNumOpenPolygons())
+                   .arg(slicer.getNumPolygons()));
+    msgBox.exec();
+  }
+  return true;
+}
+
 QString GLMdiChild::userFriendlyCurrentFile() {
   return strippedName(curFile);
 }
 
+bool GLMdiChild::showSection(int axis, double position) {
+  if (isLoading() || isComputingStats() || isRepairing() ||
+      stlFile->getFacets() == 0)
+    return false;
+  if (section == 0 || section->getAxis() != axis) {
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    MeshSection *newSection = new MeshSection;
+    try {
+      newSection->build(stlFile->getMesh(), axis);
+    } catch (const ::std::exception& e) {
+      delete newSection;
+      QApplication::restoreOverrideCursor();
+      QMessageBox msgBox;
+      msgBox.setText(tr("The section of %1 could not be computed.\n%2")
+                     .arg(userFriendlyCurrentFile()).arg(e.what()));
+      msgBox.exec();
+      return false;
+    }
+    delete section;
+    section = newSection;
+    QApplication::restoreOverrideCursor();
+  }
+  // Only the facets around the plane are visited
+  section->cut(position);
+  setSection(section);
+  return true;
+}
+
+void GLMdiChild::hideSection() {
+  // The bins are kept for the next time the section is shown
+  if (isSectionShown())
+    clearSection();
+}
+
+const MeshSection* GLMdiChild::getSection() const {
+  return isSectionShown() ? section : 0;
+}
+
+bool GLMdiChild::setWeldTolerance(float tolerance) {
+  if (tolerance == stlFile->getWeldTolerance())
+    return true;
+  // The workers can't be interrupted, the weld would wait for them
+  if (isLoading() || isComputingStats() || isMakingLevels() || isRepairing())
+    return false;
+  // The section reads the mesh welded again
+  delete section;
+  section = 0;
+  clearSection();
+  // The levels are dropped with the mesh they were made from
+  level = 0;
+  stlFile->setWeldTolerance(tolerance);
+  if (stlFile->getFacets() != 0) {
+    // The shells and the defects are shown again once they're found
+    makeObjectFromStlFile(stlFile, false);
+    updateGL();
+    startStats();
+  }
+  emit statsChanged();
+  return true;
+}
+
+bool GLMdiChild::setLevel(int level) {
+  if (isLoading() || isComputingStats() || isMakingLevels() ||
+      isRepairing() || stlFile->getFacets() == 0)
+    return false;
+  if (level > 0 && stlFile->getNumLevels() == 1) {
+    // The mesh is decimated in a worker thread, finishLevels() shows the
+    // level once it is done
+    pendingLevel = level;
+    levelWorker = new LevelWorker(stlFile, ::std::vector<double>(
+        LEVEL_FRACTIONS, LEVEL_FRACTIONS + 3), this);
+    connect(levelWorker, SIGNAL(finished()), this, SLOT(finishLevels()));
+    levelWorker->start();
+    emit statsChanged();
+    return true;
+  }
+  if (level < 0 || level >= stlFile->getNumLevels())
+    return false;
+  this->level = level;
+  updateObject();
+  return true;
+}
+
+bool GLMdiChild::exportLevel() {
+  if (isRepairing() || stlFile->getFacets() == 0)
+    return false;
+  StlFile *levelFile = stlFile->getLevel(level);
+  QFileInfo fi(curFile);
+  QString name = fi.path() + "/" + strippedName(curFile).section('.', 0, 0) +
+                 QString("_%1.stl").arg(levelFile->getStats().numFacets);
+  QString filterBin = tr("STL Files, binary (*.stl)");
+  QString filterAscii = tr("STL Files, ASCII (*.stl)");
+  QString filterAll = tr("All files (*.*)");
+  QString filterSel = filterBin;
+  QString fileName = QFileDialog::getSaveFileName(
+      this, tr("Export Level"), name,
+      filterBin + ";;" + filterAscii + ";;" + filterAll, &filterSel);
+  if (fileName.isEmpty())
+    return false;
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  try {
+    // Written from a copy, the format of the file shown doesn't change
+    StlFile copy;
+    copy.setFacets(levelFile->getFacets(), levelFile->getStats().numFacets);
+    copy.setFormat(filterSel == filterAscii ? StlFile::ASCII
+                                            : StlFile::BINARY);
+    copy.write(fileName.toStdString());
+  } catch (const ::std::bad_alloc&) {
+    QApplication::restoreOverrideCursor();
+    QMessageBox msgBox;
+    msgBox.setText(tr("Problem allocating memory."));
+    msgBox.exec();
+    return false;
+  } catch (const ::std::exception&) {
+    QApplication::restoreOverrideCursor();
+    QMessageBox msgBox;
+    msgBox.setText("Unable to write in " + fileName + ".");
+    msgBox.exec();
+    return false;
+  }
+  QApplication::restoreOverrideCursor();
+  return true;
+}
+
 void GLMdiChild::closeEvent(QCloseEvent *event) {
-  stlFile->close();
+  stopLoading();
+  stopRepair();
   if (maybeSave()) {
+    stopStats();
+    stopLevels();
+    stlFile->close();
     event->accept();
   } else {
     event->ignore();
@@ -184,7 +774,17 @@ void GLMdiChild::mouseReleaseEvent(QMouseEvent *event) {
 }
 
 bool GLMdiChild::maybeSave() {
-  return true;
+  // Only a repaired file can be modified
+  if (!isWindowModified())
+    return true;
+  QMessageBox::StandardButton answer = QMessageBox::warning(
+      this, tr("STLViewer"),
+      tr("%1 has been repaired.\nDo you want to save your changes?")
+      .arg(userFriendlyCurrentFile()),
+      QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel);
+  if (answer == QMessageBox::Save)
+    return save();
+  return answer == QMessageBox::Discard;
 }
 
 void GLMdiChild::setCurrentFile(const QString &fileName) {
@@ -24,6 +24,15 @@
 #include "glwidget.h"
 #include "stlfile.h"
 
+class EdgeAnalysis;
+class LevelWorker;
+class RepairWorker;
+class MeshSection;
+class MeshShells;
+class MeshValidation;
+class StatsWorker;
+class StlLoader;
+
 class GLMdiChild : public GLWidget {
 
   Q_OBJECT
@@ -32,30 +41,130 @@ class GLMdiChild : public GLWidget {
   GLMdiChild(QWidget *parent = 0);
   ~GLMdiChild();
   void newFile();
+  // Starts loading the file in the background, loadingFinished() is
+  // emitted once it's done
   bool loadFile(const QString &fileName);
+  bool isLoading() const { return loader != 0; };
+  int loadingProgress() const { return loadingPercent; };
+  qint64 loadingFacets() const { return loadedFacets; };
   bool save();
   bool saveAs();
   bool saveFile(const QString &fileName);
   bool saveImage();
+  // Orients the facets consistently and recomputes their normals in the
+  // background, the window is modified once it's done until the file is
+  // saved. The file can't be saved or exported meanwhile.
+  bool repair();
+  bool isRepairing() const { return repairWorker != 0; };
+  // Slices the mesh into layers and writes their contours into the files
+  // chosen by the user. The stats must be done, the mesh being shared.
+  bool slice();
+  // Cuts the mesh by the plane at position along axis, the object being
+  // clipped there. The stats must be done, the mesh being shared. The
+  // facets are only binned again along another axis.
+  bool showSection(int axis, double position);
+  void hideSection();
+  // Returns 0 unless the section is shown
+  const MeshSection* getSection() const;
+  // Shows the mesh reduced to a level of detail, 0 being the full mesh and
+  // 1 to 3 half, a tenth and a hundredth of its facets. The levels are made
+  // in the background on the first call, the level being shown once they
+  // are. The stats must be done, the mesh being shared. The defects and the
+  // hidden shells are only shown at the full level.
+  bool setLevel(int level);
+  int getLevel() const { return level; };
+  bool isMakingLevels() const { return levelWorker != 0; };
+  // Writes the level shown into a new file chosen by the user
+  bool exportLevel();
   QString userFriendlyCurrentFile();
   QString currentFile() { return curFile; };
-  StlFile::Stats getStats() const { return stlFile->getStats(); };
+  // The number of points is -1 until it is counted
+  StlFile::Stats getStats() const;
+  // Returns 0 until the edges are analysed
+  const EdgeAnalysis* getEdgeAnalysis() const;
+  // Returns 0 until the mesh is validated
+  const MeshValidation* getValidation() const;
+  // Returns 0 until the shells are found
+  const MeshShells* getShells() const;
+  // Whether each shell is hidden, empty until the shells are found
+  QVector<bool> getHiddenShells() const { return hiddenShells; };
+  void setShellsHidden(const QList<int> &shells, bool hidden);
+  // Hides all the shells but these
+  void isolateShells(const QList<int> &shells);
+  void showAllShells();
+  // Writes the shells into a new file chosen by the user
+  bool exportShells(const QList<int> &shells);
+  // The stats that take a while are computed in the background once the
+  // file is loaded, statsChanged() is emitted as each of them is known
+  bool isComputingStats() const { return statsWorker != 0; };
+  // The files are loaded through the cache, if any
+  void setMeshCache(MeshCache *cache) { stlFile->setCache(cache); };
+  // Welds the vertices closer than tolerance and computes the stats again.
+  // It can't be changed while the file is loading, being repaired or
+  // analysed.
+  bool setWeldTolerance(float tolerance);
+  float getWeldTolerance() const { return stlFile->getWeldTolerance(); };
   bool isUntitled;
 
+ public slots:
+  void cancelLoading();
+
  signals:
   void mouseButtonPressed(Qt::MouseButtons button);
   void mouseButtonReleased(Qt::MouseButtons button);
+  void loadingProgressChanged(int percent, qlonglong facetsRead);
+  void loadingFinished(bool loaded);
+  void statsChanged();
 
  protected:
   void closeEvent(QCloseEvent *event);
   void mousePressEvent(QMouseEvent *event);
   void mouseReleaseEvent(QMouseEvent *event);
 
+ private slots:
+  void updateLoadingProgress(qlonglong bytesRead, qlonglong facetsRead);
+  void showPreview();
+  void finishLoading();
+  void setNumPoints(qlonglong numPoints);
+  void setValidated();
+  void setEdgesAnalysed();
+  void setShellsFound();
+  void finishStats();
+  void finishLevels();
+  void finishRepair();
+
  private:
+  void stopLoading();
+  // Forgets the stats computed in the background
+  void clearStats();
+  void startStats();
+  void stopStats();
+  void stopLevels();
+  void stopRepair();
+  // Makes the object again without the hidden shells
+  void updateObject();
   bool maybeSave();
   void setCurrentFile(const QString &fileName);
   QString strippedName(const QString &fullFileName);
   StlFile *stlFile;
+  StlLoader *loader;
+  StatsWorker *statsWorker;
+  LevelWorker *levelWorker;
+  RepairWorker *repairWorker;
+  // The stats of the file being repaired, as they were before
+  StlFile::Stats repairedStats;
+  qint64 numPoints;
+  bool edgesAnalysed;
+  bool validated;
+  bool shellsFound;
+  QVector<bool> hiddenShells;
+  MeshSection *section;
+  int level;
+  // The level shown once the levels are made
+  int pendingLevel;
+  bool previewShown;
+  int loadingPercent;
+  qint64 loadedFacets;
   QString curFile;
 };
 
@@ -22,10 +22,12 @@
 #include <QtOpenGL/QtOpenGL>
 
 #include "glwidget.h"
+#include "meshsection.h"
 #include "stlfile.h"
 
 GLWidget::GLWidget(QWidget *parent) : QGLWidget(parent) {
   object = 0;
+  highlight = 0;
   xRot = yRot = zRot = 0;
   xPos= yPos= zPos= 0;
   xTrans= yTrans= zTrans= 0;
@@ -33,14 +35,21 @@ GLWidget::GLWidget(QWidget *parent) : QGLWidget(parent) {
   zoomInc = 0;
   leftMouseButtonMode = INACTIVE;
   wireframeMode = false;
+  highlightMode = true;
   grey = QColor::fromRgbF(0.6, 0.6, 0.6);
   black = QColor::fromRgbF(0.0, 0.0, 0.0);
   purple = QColor::fromCmykF(0.39, 0.39, 0.0, 0.0);
+  red = QColor::fromRgbF(0.9, 0.1, 0.1);
+  yellow = QColor::fromRgbF(1.0, 0.85, 0.0);
+  sectionShown = false;
+  sectionAxis = 2;
+  sectionPosition = 0.0;
 }
 
 GLWidget::~GLWidget() {
   makeCurrent();
   glDeleteLists(object, 1);
+  glDeleteLists(highlight, 1);
 }
 
 QSize GLWidget::minimumSizeHint() const {
@@ -51,40 +60,122 @@ QSize GLWidget::sizeHint() const {
   return QSize(400, 400);
 }
 
-void GLWidget::makeObjectFromStlFile(StlFile *stlfile) {
+void GLWidget::makeObjectFromStlFile(StlFile *stlfile, bool resetView,
+                                     const unsigned char *hidden) {
   makeCurrent();
+  // Replace the previous object, if any, its highlight doesn't apply anymore
+  if (object != 0)
+    glDeleteLists(object, 1);
+  if (highlight != 0)
+    glDeleteLists(highlight, 1);
+  highlight = 0;
+  // Fetch the stats and the facets once, the stats hold a string
+  StlFile::Stats stats = stlfile->getStats();
+  const StlFile::Facet *facets = stlfile->getFacets();
   object = glGenLists(1);
   glNewList(object, GL_COMPILE);
   glBegin(GL_TRIANGLES);
-  for (int i = 0; i < stlfile->getStats().numFacets; ++i) {
-    glNormal3d(stlfile->getFacets()[i].normal.x,
-               stlfile->getFacets()[i].normal.y,
-               stlfile->getFacets()[i].normal.z);
-    triangle(stlfile->getFacets()[i].vector[0].x,
-             stlfile->getFacets()[i].vector[0].y,
-             stlfile->getFacets()[i].vector[0].z,
-             stlfile->getFacets()[i].vector[1].x,
-             stlfile->getFacets()[i].vector[1].y,
-             stlfile->getFacets()[i].vector[1].z,
-             stlfile->getFacets()[i].vector[2].x,
-             stlfile->getFacets()[i].vector[2].y,
-             stlfile->getFacets()[i].vector[2].z);
+  for (int64_t i = 0; i < stats.numFacets; ++i) {
+    if (hidden != 0 && hidden[i] != 0)
+      continue;
+    glNormal3d(facets[i].normal.x,
+               facets[i].normal.y,
+               facets[i].normal.z);
+    triangle(facets[i].vector[0].x,
+             facets[i].vector[0].y,
+             facets[i].vector[0].z,
+             facets[i].vector[1].x,
+             facets[i].vector[1].y,
+             facets[i].vector[1].z,
+             facets[i].vector[2].x,
+             facets[i].vector[2].y,
+             facets[i].vector[2].z);
   }
   glEnd();
   glEndList();
-  xPos = (stlfile->getStats().max.x+stlfile->getStats().min.x)/2;
-  yPos = (stlfile->getStats().max.y+stlfile->getStats().min.y)/2;
-  zPos = (stlfile->getStats().max.z+stlfile->getStats().min.z)/2;
+  xPos = (stats.max.x+stats.min.x)/2;
+  yPos = (stats.max.y+stats.min.y)/2;
+  zPos = (stats.max.z+stats.min.z)/2;
   defaultZoomFactor = qMax(qMax(
-      qAbs(stlfile->getStats().max.x-stlfile->getStats().min.x),
-      qAbs(stlfile->getStats().max.y-stlfile->getStats().min.y)),
-      qAbs(stlfile->getStats().max.z-stlfile->getStats().min.z));
+      qAbs(stats.max.x-stats.min.x),
+      qAbs(stats.max.y-stats.min.y)),
+      qAbs(stats.max.z-stats.min.z));
   zoomInc = defaultZoomFactor/1000;
-  setDefaultView();
+  if (resetView)
+    setDefaultView();
+}
+
+void GLWidget::makeHighlightFromFacets(StlFile *stlfile,
+                                       const unsigned char *flags) {
+  makeCurrent();
+  if (highlight != 0)
+    glDeleteLists(highlight, 1);
+  highlight = 0;
+  int64_t numFacets = stlfile->getStats().numFacets;
+  const StlFile::Facet *facets = stlfile->getFacets();
+  int64_t numFlagged = 0;
+  for (int64_t i = 0; i < numFacets; ++i)
+    numFlagged += flags[i] != 0;
+  if (numFlagged == 0)
+    return;
+  highlight = glGenLists(1);
+  glNewList(highlight, GL_COMPILE);
+  glBegin(GL_TRIANGLES);
+  for (int64_t i = 0; i < numFacets; ++i) {
+    if (flags[i] == 0)
+      continue;
+    glNormal3d(facets[i].normal.x,
+               facets[i].normal.y,
+               facets[i].normal.z);
+    triangle(facets[i].vector[0].x,
+             facets[i].vector[0].y,
+             facets[i].vector[0].z,
+             facets[i].vector[1].x,
+             facets[i].vector[1].y,
+             facets[i].vector[1].z,
+             facets[i].vector[2].x,
+             facets[i].vector[2].y,
+             facets[i].vector[2].z);
+  }
+  glEnd();
+  glEndList();
 }
 
 void GLWidget::deleteObject() {
   glDeleteLists(object, 1);
+  glDeleteLists(highlight, 1);
+  highlight = 0;
+  updateGL();
+}
+
+void GLWidget::setSection(const MeshSection *section) {
+  sectionShown = true;
+  sectionAxis = section->getAxis();
+  sectionPosition = section->getPosition();
+  // The points of the contour are in the coordinates following the axis
+  const MeshSlicer::Layer &contour = section->getContour();
+  int u = (sectionAxis + 1) % 3;
+  int v = (sectionAxis + 2) % 3;
+  sectionPoints.resize(3 * contour.points.size());
+  for (size_t i = 0; i < contour.points.size(); i++) {
+    sectionPoints[3 * i + sectionAxis] = static_cast<float>(sectionPosition);
+    sectionPoints[3 * i + u] = contour.points[i].x;
+    sectionPoints[3 * i + v] = contour.points[i].y;
+  }
+  sectionStarts.resize(contour.starts.size());
+  for (size_t p = 0; p < contour.starts.size(); p++)
+    sectionStarts[p] = static_cast<int>(contour.starts[p]);
+  sectionClosed.resize(contour.closed.size());
+  for (size_t p = 0; p < contour.closed.size(); p++)
+    sectionClosed[p] = contour.closed[p];
+  updateGL();
+}
+
+void GLWidget::clearSection() {
+  sectionShown = false;
+  sectionPoints.clear();
+  sectionStarts.clear();
+  sectionClosed.clear();
   updateGL();
 }
 
@@ -233,6 +324,12 @@ void GLWidget::setWireframeMode(const bool state) {
   updateGL();
 }
 
+void GLWidget::setHighlightMode(const bool state) {
+  makeCurrent();
+  highlightMode = state;
+  updateGL();
+}
+
 void GLWidget::initializeGL() {
   qglClearColor(purple.dark());
   glEnable(GL_DEPTH_TEST);
@@ -273,9 +370,29 @@ void GLWidget::paintGL() {
   else
     glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
   glCullFace(GL_BACK);
+  if (sectionShown) {
+    // Keep what lies below the plane along its axis, where the equation is
+    // not negative
+    GLdouble equation[4] = {0.0, 0.0, 0.0, sectionPosition};
+    equation[sectionAxis] = -1.0;
+    glClipPlane(GL_CLIP_PLANE0, equation);
+    glEnable(GL_CLIP_PLANE0);
+  }
   qglColor(grey);
   glCallList(object);
 
+  if (highlightMode && highlight != 0) {
+    // Pull the highlighted facets towards the viewer, so that they win the
+    // depth test against the same facets of the object
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glEnable(GL_POLYGON_OFFSET_LINE);
+    glPolygonOffset(-1.0, -1.0);
+    qglColor(red);
+    glCallList(highlight);
+    glDisable(GL_POLYGON_OFFSET_LINE);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+  }
+
   if (!wireframeMode) {
     glCullFace(GL_FRONT);
     qglColor(black);
@@ -285,6 +402,10 @@ void GLWidget::paintGL() {
 	  glCullFace(GL_BACK);
   }
 
+  if (sectionShown) {
+    glDisable(GL_CLIP_PLANE0);
+    drawSection();
+  }
   drawAxes();
 }
 
@@ -380,6 +501,21 @@ void GLWidget::normalizeAngle(int *angle) {
     *angle -= 360 * 16;
 }
 
+void GLWidget::drawSection() {
+  glDisable(GL_LIGHTING);
+  glLineWidth(2.0);
+  // The open polygons come from holes in the mesh
+  for (int p = 0; p + 1 < sectionStarts.size(); p++) {
+    qglColor(sectionClosed[p] ? yellow : red);
+    glBegin(sectionClosed[p] ? GL_LINE_LOOP : GL_LINE_STRIP);
+    for (int i = sectionStarts[p]; i < sectionStarts[p + 1]; i++)
+      glVertex3fv(sectionPoints.constData() + 3 * i);
+    glEnd();
+  }
+  glLineWidth(1.0);
+  glEnable(GL_LIGHTING);
+}
+
 void GLWidget::drawAxes() {
   glPushMatrix();
   glDisable(GL_DEPTH_TEST);
@@ -25,6 +25,7 @@
 
 class StlFile;
 class MdiChild;
+class MeshSection;
 
 class GLWidget : public QGLWidget {
 
@@ -40,8 +41,17 @@ class GLWidget : public QGLWidget {
   ~GLWidget();
   QSize minimumSizeHint() const;
   QSize sizeHint() const;
-  void makeObjectFromStlFile(StlFile*);
+  // Leaves out the facets whose hidden flag is not 0, if any
+  void makeObjectFromStlFile(StlFile*, bool resetView = true,
+                             const unsigned char *hidden = 0);
+  // Draws the facets whose flag is not 0 over the object, in red
+  void makeHighlightFromFacets(StlFile*, const unsigned char *flags);
   void deleteObject();
+  // Clips away the part of the object beyond the plane of the section, on
+  // the positive side of its axis, and draws the contour of its last cut
+  void setSection(const MeshSection *section);
+  void clearSection();
+  bool isSectionShown() const { return sectionShown; };
   void setDefaultView();
   void zoom();
   void unzoom();
@@ -53,6 +63,7 @@ class GLWidget : public QGLWidget {
   void setBottomView();
   void setTopFrontLeftView();
   bool isWireframeModeActivated() const { return wireframeMode; };
+  bool isHighlightModeActivated() const { return highlightMode; };
   int getXRot() const { return xRot; };
   int getYRot() const { return yRot; };
   int getZRot() const { return zRot; };
@@ -66,6 +77,7 @@ class GLWidget : public QGLWidget {
   void setZoom(const float zoom);
   void setLeftMouseButtonMode(const GLWidget::LeftMouseButtonMode);
   void setWireframeMode(const bool state);
+  void setHighlightMode(const bool state);
 
  signals:
   void xRotationChanged(const int angle) const;
@@ -89,11 +101,14 @@ class GLWidget : public QGLWidget {
                 GLdouble, GLdouble, GLdouble);
   void normalizeAngle(int *angle);
   void drawAxes();
+  void drawSection();
   void updateCursor();
   //GLfloat panMatrix[16];
   int width, height;
   GLuint object;
+  GLuint highlight;
   bool wireframeMode;
+  bool highlightMode;
   LeftMouseButtonMode leftMouseButtonMode;
   int xRot, yRot, zRot;
   int xPos, yPos, zPos;
@@ -102,7 +117,15 @@ class GLWidget : public QGLWidget {
   float zoomInc;
   float defaultZoomFactor;
   QPoint lastPos;
-  QColor grey, black, purple;
+  QColor grey, black, purple, red, yellow;
+  bool sectionShown;
+  int sectionAxis;
+  double sectionPosition;
+  // Polygon p goes from point sectionStarts[p] to sectionStarts[p + 1] - 1
+  // of sectionPoints, which holds their x, y and z one after the other
+  QVector<GLfloat> sectionPoints;
+  QVector<int> sectionStarts;
+  QVector<bool> sectionClosed;
 };
 
 #endif  // GLWIDGET_H
@@ -0,0 +1,102 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <QtGui/QtGui>
+
+#include "histogramwidget.h"
+
+HistogramWidget::HistogramWidget(QWidget *parent)
+    : QWidget(parent) {
+  setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Fixed);
+}
+
+HistogramWidget::~HistogramWidget() {}
+
+void HistogramWidget::setBins(const QVector<qint64> &counts,
+                              const QVector<double> &limits) {
+  this->counts = counts;
+  this->limits = limits;
+  update();
+}
+
+void HistogramWidget::reset() {
+  counts.clear();
+  limits.clear();
+  update();
+}
+
+QSize HistogramWidget::minimumSizeHint() const {
+  return QSize(100, 60);
+}
+
+QSize HistogramWidget::sizeHint() const {
+  return QSize(200, 80);
+}
+
+int HistogramWidget::binAt(int x) const {
+  if (counts.isEmpty() || width() <= 0)
+    return -1;
+  int bin = x * counts.size() / width();
+  return (bin >= 0 && bin < counts.size()) ? bin : -1;
+}
+
+bool HistogramWidget::event(QEvent *event) {
+  if (event->type() == QEvent::ToolTip) {
+    QHelpEvent *helpEvent = static_cast<QHelpEvent*>(event);
+    int bin = binAt(helpEvent->pos().x());
+    if (bin >= 0 && bin + 1 < limits.size()) {
+      QToolTip::showText(helpEvent->globalPos(),
+                         tr("%1 to %2 mm: %3 edges")
+                         .arg(limits[bin], 0, 'g', 4)
+                         .arg(limits[bin + 1], 0, 'g', 4)
+                         .arg(counts[bin]));
+    } else {
+      QToolTip::hideText();
+      event->ignore();
+    }
+    return true;
+  }
+  return QWidget::event(event);
+}
+
+void HistogramWidget::paintEvent(QPaintEvent *) {
+  QPainter painter(this);
+  painter.fillRect(rect(), palette().base());
+  painter.setPen(palette().mid().color());
+  painter.drawRect(rect().adjusted(0, 0, -1, -1));
+  qint64 maxCount = 0;
+  for (int i = 0; i < counts.size(); i++)
+    maxCount = qMax(maxCount, counts[i]);
+  if (maxCount == 0)
+    return;
+  // Each bar takes the same share of the width, its height is relative to
+  // the fullest bin
+  int height = this->height() - 2;
+  for (int i = 0; i < counts.size(); i++) {
+    int left = 1 + i * (width() - 2) / counts.size();
+    int right = 1 + (i + 1) * (width() - 2) / counts.size();
+    int barHeight = static_cast<int>(height * counts[i] / maxCount);
+    if (counts[i] > 0 && barHeight == 0)
+      barHeight = 1;
+    painter.fillRect(left, 1 + height - barHeight, qMax(1, right - left - 1),
+                     barHeight, palette().highlight());
+  }
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef HISTOGRAMWIDGET_H
+#define HISTOGRAMWIDGET_H
+
+#include <QtCore/QVector>
+#include <QtGui/QWidget>
+
+// HistogramWidget Class - Draws the bins of a histogram as bars
+// Hovering over a bar shows its limits and its count.
+class HistogramWidget : public QWidget {
+
+  Q_OBJECT
+
+ public:
+  HistogramWidget(QWidget *parent = 0);
+  ~HistogramWidget();
+  // There is one more limit than counts, bin i going from limits[i] to
+  // limits[i + 1]
+  void setBins(const QVector<qint64> &counts, const QVector<double> &limits);
+  void reset();
+  QSize minimumSizeHint() const;
+  QSize sizeHint() const;
+
+ protected:
+  bool event(QEvent *event);
+  void paintEvent(QPaintEvent *event);
+
+ private:
+  int binAt(int x) const;
+  QVector<qint64> counts;
+  QVector<double> limits;
+};
+
+#endif  // HISTOGRAMWIDGET_H
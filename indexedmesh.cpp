@@ -0,0 +1,349 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <math.h>
+#include <algorithm>
+#include <cstring>
+
+#include "indexedmesh.h"
+#include "parallel.h"
+
+// Corners handled by one task
+#define WELD_BLOCK_SIZE 65536
+// The corners are split into this many parts by hash, welded independently
+#define WELD_PARTITION_BITS 8
+#define WELD_NUM_PARTITIONS (1 << WELD_PARTITION_BITS)
+#define WELD_EMPTY_SLOT 0xffffffffu
+// Bound of the coordinates of the cells of the tolerance weld, well within
+// the range of int64_t
+#define WELD_MAX_CELL 4.0e18
+
+namespace {
+
+// Position of a corner as compared when welding: the bits of its
+// coordinates, or the cube of the grid a vertex falls into
+typedef struct {
+  int64_t x;
+  int64_t y;
+  int64_t z;
+} WeldKey;
+
+typedef struct {
+  uint32_t corner;
+  uint32_t hash;
+} WeldSlot;
+
+class Welder {
+ public:
+  explicit Welder(const StlFile::Facet *facets) : facets(facets) {}
+
+  const StlFile::Vertex& getCorner(uint32_t corner) const {
+    return facets[corner / 3].vector[corner % 3];
+  }
+
+  WeldKey getKey(uint32_t corner) const {
+    const StlFile::Vertex &v = getCorner(corner);
+    WeldKey key;
+    // Adding 0 turns -0 into +0, which is the same position
+    key.x = floatBits(v.x + 0.0f);
+    key.y = floatBits(v.y + 0.0f);
+    key.z = floatBits(v.z + 0.0f);
+    return key;
+  }
+
+  static uint64_t hashKey(const WeldKey& key) {
+    uint64_t hash = key.x * 0x9e3779b97f4a7c15ULL;
+    hash ^= key.y * 0xc2b2ae3d27d4eb4fULL + (hash >> 29);
+    hash ^= key.z * 0x165667b19e3779f9ULL + (hash >> 32);
+    // Final mix of splitmix64, so that all the bits depend on all the keys
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+  }
+
+  static bool equalKeys(const WeldKey& a, const WeldKey& b) {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+  }
+
+ private:
+  static int64_t floatBits(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+  }
+
+  const StlFile::Facet *facets;
+};
+
+// The grid cells the vertices are looked up in when welding with a
+// tolerance. A cell is twice as wide as the tolerance, so that the
+// vertices within the tolerance of a point are all in the 2 by 2 by 2
+// cells around it: its own cell and, along each axis, the neighbour on the
+// side of the nearer face.
+class WeldGrid {
+ public:
+  explicit WeldGrid(float tolerance) : cellSize(2.0 * tolerance) {}
+
+  // Returns false if the vertex is too far away, or not a number, to fall
+  // into a cell whose coordinates fit into 64 bits
+  bool getCell(const StlFile::Vertex& v, WeldKey *cell,
+               int neighbours[3]) const {
+    double position[3] = {v.x / cellSize, v.y / cellSize, v.z / cellSize};
+    int64_t *coordinates[3] = {&cell->x, &cell->y, &cell->z};
+    for (int i = 0; i < 3; i++) {
+      // Also false for NaN
+      if (!(fabs(position[i]) < WELD_MAX_CELL))
+        return false;
+      double coordinate = floor(position[i]);
+      *coordinates[i] = static_cast<int64_t>(coordinate);
+      neighbours[i] = position[i] - coordinate < 0.5 ? -1 : 1;
+    }
+    return true;
+  }
+
+ private:
+  double cellSize;
+};
+
+}  // namespace
+
+IndexedMesh::IndexedMesh() {
+  tolerance = 0.0;
+}
+
+void IndexedMesh::clear() {
+  ::std::vector<StlFile::Vertex>().swap(vertices);
+  ::std::vector<uint32_t>().swap(indices);
+}
+
+void IndexedMesh::build(const StlFile::Facet *facets, int64_t numFacets,
+                        float tolerance) {
+  clear();
+  this->tolerance = tolerance;
+  if (numFacets <= 0)
+    return;
+  if (numFacets * 3 >= WELD_EMPTY_SLOT)
+    throw StlFile::error("Too many facets to index the mesh");
+  uint32_t numCorners = static_cast<uint32_t>(numFacets * 3);
+  int numBlocks = static_cast<int>(
+      (static_cast<int64_t>(numCorners) + WELD_BLOCK_SIZE - 1) /
+      WELD_BLOCK_SIZE);
+  // The last corner of a block plus one, which may not fit into 32 bits
+  // for the last block
+  auto getBlockEnd = [numCorners](int block) {
+    return static_cast<uint32_t>(::std::min<int64_t>(
+        static_cast<int64_t>(block + 1) * WELD_BLOCK_SIZE, numCorners));
+  };
+  Welder welder(facets);
+
+  // Sort the corners into partitions by hash, keeping their order within
+  // each partition, so that equal corners always end up in the same one
+  ::std::vector<uint8_t> partitionOf(numCorners);
+  ::std::vector<uint32_t> counts(numBlocks * WELD_NUM_PARTITIONS, 0);
+  Parallel::run(numBlocks, [&](int block) {
+    uint32_t begin = block * WELD_BLOCK_SIZE;
+    uint32_t end = getBlockEnd(block);
+    uint32_t *count = &counts[block * WELD_NUM_PARTITIONS];
+    for (uint32_t c = begin; c < end; c++) {
+      uint64_t hash = Welder::hashKey(welder.getKey(c));
+      partitionOf[c] = static_cast<uint8_t>(hash >> (64 - WELD_PARTITION_BITS));
+      count[partitionOf[c]]++;
+    }
+  });
+  ::std::vector<uint32_t> partitionStart(WELD_NUM_PARTITIONS + 1);
+  uint32_t offset = 0;
+  for (int p = 0; p < WELD_NUM_PARTITIONS; p++) {
+    partitionStart[p] = offset;
+    for (int block = 0; block < numBlocks; block++) {
+      uint32_t count = counts[block * WELD_NUM_PARTITIONS + p];
+      counts[block * WELD_NUM_PARTITIONS + p] = offset;
+      offset += count;
+    }
+  }
+  partitionStart[WELD_NUM_PARTITIONS] = offset;
+  ::std::vector<uint32_t> sorted(numCorners);
+  Parallel::run(numBlocks, [&](int block) {
+    uint32_t begin = block * WELD_BLOCK_SIZE;
+    uint32_t end = getBlockEnd(block);
+    uint32_t *next = &counts[block * WELD_NUM_PARTITIONS];
+    for (uint32_t c = begin; c < end; c++)
+      sorted[next[partitionOf[c]]++] = c;
+  });
+  ::std::vector<uint8_t>().swap(partitionOf);
+
+  // Weld each partition with its own open addressing table. first[c] is
+  // the first corner at the same position as c.
+  ::std::vector<uint32_t> first(numCorners);
+  Parallel::run(WELD_NUM_PARTITIONS, [&](int p) {
+    uint32_t size = partitionStart[p + 1] - partitionStart[p];
+    if (size == 0)
+      return;
+    // Keep the table at most half full
+    uint64_t mask = 1;
+    while (mask < static_cast<uint64_t>(size) * 2)
+      mask <<= 1;
+    mask--;
+    WeldSlot emptySlot = {WELD_EMPTY_SLOT, 0};
+    ::std::vector<WeldSlot> table(mask + 1, emptySlot);
+    for (uint32_t i = partitionStart[p]; i < partitionStart[p + 1]; i++) {
+      uint32_t c = sorted[i];
+      WeldKey key = welder.getKey(c);
+      uint32_t hash = static_cast<uint32_t>(Welder::hashKey(key));
+      for (uint64_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+        WeldSlot &entry = table[slot];
+        if (entry.corner == WELD_EMPTY_SLOT) {
+          entry.corner = c;
+          entry.hash = hash;
+          first[c] = c;
+          break;
+        }
+        if (entry.hash == hash &&
+            Welder::equalKeys(welder.getKey(entry.corner), key)) {
+          first[c] = entry.corner;
+          break;
+        }
+      }
+    }
+  });
+
+  // Number the vertices in the order of their first corner: count them per
+  // block, then number each block from its offset
+  ::std::vector<uint32_t> &ids = sorted;
+  ::std::vector<uint32_t> blockStart(numBlocks + 1, 0);
+  Parallel::run(numBlocks, [&](int block) {
+    uint32_t begin = block * WELD_BLOCK_SIZE;
+    uint32_t end = getBlockEnd(block);
+    uint32_t count = 0;
+    for (uint32_t c = begin; c < end; c++)
+      count += first[c] == c;
+    blockStart[block + 1] = count;
+  });
+  for (int block = 0; block < numBlocks; block++)
+    blockStart[block + 1] += blockStart[block];
+  vertices.resize(blockStart[numBlocks]);
+  Parallel::run(numBlocks, [&](int block) {
+    uint32_t begin = block * WELD_BLOCK_SIZE;
+    uint32_t end = getBlockEnd(block);
+    uint32_t id = blockStart[block];
+    for (uint32_t c = begin; c < end; c++) {
+      if (first[c] == c) {
+        vertices[id] = welder.getCorner(c);
+        ids[c] = id++;
+      }
+    }
+  });
+  // The first corner always comes before, so its id is already known. Each
+  // corner only reads and writes its own entry of first, which becomes the
+  // index buffer.
+  Parallel::run(numBlocks, [&](int block) {
+    uint32_t begin = block * WELD_BLOCK_SIZE;
+    uint32_t end = getBlockEnd(block);
+    for (uint32_t c = begin; c < end; c++)
+      first[c] = ids[first[c]];
+  });
+  indices.swap(first);
+  if (tolerance > 0.0)
+    weld(tolerance);
+}
+
+void IndexedMesh::weld(float tolerance) {
+  // The vertices are taken in order. Each one is merged into the first
+  // vertex kept before it within the tolerance, if any, or kept otherwise,
+  // so that the vertices kept are all further apart than the tolerance.
+  // This depends on the order of the vertices, so it is done on a single
+  // core, but only once the positions that are exactly equal were merged.
+  uint32_t numVertices = static_cast<uint32_t>(vertices.size());
+  WeldGrid grid(tolerance);
+  double squaredTolerance = static_cast<double>(tolerance) * tolerance;
+  // The vertices kept in a cell are chained from the last one through next
+  uint64_t mask = 1;
+  while (mask < static_cast<uint64_t>(numVertices) * 2)
+    mask <<= 1;
+  mask--;
+  WeldSlot emptySlot = {WELD_EMPTY_SLOT, 0};
+  ::std::vector<WeldSlot> table(mask + 1, emptySlot);
+  ::std::vector<uint32_t> next(numVertices, WELD_EMPTY_SLOT);
+  ::std::vector<uint32_t> ids(numVertices);
+  ::std::vector<StlFile::Vertex> kept;
+  uint32_t numKept = 0;
+  // Returns the slot of a cell, empty if no vertex was kept in it
+  auto findSlot = [&](const WeldKey& cell, uint32_t hash) -> WeldSlot& {
+    for (uint64_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+      WeldSlot &entry = table[slot];
+      WeldKey entryCell;
+      int neighbours[3];
+      if (entry.corner == WELD_EMPTY_SLOT ||
+          (entry.hash == hash &&
+           grid.getCell(vertices[entry.corner], &entryCell, neighbours) &&
+           Welder::equalKeys(entryCell, cell)))
+        return entry;
+    }
+  };
+  for (uint32_t v = 0; v < numVertices; v++) {
+    const StlFile::Vertex &p = vertices[v];
+    WeldKey cell;
+    int neighbours[3];
+    if (!grid.getCell(p, &cell, neighbours)) {
+      kept.push_back(p);
+      ids[v] = numKept++;
+      continue;
+    }
+    uint32_t closest = WELD_EMPTY_SLOT;
+    for (int i = 0; i < 8; i++) {
+      WeldKey around = cell;
+      around.x += (i & 1) ? neighbours[0] : 0;
+      around.y += (i & 2) ? neighbours[1] : 0;
+      around.z += (i & 4) ? neighbours[2] : 0;
+      const WeldSlot &entry = findSlot(
+          around, static_cast<uint32_t>(Welder::hashKey(around)));
+      for (uint32_t u = entry.corner; u != WELD_EMPTY_SLOT; u = next[u]) {
+        const StlFile::Vertex &q = vertices[u];
+        double dx = static_cast<double>(q.x) - p.x;
+        double dy = static_cast<double>(q.y) - p.y;
+        double dz = static_cast<double>(q.z) - p.z;
+        if (dx * dx + dy * dy + dz * dz <= squaredTolerance)
+          closest = ::std::min(closest, u);
+      }
+    }
+    if (closest != WELD_EMPTY_SLOT) {
+      ids[v] = ids[closest];
+    } else {
+      uint32_t hash = static_cast<uint32_t>(Welder::hashKey(cell));
+      WeldSlot &entry = findSlot(cell, hash);
+      next[v] = entry.corner;
+      entry.corner = v;
+      entry.hash = hash;
+      kept.push_back(p);
+      ids[v] = numKept++;
+    }
+  }
+  ::std::vector<WeldSlot>().swap(table);
+  ::std::vector<uint32_t>().swap(next);
+  vertices.swap(kept);
+  int64_t numIndices = indices.size();
+  Parallel::run(static_cast<int>((numIndices + WELD_BLOCK_SIZE - 1) /
+                                 WELD_BLOCK_SIZE), [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * WELD_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + WELD_BLOCK_SIZE, numIndices);
+    for (int64_t i = begin; i < end; i++)
+      indices[i] = ids[indices[i]];
+  });
+}
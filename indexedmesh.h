@@ -0,0 +1,64 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef INDEXEDMESH_H
+#define INDEXEDMESH_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "stlfile.h"
+
+// IndexedMesh Class - The facets of a file welded into shared vertices
+// Each corner of a facet becomes an index into the array of vertices, and
+// corners at the same position share the same vertex. The vertices are in
+// the order their first corner appears in, so that the result doesn't
+// depend on the number of threads used to build it.
+class IndexedMesh {
+ public:
+  IndexedMesh();
+  // Welds the corners of the facets. Corners at exactly the same position
+  // are always merged. With a tolerance, each vertex is also merged into
+  // the first vertex before it within that distance which wasn't merged
+  // itself, so that the vertices left are further apart than the
+  // tolerance. Throws StlFile::error if there are too many corners to be
+  // indexed with 32 bits.
+  void build(const StlFile::Facet *facets, int64_t numFacets,
+             float tolerance = 0.0);
+  void clear();
+  int64_t getNumVertices() const { return vertices.size(); };
+  int64_t getNumTriangles() const { return indices.size() / 3; };
+  float getTolerance() const { return tolerance; };
+  const StlFile::Vertex* getVertices() const { return vertices.data(); };
+  // Three indices per triangle, in the order of the facets
+  const uint32_t* getIndices() const { return indices.data(); };
+
+ private:
+  // Stores the results into its entries and restores them as they are
+  friend class MeshCache;
+  // Merges the vertices within the tolerance, once the exact ones are
+  void weld(float tolerance);
+  ::std::vector<StlFile::Vertex> vertices;
+  ::std::vector<uint32_t> indices;
+  float tolerance;
+};
+
+#endif  // INDEXEDMESH_H
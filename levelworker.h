@@ -0,0 +1,54 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef LEVELWORKER_H
+#define LEVELWORKER_H
+
+#include <QtCore/QThread>
+#include <vector>
+
+#include "stlfile.h"
+
+// Makes the levels of detail of a file in a worker thread, so that the
+// window stays responsive while the mesh is decimated. finished() is
+// delivered to the window once the levels are made. The file must not be
+// changed or closed before the thread is finished.
+class LevelWorker : public QThread {
+
+  Q_OBJECT
+
+ public:
+  LevelWorker(StlFile *stlFile, const ::std::vector<double>& fractions,
+              QObject *parent = 0);
+  ~LevelWorker();
+  // Returns the reason why the levels couldn't be made, empty on success
+  QString errorMessage() const { return error; };
+
+ protected:
+  void run();
+
+ private:
+  StlFile *stlFile;
+  ::std::vector<double> fractions;
+  QString error;
+};
+
+#endif  // LEVELWORKER_H
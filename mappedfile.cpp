@@ -0,0 +1,144 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.h"
+
+MappedFile::MappedFile() {
+  data = 0;
+  size = 0;
+  opened = false;
+#ifdef _WIN32
+  fileHandle = INVALID_HANDLE_VALUE;
+  mappingHandle = 0;
+#endif
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const ::std::string& fileName, bool copyOnWrite) {
+  close();
+  fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, 0,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+  if (fileHandle == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(fileHandle, &fileSize) ||
+      static_cast<unsigned long long>(fileSize.QuadPart) >
+      static_cast<size_t>(-1)) {
+    close();
+    return false;
+  }
+  size = static_cast<size_t>(fileSize.QuadPart);
+  // An empty file can't be mapped, but it is still a valid file
+  if (size == 0) {
+    opened = true;
+    return true;
+  }
+  mappingHandle = CreateFileMappingA(
+      fileHandle, 0, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, 0);
+  if (mappingHandle == 0) {
+    close();
+    return false;
+  }
+  data = static_cast<const char*>(MapViewOfFile(
+      mappingHandle, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0));
+  if (data == 0) {
+    close();
+    return false;
+  }
+  opened = true;
+  return true;
+}
+
+void MappedFile::close() {
+  if (data != 0)
+    UnmapViewOfFile(data);
+  if (mappingHandle != 0)
+    CloseHandle(mappingHandle);
+  if (fileHandle != INVALID_HANDLE_VALUE)
+    CloseHandle(fileHandle);
+  data = 0;
+  size = 0;
+  opened = false;
+  fileHandle = INVALID_HANDLE_VALUE;
+  mappingHandle = 0;
+}
+
+#else
+
+bool MappedFile::open(const ::std::string& fileName, bool copyOnWrite) {
+  close();
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat fileInfo;
+  if (fstat(fd, &fileInfo) != 0 ||
+      static_cast<unsigned long long>(fileInfo.st_size) >
+      static_cast<size_t>(-1)) {
+    ::close(fd);
+    return false;
+  }
+  size = static_cast<size_t>(fileInfo.st_size);
+  // An empty file can't be mapped, but it is still a valid file
+  if (size == 0) {
+    ::close(fd);
+    opened = true;
+    return true;
+  }
+  void *address = mmap(0, size,
+                       copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ,
+                       MAP_PRIVATE, fd, 0);
+  // The mapping stays valid once the descriptor is closed
+  ::close(fd);
+  if (address == MAP_FAILED) {
+    size = 0;
+    return false;
+  }
+  // The file is read from the beginning to the end, so let the kernel
+  // read ahead aggressively
+  madvise(address, size, MADV_SEQUENTIAL);
+  data = static_cast<const char*>(address);
+  opened = true;
+  return true;
+}
+
+void MappedFile::close() {
+  if (data != 0)
+    munmap(const_cast<char*>(data), size);
+  data = 0;
+  size = 0;
+  opened = false;
+}
+
+#endif
@@ -0,0 +1,57 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+// MappedFile Class - A read-only memory mapping of a whole file
+// The content of the file is accessed in place through getData(), without
+// copying it through a stream into an intermediate buffer
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+  // Maps the given file into memory, returns false if it can't be done.
+  // A copy-on-write mapping can be written to through getData(), the
+  // changes are private to the mapping and never reach the file.
+  bool open(const ::std::string& fileName, bool copyOnWrite = false);
+  // Unmaps the file
+  void close();
+  bool isOpen() const { return opened; };
+  const char* getData() const { return data; };
+  size_t getSize() const { return size; };
+
+ private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+  const char *data;
+  size_t size;
+  bool opened;
+#ifdef _WIN32
+  void *fileHandle;
+  void *mappingHandle;
+#endif
+};
+
+#endif  // MAPPEDFILE_H
@@ -0,0 +1,486 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <utime.h>
+#endif
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "indexedmesh.h"
+#include "meshcache.h"
+#include "meshshells.h"
+#include "meshvalidation.h"
+
+#define CACHE_MAGIC "STLCACHE"
+// Must be increased whenever the layout of an entry changes
+#define CACHE_VERSION 7
+#define CACHE_BYTE_ORDER 0x01020304
+#define CACHE_EXTENSION ".stlcache"
+// The facets and the arrays of an entry start on a multiple of this many
+// bytes
+#define CACHE_ALIGNMENT 64
+// Blocks of the file hashed to tell if its content changed
+#define HASH_BLOCK_SIZE 4096
+#define HASH_NUM_BLOCKS 64
+
+typedef struct {
+  ::std::string name;
+  int64_t       size;
+  int64_t       time;
+} CacheEntry;
+
+// FNV-1a, good enough to tell if a file changed
+static uint64_t hashBytes(const char *bytes, size_t size,
+                          uint64_t hash = 14695981039346656037ULL) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<unsigned char>(bytes[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static bool getFileInfo(const ::std::string& fileName, int64_t *size,
+                        int64_t *time) {
+#ifdef _WIN32
+  struct _stat64 info;
+  if (_stat64(fileName.c_str(), &info) != 0)
+    return false;
+#else
+  struct stat info;
+  if (stat(fileName.c_str(), &info) != 0)
+    return false;
+#endif
+  *size = info.st_size;
+  *time = info.st_mtime;
+  return true;
+}
+
+static ::std::string getCanonicalPath(const ::std::string& fileName) {
+#ifdef _WIN32
+  char *path = _fullpath(0, fileName.c_str(), 0);
+#else
+  char *path = realpath(fileName.c_str(), 0);
+#endif
+  if (path == 0)
+    return fileName;
+  ::std::string canonicalPath = path;
+  free(path);
+  return canonicalPath;
+}
+
+static void listEntries(const ::std::string& directory,
+                        ::std::vector<CacheEntry>& entries) {
+  size_t extensionSize = strlen(CACHE_EXTENSION);
+  ::std::vector< ::std::string> names;
+#ifdef _WIN32
+  WIN32_FIND_DATAA findData;
+  HANDLE find = FindFirstFileA((directory + "/*" CACHE_EXTENSION).c_str(),
+                               &findData);
+  if (find != INVALID_HANDLE_VALUE) {
+    do {
+      names.push_back(findData.cFileName);
+    } while (FindNextFileA(find, &findData));
+    FindClose(find);
+  }
+#else
+  DIR *dir = opendir(directory.c_str());
+  if (dir != 0) {
+    while (struct dirent *entry = readdir(dir))
+      names.push_back(entry->d_name);
+    closedir(dir);
+  }
+#endif
+  for (size_t i = 0; i < names.size(); i++) {
+    if (names[i].size() <= extensionSize ||
+        names[i].compare(names[i].size() - extensionSize, extensionSize,
+                         CACHE_EXTENSION) != 0)
+      continue;
+    CacheEntry entry;
+    entry.name = directory + "/" + names[i];
+    if (getFileInfo(entry.name, &entry.size, &entry.time))
+      entries.push_back(entry);
+  }
+}
+
+static int64_t alignOffset(int64_t offset) {
+  return (offset + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+}
+
+// Pads the file from position up to offset, then writes size bytes there
+static bool writeAt(FILE *file, int64_t *position, int64_t offset,
+                    const void *data, int64_t size) {
+  static const char padding[CACHE_ALIGNMENT] = {0};
+  size_t paddingSize = static_cast<size_t>(offset - *position);
+  if (fwrite(padding, 1, paddingSize, file) != paddingSize ||
+      fwrite(data, 1, size, file) != static_cast<size_t>(size))
+    return false;
+  *position = offset + size;
+  return true;
+}
+
+// Creates a file next to entryName, under a name no other file has, and
+// opens it for writing. The caches of other processes may share the
+// directory, so the file is created exclusively.
+static FILE* createTempFile(const ::std::string& entryName,
+                            ::std::string *tempName) {
+  static ::std::atomic<unsigned> counter(0);
+  for (int attempt = 0; attempt < 100; attempt++) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%u.tmp", counter++);
+    *tempName = entryName + suffix;
+    FILE *file = fopen(tempName->c_str(), "wbx");
+    if (file != 0 || errno != EEXIST)
+      return file;
+  }
+  return 0;
+}
+
+static bool compareEntryTimes(const CacheEntry& i, const CacheEntry& j) {
+  return i.time < j.time;
+}
+
+MeshCache::MeshCache(const ::std::string& directory, int64_t maxSize) {
+  this->directory = directory;
+  this->maxSize = maxSize;
+}
+
+bool MeshCache::getKey(const ::std::string& fileName, Key *key) {
+  key->path = getCanonicalPath(fileName);
+  if (!getFileInfo(key->path, &key->fileSize, &key->fileTime))
+    return false;
+  ::std::ifstream file(key->path.c_str(), ::std::ios::binary);
+  if (!file.is_open())
+    return false;
+  // Hash blocks evenly spread from the beginning to the end of the file
+  char block[HASH_BLOCK_SIZE];
+  uint64_t hash = hashBytes(0, 0);
+  int64_t numBlocks = (key->fileSize + HASH_BLOCK_SIZE - 1) / HASH_BLOCK_SIZE;
+  int64_t numHashedBlocks = ::std::min(numBlocks,
+                                       static_cast<int64_t>(HASH_NUM_BLOCKS));
+  for (int64_t i = 0; i < numHashedBlocks; i++) {
+    int64_t index = numHashedBlocks > 1 ?
+        i * (numBlocks - 1) / (numHashedBlocks - 1) : 0;
+    file.seekg(index * HASH_BLOCK_SIZE, ::std::ios::beg);
+    file.read(block, HASH_BLOCK_SIZE);
+    hash = hashBytes(block, file.gcount(), hash);
+    file.clear();
+  }
+  key->contentHash = hash;
+  return true;
+}
+
+const StlFile::Facet* MeshCache::lookup(const Key& key, MappedFile *entry,
+                                        StlFile::Stats *stats) {
+  ::std::string entryName = getEntryName(key.path);
+  // The facets may be changed once they are loaded, but not the entry
+  if (!entry->open(entryName, true))
+    return 0;
+  EntryHeader header;
+  const char *data = entry->getData();
+  if (entry->getSize() < sizeof(header)) {
+    entry->close();
+    return 0;
+  }
+  memcpy(&header, data, sizeof(header));
+  // The counts are bounded first, so that the layout can't overflow
+  int64_t entrySize = entry->getSize();
+  bool valid =
+      memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+      header.version == CACHE_VERSION &&
+      header.byteOrder == CACHE_BYTE_ORDER &&
+      header.facetSize == sizeof(StlFile::Facet) &&
+      header.fileSize == key.fileSize && header.fileTime == key.fileTime &&
+      header.contentHash == key.contentHash &&
+      header.facetsOffset % CACHE_ALIGNMENT == 0 &&
+      sizeof(header) + header.pathSize + header.headerSize <=
+          static_cast<uint64_t>(header.facetsOffset) &&
+      header.numFacets >= 0 && header.numFacets <= entrySize &&
+      (!header.hasResults ||
+       (header.shellSize == sizeof(MeshShells::Shell) &&
+        header.numVertices >= 0 && header.numVertices <= entrySize &&
+        header.numShells >= 0 && header.numShells <= entrySize)) &&
+      getLayout(header).end == entrySize &&
+      key.path.compare(0, ::std::string::npos, data + sizeof(header),
+                       header.pathSize) == 0;
+  if (!valid) {
+    entry->close();
+    return 0;
+  }
+  stats->header.assign(data + sizeof(header) + header.pathSize,
+                       header.headerSize);
+  stats->type = header.type == StlFile::ASCII ? StlFile::ASCII :
+                                                StlFile::BINARY;
+  stats->numFacets = header.numFacets;
+  stats->numPoints = header.numPoints;
+  stats->max = Vector(header.max[0], header.max[1], header.max[2]);
+  stats->min = Vector(header.min[0], header.min[1], header.min[2]);
+  stats->size = Vector(header.size[0], header.size[1], header.size[2]);
+  stats->boundingDiameter = header.boundingDiameter;
+  stats->shortestEdge = header.shortestEdge;
+  stats->longestEdge = header.longestEdge;
+  stats->volume = header.volume;
+  stats->surface = header.surface;
+  // The time of an entry is the last time it was used
+  utime(entryName.c_str(), 0);
+  return reinterpret_cast<const StlFile::Facet*>(data + header.facetsOffset);
+}
+
+bool MeshCache::restore(const MappedFile& entry, float tolerance,
+                        IndexedMesh *mesh, MeshValidation *validation,
+                        EdgeAnalysis *edgeAnalysis, MeshShells *shells) {
+  EntryHeader header;
+  const char *data = entry.getData();
+  if (!entry.isOpen() || entry.getSize() < sizeof(header))
+    return false;
+  memcpy(&header, data, sizeof(header));
+  if (!header.hasResults || header.weldTolerance != tolerance)
+    return false;
+  EntryLayout layout = getLayout(header);
+  int64_t numFacets = header.numFacets;
+  const StlFile::Vertex *vertices =
+      reinterpret_cast<const StlFile::Vertex*>(data + layout.vertices);
+  mesh->vertices.assign(vertices, vertices + header.numVertices);
+  const uint32_t *indices =
+      reinterpret_cast<const uint32_t*>(data + layout.indices);
+  mesh->indices.assign(indices, indices + numFacets * 3);
+  mesh->tolerance = header.weldTolerance;
+  const uint8_t *facetFlags =
+      reinterpret_cast<const uint8_t*>(data + layout.facetFlags);
+  validation->facetFlags.assign(facetFlags, facetFlags + numFacets);
+  validation->numEdges = header.numEdges;
+  validation->numNonManifoldEdges = header.numNonManifoldEdges;
+  validation->numBoundaryEdges = header.numBoundaryEdges;
+  validation->numHoles = header.numHoles;
+  validation->numFlippedEdges = header.numFlippedEdges;
+  validation->numDegenerateFacets = header.numDegenerateFacets;
+  validation->numDuplicateFacets = header.numDuplicateFacets;
+  validation->numFlaggedFacets = header.numFlaggedFacets;
+  edgeAnalysis->numEdges = header.numMeasuredEdges;
+  edgeAnalysis->numDegenerate = header.numDegenerateEdges;
+  edgeAnalysis->shortest = header.shortestMeasuredEdge;
+  edgeAnalysis->shortestNonZero = header.shortestNonZeroEdge;
+  edgeAnalysis->longest = header.longestMeasuredEdge;
+  edgeAnalysis->mean = header.meanEdge;
+  edgeAnalysis->median = header.medianEdge;
+  memcpy(edgeAnalysis->binCounts, header.edgeBinCounts,
+         sizeof(header.edgeBinCounts));
+  const MeshShells::Shell *meshShells =
+      reinterpret_cast<const MeshShells::Shell*>(data + layout.shells);
+  shells->shells.assign(meshShells, meshShells + header.numShells);
+  const uint32_t *facetShells =
+      reinterpret_cast<const uint32_t*>(data + layout.facetShells);
+  shells->facetShells.assign(facetShells, facetShells + numFacets);
+  const uint32_t *shellFacets =
+      reinterpret_cast<const uint32_t*>(data + layout.shellFacets);
+  shells->order.assign(shellFacets, shellFacets + numFacets);
+  const int64_t *firstFacets =
+      reinterpret_cast<const int64_t*>(data + layout.firstFacets);
+  shells->firstFacets.assign(firstFacets,
+                             firstFacets + header.numShells + 1);
+  return true;
+}
+
+bool MeshCache::store(const Key& key, const StlFile::Stats& stats,
+                      const StlFile::Facet *facets, float tolerance,
+                      const IndexedMesh *mesh,
+                      const MeshValidation *validation,
+                      const EdgeAnalysis *edgeAnalysis,
+                      const MeshShells *shells) {
+  EntryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+  header.version = CACHE_VERSION;
+  header.byteOrder = CACHE_BYTE_ORDER;
+  header.facetSize = sizeof(StlFile::Facet);
+  header.type = stats.type;
+  header.fileSize = key.fileSize;
+  header.fileTime = key.fileTime;
+  header.contentHash = key.contentHash;
+  header.numFacets = stats.numFacets;
+  // The number of points is only known once the mesh is welded
+  header.numPoints = mesh != 0 ? mesh->getNumVertices() : stats.numPoints;
+  header.max[0] = stats.max.x;
+  header.max[1] = stats.max.y;
+  header.max[2] = stats.max.z;
+  header.min[0] = stats.min.x;
+  header.min[1] = stats.min.y;
+  header.min[2] = stats.min.z;
+  header.size[0] = stats.size.x;
+  header.size[1] = stats.size.y;
+  header.size[2] = stats.size.z;
+  header.boundingDiameter = stats.boundingDiameter;
+  header.shortestEdge = stats.shortestEdge;
+  header.longestEdge = stats.longestEdge;
+  header.volume = stats.volume;
+  header.surface = stats.surface;
+  header.pathSize = key.path.size();
+  header.headerSize = stats.header.size();
+  int64_t headersSize = sizeof(header) + header.pathSize + header.headerSize;
+  header.facetsOffset = alignOffset(headersSize);
+  if (mesh != 0) {
+    header.hasResults = 1;
+    header.shellSize = sizeof(MeshShells::Shell);
+    header.weldTolerance = tolerance;
+    header.numVertices = mesh->getNumVertices();
+    header.numShells = shells->getNumShells();
+    header.numEdges = validation->numEdges;
+    header.numNonManifoldEdges = validation->numNonManifoldEdges;
+    header.numBoundaryEdges = validation->numBoundaryEdges;
+    header.numHoles = validation->numHoles;
+    header.numFlippedEdges = validation->numFlippedEdges;
+    header.numDegenerateFacets = validation->numDegenerateFacets;
+    header.numDuplicateFacets = validation->numDuplicateFacets;
+    header.numFlaggedFacets = validation->numFlaggedFacets;
+    header.numMeasuredEdges = edgeAnalysis->numEdges;
+    header.numDegenerateEdges = edgeAnalysis->numDegenerate;
+    header.shortestMeasuredEdge = edgeAnalysis->shortest;
+    header.shortestNonZeroEdge = edgeAnalysis->shortestNonZero;
+    header.longestMeasuredEdge = edgeAnalysis->longest;
+    header.meanEdge = edgeAnalysis->mean;
+    header.medianEdge = edgeAnalysis->median;
+    memcpy(header.edgeBinCounts, edgeAnalysis->binCounts,
+           sizeof(header.edgeBinCounts));
+  }
+  EntryLayout layout = getLayout(header);
+  int64_t facetsSize = stats.numFacets * sizeof(StlFile::Facet);
+  // Don't throw the whole cache away for a single file
+  if (layout.end > maxSize)
+    return false;
+  ::std::lock_guard< ::std::mutex> lock(storeMutex);
+  // Write a temporary file, so that an entry is never seen half written
+  ::std::string entryName = getEntryName(key.path);
+  ::std::string tempName;
+  FILE *file = createTempFile(entryName, &tempName);
+  if (file == 0)
+    return false;
+  int64_t position = 0;
+  bool written =
+      writeAt(file, &position, 0, &header, sizeof(header)) &&
+      writeAt(file, &position, position, key.path.data(), header.pathSize) &&
+      writeAt(file, &position, position, stats.header.data(),
+              header.headerSize) &&
+      writeAt(file, &position, header.facetsOffset, facets, facetsSize);
+  if (written && mesh != 0) {
+    int64_t numFacets = stats.numFacets;
+    written =
+        writeAt(file, &position, layout.vertices, mesh->getVertices(),
+                header.numVertices * sizeof(StlFile::Vertex)) &&
+        writeAt(file, &position, layout.indices, mesh->getIndices(),
+                numFacets * 3 * sizeof(uint32_t)) &&
+        writeAt(file, &position, layout.facetFlags,
+                validation->getFacetFlags(), numFacets) &&
+        writeAt(file, &position, layout.shells, shells->shells.data(),
+                header.numShells * sizeof(MeshShells::Shell)) &&
+        writeAt(file, &position, layout.facetShells,
+                shells->getFacetShells(), numFacets * sizeof(uint32_t)) &&
+        writeAt(file, &position, layout.shellFacets, shells->getFacets(),
+                numFacets * sizeof(uint32_t)) &&
+        writeAt(file, &position, layout.firstFacets,
+                shells->firstFacets.data(),
+                (header.numShells + 1) * sizeof(int64_t));
+  }
+  written = fclose(file) == 0 && written;
+  if (written && rename(tempName.c_str(), entryName.c_str()) != 0) {
+    // The entry may not be replaced in one step on all systems
+    remove(entryName.c_str());
+    written = rename(tempName.c_str(), entryName.c_str()) == 0;
+  }
+  if (!written) {
+    remove(tempName.c_str());
+    return false;
+  }
+  evict(entryName);
+  return true;
+}
+
+void MeshCache::clear() {
+  ::std::lock_guard< ::std::mutex> lock(storeMutex);
+  ::std::vector<CacheEntry> entries;
+  listEntries(directory, entries);
+  for (size_t i = 0; i < entries.size(); i++)
+    remove(entries[i].name.c_str());
+}
+
+MeshCache::EntryLayout MeshCache::getLayout(const EntryHeader& header) {
+  EntryLayout layout;
+  int64_t numFacets = header.numFacets;
+  int64_t end = header.facetsOffset + numFacets * header.facetSize;
+  if (header.hasResults) {
+    layout.vertices = alignOffset(end);
+    layout.indices = alignOffset(
+        layout.vertices + header.numVertices * sizeof(StlFile::Vertex));
+    layout.facetFlags = alignOffset(
+        layout.indices + numFacets * 3 * sizeof(uint32_t));
+    layout.shells = alignOffset(layout.facetFlags + numFacets);
+    layout.facetShells = alignOffset(
+        layout.shells + header.numShells * header.shellSize);
+    layout.shellFacets = alignOffset(
+        layout.facetShells + numFacets * sizeof(uint32_t));
+    layout.firstFacets = alignOffset(
+        layout.shellFacets + numFacets * sizeof(uint32_t));
+    end = layout.firstFacets + (header.numShells + 1) * sizeof(int64_t);
+  } else {
+    layout.vertices = layout.indices = layout.facetFlags = end;
+    layout.shells = layout.facetShells = layout.shellFacets = end;
+    layout.firstFacets = end;
+  }
+  layout.end = end;
+  return layout;
+}
+
+::std::string MeshCache::getEntryName(const ::std::string& path) const {
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx",
+           static_cast<unsigned long long>(hashBytes(path.data(),
+                                                     path.size())));
+  return directory + "/" + name + CACHE_EXTENSION;
+}
+
+void MeshCache::evict(const ::std::string& keptEntryName) {
+  ::std::vector<CacheEntry> entries;
+  listEntries(directory, entries);
+  int64_t size = 0;
+  for (size_t i = 0; i < entries.size(); i++)
+    size += entries[i].size;
+  // Remove the least recently used entries first. An entry that is still
+  // mapped stays valid on POSIX systems, and can't be removed on Windows.
+  // The times only have a precision of a second, so the entry that was
+  // just stored is kept explicitly.
+  ::std::sort(entries.begin(), entries.end(), compareEntryTimes);
+  for (size_t i = 0; i < entries.size() && size > maxSize; i++) {
+    if (entries[i].name != keptEntryName &&
+        remove(entries[i].name.c_str()) == 0)
+      size -= entries[i].size;
+  }
+}
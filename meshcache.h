@@ -0,0 +1,155 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+
+#include "edgeanalysis.h"
+#include "mappedfile.h"
+#include "stlfile.h"
+
+class IndexedMesh;
+class MeshShells;
+class MeshValidation;
+
+// MeshCache Class - An on-disk cache of loaded STL files
+// An entry holds the facets and the stats of a file, laid out so that the
+// facets can be mapped into memory and used in place. It may also hold the
+// welded mesh of the file and what was found from it, so that they aren't
+// computed again when the file is opened with the same weld tolerance. An
+// entry is only used if the path, size, modification time and a hash of
+// the content of the file still match. The least recently used entries
+// are removed once the cache grows over its maximum size. The cache can be
+// used by several threads at a time.
+class MeshCache {
+ public:
+  // Identifies the content of a file at the time it is read
+  typedef struct {
+    ::std::string path;
+    int64_t       fileSize;
+    int64_t       fileTime;
+    uint64_t      contentHash;
+  } Key;
+  MeshCache(const ::std::string& directory, int64_t maxSize);
+  ::std::string getDirectory() const { return directory; };
+  int64_t getMaxSize() const { return maxSize; };
+  // Gets the key of a file, returns false if the file can't be read. The
+  // hash only covers a few blocks spread over the file, so that it takes
+  // the same time whatever the size of the file.
+  static bool getKey(const ::std::string& fileName, Key *key);
+  // Maps the entry of a file into entry. Returns the facets it holds and
+  // fills stats, or returns 0 if there is no valid entry for the file.
+  const StlFile::Facet* lookup(const Key& key, MappedFile *entry,
+                               StlFile::Stats *stats);
+  // Copies the welded mesh, the defects, the edge lengths and the shells
+  // held by an entry that lookup() mapped into the objects given. Returns
+  // false, leaving them untouched, if the entry doesn't hold them or holds
+  // those of another weld tolerance.
+  static bool restore(const MappedFile& entry, float tolerance,
+                      IndexedMesh *mesh, MeshValidation *validation,
+                      EdgeAnalysis *edgeAnalysis, MeshShells *shells);
+  // Stores the facets and the stats of a file, with its welded mesh and
+  // what was found from it unless mesh is 0, then removes the least
+  // recently used entries if the cache is too big. Returns false if the
+  // entry couldn't be written.
+  bool store(const Key& key, const StlFile::Stats& stats,
+             const StlFile::Facet *facets, float tolerance = 0.0,
+             const IndexedMesh *mesh = 0,
+             const MeshValidation *validation = 0,
+             const EdgeAnalysis *edgeAnalysis = 0,
+             const MeshShells *shells = 0);
+  // Removes all the entries
+  void clear();
+
+ private:
+  typedef struct {
+    char      magic[8];
+    uint32_t  version;
+    uint32_t  byteOrder;
+    uint32_t  facetSize;
+    uint32_t  type;
+    int64_t   fileSize;
+    int64_t   fileTime;
+    uint64_t  contentHash;
+    int64_t   numFacets;
+    int64_t   numPoints;
+    float     max[3];
+    float     min[3];
+    float     size[3];
+    float     boundingDiameter;
+    float     shortestEdge;
+    float     longestEdge;
+    double    volume;
+    double    surface;
+    uint32_t  pathSize;
+    uint32_t  headerSize;
+    int64_t   facetsOffset;
+    // The results below are only valid if hasResults isn't 0
+    uint32_t  hasResults;
+    uint32_t  shellSize;
+    float     weldTolerance;
+    float     shortestNonZeroEdge;
+    int64_t   numVertices;
+    int64_t   numShells;
+    int64_t   numEdges;
+    int64_t   numNonManifoldEdges;
+    int64_t   numBoundaryEdges;
+    int64_t   numHoles;
+    int64_t   numFlippedEdges;
+    int64_t   numDegenerateFacets;
+    int64_t   numDuplicateFacets;
+    int64_t   numFlaggedFacets;
+    int64_t   numMeasuredEdges;
+    int64_t   numDegenerateEdges;
+    double    meanEdge;
+    float     medianEdge;
+    float     shortestMeasuredEdge;
+    float     longestMeasuredEdge;
+    float     padding;
+    int64_t   edgeBinCounts[EdgeAnalysis::NUM_BINS];
+  } EntryHeader;
+  // Offsets of the arrays of an entry, each starting on a multiple of
+  // CACHE_ALIGNMENT bytes after the facets
+  typedef struct {
+    int64_t vertices;
+    int64_t indices;
+    int64_t facetFlags;
+    int64_t shells;
+    int64_t facetShells;
+    int64_t shellFacets;
+    int64_t firstFacets;
+    int64_t end;
+  } EntryLayout;
+  MeshCache(const MeshCache&);
+  MeshCache& operator=(const MeshCache&);
+  static EntryLayout getLayout(const EntryHeader& header);
+  ::std::string getEntryName(const ::std::string& path) const;
+  void evict(const ::std::string& keptEntryName);
+  ::std::string directory;
+  int64_t maxSize;
+  ::std::mutex storeMutex;
+};
+
+#endif  // MESHCACHE_H
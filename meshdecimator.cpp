@@ -0,0 +1,684 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+
+#include "indexedmesh.h"
+#include "meshdecimator.h"
+#include "parallel.h"
+#include "partitionsort.h"
+#include "statskernel.h"
+
+#define DECIMATOR_BLOCK_SIZE 65536
+// Share of the edges picked in a pass which claim their vertices, the
+// cheapest ones, so that the collapses stay close to the order of their
+// errors
+#define DECIMATOR_PASS_FRACTION 0.25
+// A collapse mustn't turn a facet by more than about 80 degrees, beyond
+// which it is taken as folded over
+#define DECIMATOR_MIN_NORMAL_COS 0.2
+// Below this, relative to the cube of its trace, the matrix of a quadric
+// is taken as singular, and the vertices go to the best of the ends and
+// the middle of their edge
+#define DECIMATOR_MIN_DETERMINANT 1e-10
+// The edges which lost their claims try again at most this many times
+#define DECIMATOR_CLAIM_ROUNDS 4
+
+class MeshDecimator::Scratch {
+ public:
+  typedef struct {
+    double error;
+    uint32_t other;
+    double position[3];
+  } Candidate;
+  ::std::vector<uint32_t> neighbours;
+  ::std::vector<uint32_t> others;
+  ::std::vector<Candidate> candidates;
+};
+
+namespace {
+
+int getNumBlocks(int64_t numItems) {
+  return static_cast<int>((numItems + DECIMATOR_BLOCK_SIZE - 1) /
+                          DECIMATOR_BLOCK_SIZE);
+}
+
+void addPlane(double q[10], const double normal[3], double d,
+              double weight) {
+  double plane[4] = {normal[0], normal[1], normal[2], d};
+  int k = 0;
+  for (int i = 0; i < 4; i++) {
+    for (int j = i; j < 4; j++)
+      q[k++] += weight * plane[i] * plane[j];
+  }
+}
+
+double getError(const double q[10], const double p[3]) {
+  return q[0] * p[0] * p[0] + 2.0 * q[1] * p[0] * p[1] +
+         2.0 * q[2] * p[0] * p[2] + 2.0 * q[3] * p[0] +
+         q[4] * p[1] * p[1] + 2.0 * q[5] * p[1] * p[2] + 2.0 * q[6] * p[1] +
+         q[7] * p[2] * p[2] + 2.0 * q[8] * p[2] + q[9];
+}
+
+// Where collapsing the edge from a to b moves its vertices, and the error
+// there. a must be the lower vertex, so that both ends get the same result.
+double getTarget(const double q[10], const StlFile::Vertex& a,
+                 const StlFile::Vertex& b, double p[3]) {
+  double c00 = q[4] * q[7] - q[5] * q[5];
+  double c01 = q[2] * q[5] - q[1] * q[7];
+  double c02 = q[1] * q[5] - q[2] * q[4];
+  double det = q[0] * c00 + q[1] * c01 + q[2] * c02;
+  double trace = q[0] + q[4] + q[7];
+  if (fabs(det) > DECIMATOR_MIN_DETERMINANT * trace * trace * trace) {
+    double c11 = q[0] * q[7] - q[2] * q[2];
+    double c12 = q[1] * q[2] - q[0] * q[5];
+    double c22 = q[0] * q[4] - q[1] * q[1];
+    p[0] = -(c00 * q[3] + c01 * q[6] + c02 * q[8]) / det;
+    p[1] = -(c01 * q[3] + c11 * q[6] + c12 * q[8]) / det;
+    p[2] = -(c02 * q[3] + c12 * q[6] + c22 * q[8]) / det;
+    return ::std::max(0.0, getError(q, p));
+  }
+  double ends[3][3] = {
+    {a.x, a.y, a.z},
+    {b.x, b.y, b.z},
+    {(static_cast<double>(a.x) + b.x) / 2.0,
+     (static_cast<double>(a.y) + b.y) / 2.0,
+     (static_cast<double>(a.z) + b.z) / 2.0}
+  };
+  double best = DBL_MAX;
+  for (int i = 0; i < 3; i++) {
+    double error = getError(q, ends[i]);
+    if (error < best) {
+      best = error;
+      memcpy(p, ends[i], sizeof(ends[i]));
+    }
+  }
+  return ::std::max(0.0, best);
+}
+
+void getNormal(const double a[3], const double b[3], const double c[3],
+               double normal[3]) {
+  double u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+  double v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+  normal[0] = u[1] * v[2] - u[2] * v[1];
+  normal[1] = u[2] * v[0] - u[0] * v[2];
+  normal[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+void atomicMin(::std::atomic<uint64_t>& target, uint64_t value) {
+  uint64_t current = target.load(::std::memory_order_relaxed);
+  while (value < current &&
+         !target.compare_exchange_weak(current, value,
+                                       ::std::memory_order_relaxed)) {}
+}
+
+// A positive float orders like its bits, the vertex comes last to make the
+// key unique
+uint64_t getKey(float error, uint32_t vertex) {
+  uint32_t bits;
+  memcpy(&bits, &error, sizeof(bits));
+  return (static_cast<uint64_t>(bits) << 32) | vertex;
+}
+
+}  // namespace
+
+MeshDecimator::MeshDecimator() {
+  numFacets = 0;
+  maxError = 0.0;
+}
+
+void MeshDecimator::setMesh(const IndexedMesh *mesh) {
+  *this = MeshDecimator();
+  int64_t numVertices = mesh->getNumVertices();
+  int64_t numTriangles = mesh->getNumTriangles();
+  positions.assign(mesh->getVertices(), mesh->getVertices() + numVertices);
+  indices.assign(mesh->getIndices(), mesh->getIndices() + 3 * numTriangles);
+  alive.resize(numTriangles);
+  int numBlocks = getNumBlocks(numTriangles);
+  ::std::vector<int64_t> counts(numBlocks, 0);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * DECIMATOR_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + DECIMATOR_BLOCK_SIZE,
+                                      numTriangles);
+    for (int64_t i = begin; i < end; i++) {
+      const uint32_t *v = &indices[3 * i];
+      alive[i] = v[0] != v[1] && v[1] != v[2] && v[2] != v[0];
+      counts[block] += alive[i];
+    }
+  });
+  for (int block = 0; block < numBlocks; block++)
+    numFacets += counts[block];
+  // The ends of the edges which don't have exactly two facets are locked
+  locked.assign(numVertices, 0);
+  ::std::vector<EdgeRecord> records;
+  ::std::vector<int64_t> starts;
+  sortEdges(indices.data(), numTriangles, &records, &starts);
+  for (size_t i = 0; i < records.size();) {
+    size_t j = i;
+    int numEdgeFacets = 0;
+    for (; j < records.size() && records[j].key == records[i].key; j++)
+      numEdgeFacets += alive[records[j].corner / 3];
+    if (numEdgeFacets != 0 && numEdgeFacets != 2) {
+      locked[records[i].key >> 32] = 1;
+      locked[records[i].key & 0xffffffff] = 1;
+    }
+    i = j;
+  }
+  ::std::vector<EdgeRecord>().swap(records);
+  buildAdjacency();
+  // The planes of the facets around each vertex, weighted by their areas
+  quadrics.resize(numVertices);
+  Parallel::run(getNumBlocks(numVertices), [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * DECIMATOR_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + DECIMATOR_BLOCK_SIZE,
+                                      numVertices);
+    for (int64_t v = begin; v < end; v++) {
+      double *q = quadrics[v].q;
+      memset(q, 0, sizeof(quadrics[v].q));
+      for (int64_t i = vertexStarts[v]; i < vertexStarts[v + 1]; i++) {
+        const uint32_t *f = &indices[3 * static_cast<int64_t>(
+            vertexFacets[i])];
+        double corners[3][3];
+        for (int j = 0; j < 3; j++) {
+          corners[j][0] = positions[f[j]].x;
+          corners[j][1] = positions[f[j]].y;
+          corners[j][2] = positions[f[j]].z;
+        }
+        double normal[3];
+        getNormal(corners[0], corners[1], corners[2], normal);
+        double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                             normal[2] * normal[2]);
+        if (length == 0.0)
+          continue;
+        for (int j = 0; j < 3; j++)
+          normal[j] /= length;
+        double d = -(normal[0] * corners[0][0] + normal[1] * corners[0][1] +
+                     normal[2] * corners[0][2]);
+        addPlane(q, normal, d, length / 2.0);
+      }
+    }
+  });
+}
+
+void MeshDecimator::buildAdjacency() {
+  int64_t numVertices = positions.size();
+  int64_t numTriangles = alive.size();
+  int numBlocks = getNumBlocks(numTriangles);
+  ::std::vector< ::std::atomic<uint32_t> > counts(numVertices);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * DECIMATOR_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + DECIMATOR_BLOCK_SIZE,
+                                      numTriangles);
+    for (int64_t i = begin; i < end; i++) {
+      if (alive[i]) {
+        for (int j = 0; j < 3; j++)
+          counts[indices[3 * i + j]].fetch_add(1, ::std::memory_order_relaxed);
+      }
+    }
+  });
+  vertexStarts.resize(numVertices + 1);
+  int64_t offset = 0;
+  for (int64_t v = 0; v < numVertices; v++) {
+    vertexStarts[v] = offset;
+    offset += counts[v].load(::std::memory_order_relaxed);
+    counts[v].store(0, ::std::memory_order_relaxed);
+  }
+  vertexStarts[numVertices] = offset;
+  vertexFacets.resize(offset);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * DECIMATOR_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + DECIMATOR_BLOCK_SIZE,
+                                      numTriangles);
+    for (int64_t i = begin; i < end; i++) {
+      if (alive[i]) {
+        for (int j = 0; j < 3; j++) {
+          uint32_t v = indices[3 * i + j];
+          vertexFacets[vertexStarts[v] + counts[v].fetch_add(
+              1, ::std::memory_order_relaxed)] = static_cast<uint32_t>(i);
+        }
+      }
+    }
+  });
+  // The facets were added in any order
+  Parallel::run(getNumBlocks(numVertices), [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * DECIMATOR_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + DECIMATOR_BLOCK_SIZE,
+                                      numVertices);
+    for (int64_t v = begin; v < end; v++) {
+      ::std::sort(vertexFacets.begin() + vertexStarts[v],
+                  vertexFacets.begin() + vertexStarts[v + 1]);
+    }
+  });
+}
+
+void MeshDecimator::getNeighbours(uint32_t vertex,
+                                  ::std::vector<uint32_t> *neighbours) const {
+  neighbours->clear();
+  for (int64_t i = vertexStarts[vertex]; i < vertexStarts[vertex + 1]; i++) {
+    const uint32_t *f = &indices[3 * static_cast<int64_t>(vertexFacets[i])];
+    for (int j = 0; j < 3; j++) {
+      if (f[j] != vertex)
+        neighbours->push_back(f[j]);
+    }
+  }
+  ::std::sort(neighbours->begin(), neighbours->end());
+  neighbours->erase(::std::unique(neighbours->begin(), neighbours->end()),
+                    neighbours->end());
+}
+
+bool MeshDecimator::isValid(uint32_t a, uint32_t b, const double position[3],
+                            Scratch *scratch) const {
+  // The edge must have a facet on each side, whose third vertices are the
+  // only ones next to both of its ends and keep at least three facets
+  uint32_t opposites[2];
+  int numShared = 0;
+  for (int64_t i = vertexStarts[a]; i < vertexStarts[a + 1]; i++) {
+    const uint32_t *f = &indices[3 * static_cast<int64_t>(vertexFacets[i])];
+    if (f[0] != b && f[1] != b && f[2] != b)
+      continue;
+    if (numShared == 2)
+      return false;
+    for (int j = 0; j < 3; j++) {
+      if (f[j] != a && f[j] != b)
+        opposites[numShared] = f[j];
+    }
+    numShared++;
+  }
+  if (numShared != 2 || opposites[0] == opposites[1])
+    return false;
+  for (int i = 0; i < 2; i++) {
+    if (vertexStarts[opposites[i] + 1] - vertexStarts[opposites[i]] <= 3)
+      return false;
+  }
+  getNeighbours(b, &scratch->others);
+  int numCommon = 0;
+  for (size_t i = 0, j = 0; i < scratch->neighbours.size() &&
+       j < scratch->others.size();) {
+    if (scratch->neighbours[i] < scratch->others[j]) {
+      i++;
+    } else if (scratch->others[j] < scratch->neighbours[i]) {
+      j++;
+    } else {
+      numCommon++;
+      i++;
+      j++;
+    }
+  }
+  if (numCommon != 2)
+    return false;
+  // No facet left may be turned over
+  for (int side = 0; side < 2; side++) {
+    uint32_t vertex = side == 0 ? a : b;
+    for (int64_t i = vertexStarts[vertex]; i < vertexStarts[vertex + 1];
+         i++) {
+      const uint32_t *f = &indices[3 * static_cast<int64_t>(
+          vertexFacets[i])];
+      bool hasA = f[0] == a || f[1] == a || f[2] == a;
+      bool hasB = f[0] == b || f[1] == b || f[2] == b;
+      if (hasA && hasB)
+        continue;
+      double before[3][3], after[3][3];
+      for (int j = 0; j < 3; j++) {
+        before[j][0] = positions[f[j]].x;
+        before[j][1] = positions[f[j]].y;
+        before[j][2] = positions[f[j]].z;
+        memcpy(after[j], f[j] == vertex ? position : before[j],
+               sizeof(after[j]));
+      }
+      double normalBefore[3], normalAfter[3];
+      getNormal(before[0], before[1], before[2], normalBefore);
+      getNormal(after[0], after[1], after[2], normalAfter);
+      double lengthBefore = sqrt(normalBefore[0] * normalBefore[0] +
+                                 normalBefore[1] * normalBefore[1] +
+                                 normalBefore[2] * normalBefore[2]);
+      double lengthAfter = sqrt(normalAfter[0] * normalAfter[0] +
+                                normalAfter[1] * normalAfter[1] +
+                                normalAfter[2] * normalAfter[2]);
+      // A facet which was already flat can't be turned over
+      if (lengthBefore == 0.0)
+        continue;
+      double dot = normalBefore[0] * normalAfter[0] +
+                   normalBefore[1] * normalAfter[1] +
+                   normalBefore[2] * normalAfter[2];
+      if (dot <= DECIMATOR_MIN_NORMAL_COS * lengthBefore * lengthAfter)
+        return false;
+    }
+  }
+  return true;
+}
+
+void MeshDecimator::findCollapse(uint32_t vertex, Scratch *scratch,
+                                 Collapse *best) const {
+  best->error = FLT_MAX;
+  best->other = NO_VERTEX;
+  if (locked[vertex] || vertexStarts[vertex] == vertexStarts[vertex + 1])
+    return;
+  getNeighbours(vertex, &scratch->neighbours);
+  scratch->candidates.clear();
+  for (size_t i = 0; i < scratch->neighbours.size(); i++) {
+    uint32_t other = scratch->neighbours[i];
+    if (locked[other])
+      continue;
+    uint32_t a = ::std::min(vertex, other);
+    uint32_t b = ::std::max(vertex, other);
+    Scratch::Candidate candidate;
+    double q[10];
+    for (int j = 0; j < 10; j++)
+      q[j] = quadrics[a].q[j] + quadrics[b].q[j];
+    candidate.error = getTarget(q, positions[a], positions[b],
+                                candidate.position);
+    candidate.other = other;
+    scratch->candidates.push_back(candidate);
+  }
+  ::std::sort(scratch->candidates.begin(), scratch->candidates.end(),
+              [](const Scratch::Candidate& x, const Scratch::Candidate& y) {
+    return x.error < y.error || (x.error == y.error && x.other < y.other);
+  });
+  for (size_t i = 0; i < scratch->candidates.size(); i++) {
+    const Scratch::Candidate &candidate = scratch->candidates[i];
+    if (isValid(vertex, candidate.other, candidate.position, scratch)) {
+      best->error = static_cast<float>(candidate.error);
+      best->other = candidate.other;
+      best->position.x = static_cast<float>(candidate.position[0]);
+      best->position.y = static_cast<float>(candidate.position[1]);
+      best->position.z = static_cast<float>(candidate.position[2]);
+      return;
+    }
+  }
+}
+
+void MeshDecimator::compact() {
+  int64_t numVertices = positions.size();
+  int64_t numTriangles = alive.size();
+  // The vertices left are those with facets, their order is kept
+  ::std::vector<uint32_t> newVertices(numVertices, NO_VERTEX);
+  uint32_t numNewVertices = 0;
+  for (int64_t v = 0; v < numVertices; v++) {
+    if (vertexStarts[v] == vertexStarts[v + 1])
+      continue;
+    newVertices[v] = numNewVertices;
+    positions[numNewVertices] = positions[v];
+    quadrics[numNewVertices] = quadrics[v];
+    locked[numNewVertices] = locked[v];
+    numNewVertices++;
+  }
+  positions.resize(numNewVertices);
+  quadrics.resize(numNewVertices);
+  locked.resize(numNewVertices);
+  int64_t numNewFacets = 0;
+  for (int64_t i = 0; i < numTriangles; i++) {
+    if (!alive[i])
+      continue;
+    for (int j = 0; j < 3; j++)
+      indices[3 * numNewFacets + j] = newVertices[indices[3 * i + j]];
+    numNewFacets++;
+  }
+  indices.resize(3 * numNewFacets);
+  alive.assign(numNewFacets, 1);
+  buildAdjacency();
+}
+
+void MeshDecimator::decimate(int64_t numFacets) {
+  int64_t numVertices = 0;
+  int numBlocks = 0;
+  ::std::vector<Collapse> collapses;
+  ::std::vector< ::std::atomic<uint64_t> > claims;
+  // Only the vertices next to the facets changed by the last pass pick
+  // their edge again, the others would pick the same one
+  ::std::vector<uint8_t> changed;
+  ::std::vector<uint8_t> touched;
+  while (this->numFacets > numFacets) {
+    // The facets removed are dropped once they are the most, so that the
+    // passes take less and less time
+    bool compacted = this->numFacets < static_cast<int64_t>(alive.size()) / 2;
+    if (compacted)
+      compact();
+    if (compacted || numVertices != static_cast<int64_t>(positions.size())) {
+      numVertices = positions.size();
+      numBlocks = getNumBlocks(numVertices);
+      collapses.resize(numVertices);
+      ::std::vector< ::std::atomic<uint64_t> >(numVertices).swap(claims);
+      changed.assign(numVertices, 1);
+      touched.assign(numVertices, 0);
+    }
+    Parallel::run(numBlocks, [&](int block) {
+      int64_t begin = static_cast<int64_t>(block) * DECIMATOR_BLOCK_SIZE;
+      int64_t end = ::std::min<int64_t>(begin + DECIMATOR_BLOCK_SIZE,
+                                        numVertices);
+      Scratch scratch;
+      for (int64_t v = begin; v < end; v++) {
+        if (changed[v])
+          findCollapse(static_cast<uint32_t>(v), &scratch, &collapses[v]);
+        touched[v] = 0;
+      }
+    });
+    // The edges picked by the vertices, keyed by their error and by the
+    // vertex, both ends picking the same edge with the same error
+    ::std::vector< ::std::vector<uint64_t> > blockKeys(numBlocks);
+    Parallel::run(numBlocks, [&](int block) {
+      int64_t begin = static_cast<int64_t>(block) * DECIMATOR_BLOCK_SIZE;
+      int64_t end = ::std::min<int64_t>(begin + DECIMATOR_BLOCK_SIZE,
+                                        numVertices);
+      for (int64_t v = begin; v < end; v++) {
+        if (collapses[v].other != NO_VERTEX)
+          blockKeys[block].push_back(getKey(collapses[v].error, v));
+      }
+    });
+    ::std::vector<uint64_t> keys;
+    for (int block = 0; block < numBlocks; block++)
+      keys.insert(keys.end(), blockKeys[block].begin(),
+                  blockKeys[block].end());
+    if (keys.empty())
+      break;
+    size_t maxKeys = ::std::max<size_t>(
+        1, static_cast<size_t>(keys.size() * DECIMATOR_PASS_FRACTION));
+    if (maxKeys < keys.size()) {
+      ::std::nth_element(keys.begin(), keys.begin() + maxKeys, keys.end());
+      keys.resize(maxKeys);
+    }
+    // Within the pass the edges are ordered at random, by a hash of their
+    // vertex. Ordered by their errors, which vary smoothly over the mesh,
+    // only the lowest of a slope would get all of its vertices.
+    ::std::vector<uint64_t> priorities(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      uint32_t vertex = static_cast<uint32_t>(keys[i] & 0xffffffff);
+      priorities[i] = (mixBits(vertex) & 0xffffffff00000000ULL) | vertex;
+    }
+    int numKeyBlocks = getNumBlocks(keys.size());
+    auto forKeys = [&](auto visit) {
+      Parallel::run(numKeyBlocks, [&](int block) {
+        size_t begin = static_cast<size_t>(block) * DECIMATOR_BLOCK_SIZE;
+        size_t end = ::std::min<size_t>(begin + DECIMATOR_BLOCK_SIZE,
+                                        keys.size());
+        for (size_t i = begin; i < end; i++)
+          visit(i);
+      });
+    };
+    // Visits the vertices of the facets around the edge until visit()
+    // returns false
+    auto forRegion = [&](size_t key, auto visit) {
+      uint32_t ends[2] = {static_cast<uint32_t>(keys[key] & 0xffffffff), 0};
+      ends[1] = collapses[ends[0]].other;
+      for (int e = 0; e < 2; e++) {
+        for (int64_t i = vertexStarts[ends[e]]; i < vertexStarts[ends[e] + 1];
+             i++) {
+          const uint32_t *f = &indices[3 * static_cast<int64_t>(
+              vertexFacets[i])];
+          for (int j = 0; j < 3; j++) {
+            if (!visit(f[j]))
+              return false;
+          }
+        }
+      }
+      return true;
+    };
+    // Each edge claims the vertices of the facets around it, the lowest
+    // priority winning, and is collapsed if it gets all of them. The edges
+    // which lost without touching a winner try again among themselves.
+    enum { UNDECIDED, WON, LOST };
+    ::std::vector<uint8_t> states(keys.size(), UNDECIDED);
+    for (int round = 0; round < DECIMATOR_CLAIM_ROUNDS; round++) {
+      forKeys([&](size_t i) {
+        if (states[i] == UNDECIDED) {
+          forRegion(i, [&](uint32_t v) {
+            claims[v].store(UINT64_MAX, ::std::memory_order_relaxed);
+            return true;
+          });
+        }
+      });
+      forKeys([&](size_t i) {
+        if (states[i] == UNDECIDED) {
+          forRegion(i, [&](uint32_t v) {
+            atomicMin(claims[v], priorities[i]);
+            return true;
+          });
+        }
+      });
+      // The vertices of the winners are taken for good
+      forKeys([&](size_t i) {
+        if (states[i] == UNDECIDED && forRegion(i, [&](uint32_t v) {
+              return claims[v].load(::std::memory_order_relaxed) ==
+                     priorities[i];
+            })) {
+          states[i] = WON;
+          forRegion(i, [&](uint32_t v) {
+            touched[v] = 1;
+            return true;
+          });
+        }
+      });
+      forKeys([&](size_t i) {
+        if (states[i] == UNDECIDED &&
+            !forRegion(i, [&](uint32_t v) { return !touched[v]; }))
+          states[i] = LOST;
+      });
+    }
+    ::std::vector<uint8_t> won(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+      won[i] = states[i] == WON;
+    // Two facets go with each collapse, the cheapest ones are kept if there
+    // are more than needed
+    ::std::vector<uint64_t> wonKeys;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (won[i])
+        wonKeys.push_back(keys[i]);
+    }
+    size_t maxCollapses = (this->numFacets - numFacets + 1) / 2;
+    if (maxCollapses < wonKeys.size()) {
+      ::std::nth_element(wonKeys.begin(), wonKeys.begin() + maxCollapses,
+                         wonKeys.end());
+      uint64_t limit = wonKeys[maxCollapses];
+      for (size_t i = 0; i < keys.size(); i++)
+        won[i] = won[i] && keys[i] < limit;
+    }
+    // The edges collapsed don't share any vertex of their facets, the
+    // lower end takes the place of the other one
+    ::std::vector<int64_t> blockCollapses(numKeyBlocks, 0);
+    ::std::vector<double> blockErrors(numKeyBlocks, 0.0);
+    Parallel::run(numKeyBlocks, [&](int block) {
+      size_t begin = static_cast<size_t>(block) * DECIMATOR_BLOCK_SIZE;
+      size_t end = ::std::min<size_t>(begin + DECIMATOR_BLOCK_SIZE,
+                                      keys.size());
+      for (size_t i = begin; i < end; i++) {
+        if (!won[i])
+          continue;
+        const Collapse &collapse = collapses[keys[i] & 0xffffffff];
+        uint32_t a = static_cast<uint32_t>(keys[i] & 0xffffffff);
+        uint32_t b = collapse.other;
+        if (a > b)
+          ::std::swap(a, b);
+        positions[a] = collapse.position;
+        for (int j = 0; j < 10; j++)
+          quadrics[a].q[j] += quadrics[b].q[j];
+        for (int64_t k = vertexStarts[b]; k < vertexStarts[b + 1]; k++) {
+          int64_t facet = vertexFacets[k];
+          uint32_t *f = &indices[3 * facet];
+          if (f[0] == a || f[1] == a || f[2] == a) {
+            alive[facet] = 0;
+          } else {
+            for (int j = 0; j < 3; j++) {
+              if (f[j] == b)
+                f[j] = a;
+            }
+          }
+        }
+        blockCollapses[block]++;
+        blockErrors[block] = ::std::max<double>(blockErrors[block],
+                                                collapse.error);
+      }
+    });
+    for (int block = 0; block < numKeyBlocks; block++) {
+      this->numFacets -= 2 * blockCollapses[block];
+      maxError = ::std::max(maxError, blockErrors[block]);
+    }
+    buildAdjacency();
+    Parallel::run(numBlocks, [&](int block) {
+      int64_t begin = static_cast<int64_t>(block) * DECIMATOR_BLOCK_SIZE;
+      int64_t end = ::std::min<int64_t>(begin + DECIMATOR_BLOCK_SIZE,
+                                        numVertices);
+      for (int64_t v = begin; v < end; v++) {
+        changed[v] = touched[v];
+        for (int64_t i = vertexStarts[v];
+             i < vertexStarts[v + 1] && !changed[v]; i++) {
+          const uint32_t *f = &indices[3 * static_cast<int64_t>(
+              vertexFacets[i])];
+          changed[v] = touched[f[0]] | touched[f[1]] | touched[f[2]];
+        }
+      }
+    });
+  }
+}
+
+::std::vector<StlFile::Facet> MeshDecimator::getFacets() const {
+  int64_t numTriangles = alive.size();
+  int numBlocks = getNumBlocks(numTriangles);
+  ::std::vector<int64_t> offsets(numBlocks + 1, 0);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * DECIMATOR_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + DECIMATOR_BLOCK_SIZE,
+                                      numTriangles);
+    offsets[block + 1] = ::std::count(alive.begin() + begin,
+                                      alive.begin() + end, 1);
+  });
+  for (int block = 0; block < numBlocks; block++)
+    offsets[block + 1] += offsets[block];
+  ::std::vector<StlFile::Facet> facets(offsets[numBlocks]);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * DECIMATOR_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + DECIMATOR_BLOCK_SIZE,
+                                      numTriangles);
+    StlFile::Facet *facet = facets.data() + offsets[block];
+    for (int64_t i = begin; i < end; i++) {
+      if (!alive[i])
+        continue;
+      for (int j = 0; j < 3; j++)
+        facet->vector[j] = positions[indices[3 * i + j]];
+      facet++;
+    }
+    StatsKernel::computeNormals(facets.data() + offsets[block],
+                                offsets[block + 1] - offsets[block]);
+  });
+  return facets;
+}
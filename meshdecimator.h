@@ -0,0 +1,95 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef MESHDECIMATOR_H
+#define MESHDECIMATOR_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "stlfile.h"
+
+class IndexedMesh;
+
+// MeshDecimator Class - Reduces a welded mesh by quadric edge collapses
+// Each vertex holds the sum of the squared distances to the planes of its
+// facets, weighted by their areas, and collapsing an edge moves its two
+// vertices to the point where the sum of theirs is the lowest. The edges
+// are collapsed in passes: every vertex picks the cheapest edge it can
+// collapse without folding a facet over or changing the topology, and the
+// cheapest quarter of these edges claim the vertices around them, in an
+// order drawn from their vertices, over a few rounds. The edges which get
+// all of their vertices are collapsed together on all cores, the others
+// wait for the next pass, so that the result doesn't depend on the number
+// of threads. The vertices of the boundaries and of the non-manifold edges
+// are locked, so that the holes and the seams keep their shape.
+class MeshDecimator {
+ public:
+  MeshDecimator();
+  // Starts again from the mesh. Its facets whose corners were welded
+  // together are dropped.
+  void setMesh(const IndexedMesh *mesh);
+  // Collapses edges until at most numFacets facets are left, or no edge can
+  // be collapsed anymore. Called again with fewer facets, it goes on from
+  // where it stopped, which makes coarser levels of detail at little cost.
+  void decimate(int64_t numFacets);
+  int64_t getNumFacets() const { return numFacets; };
+  // The largest error of the collapses so far, a weighted sum of squared
+  // distances
+  double getMaxError() const { return maxError; };
+  // The facets left, in the order of the mesh, with their normals
+  ::std::vector<StlFile::Facet> getFacets() const;
+
+ private:
+  typedef struct {
+    // The upper half of a symmetric 4 by 4 matrix, row by row
+    double q[10];
+  } Quadric;
+  typedef struct {
+    float error;
+    uint32_t other;  // NO_VERTEX if the vertex can't collapse
+    StlFile::Vertex position;
+  } Collapse;
+  class Scratch;
+  static const uint32_t NO_VERTEX = 0xffffffff;
+  void buildAdjacency();
+  // Drops the facets removed and the vertices left without facets
+  void compact();
+  void findCollapse(uint32_t vertex, Scratch *scratch, Collapse *best) const;
+  bool isValid(uint32_t a, uint32_t b, const double position[3],
+               Scratch *scratch) const;
+  void getNeighbours(uint32_t vertex, ::std::vector<uint32_t> *neighbours)
+      const;
+  ::std::vector<StlFile::Vertex> positions;
+  ::std::vector<Quadric> quadrics;
+  ::std::vector<uint8_t> locked;
+  // Three vertices per facet, removed facets being marked as not alive
+  ::std::vector<uint32_t> indices;
+  ::std::vector<uint8_t> alive;
+  // The facets around vertex v are vertexFacets[vertexStarts[v]] to
+  // vertexFacets[vertexStarts[v + 1] - 1], in their order
+  ::std::vector<int64_t> vertexStarts;
+  ::std::vector<uint32_t> vertexFacets;
+  int64_t numFacets;
+  double maxError;
+};
+
+#endif  // MESHDECIMATOR_H
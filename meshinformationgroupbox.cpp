@@ -46,11 +46,16 @@ void MeshInformationGroupBox::reset() {
   numPoints->setText("");
 }
 
-void MeshInformationGroupBox::setValues(const StlFile::Stats stats) {
+void MeshInformationGroupBox::setValues(const StlFile::Stats stats,
+                                        bool computing) {
   QString data;
   // Write values contained in stats
   data.setNum(stats.numFacets);
   numFacets->setText(data);
-  data.setNum(stats.numPoints);
-  numPoints->setText(data);
+  if (stats.numPoints >= 0) {
+    data.setNum(stats.numPoints);
+    numPoints->setText(data);
+  } else {
+    numPoints->setText(computing ? tr("computing...") : tr("unavailable"));
+  }
 }
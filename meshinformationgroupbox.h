@@ -35,7 +35,9 @@ class MeshInformationGroupBox : public QGroupBox {
   MeshInformationGroupBox(QWidget *parent = 0);
   ~MeshInformationGroupBox();
   void reset();
-  void setValues(const StlFile::Stats stats);
+  // An unknown number of points is shown as being computed, or as
+  // unavailable if it isn't
+  void setValues(const StlFile::Stats stats, bool computing = false);
 
  private:
   QLabel *numFacets, *numPoints;
@@ -0,0 +1,429 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+
+#include "indexedmesh.h"
+#include "meshrepair.h"
+#include "parallel.h"
+#include "partitionsort.h"
+#include "statskernel.h"
+
+// Facets handled by one task
+#define REPAIR_BLOCK_SIZE 65536
+// Above this many closed shells, they are all taken as outer surfaces, as
+// looking for the shells around each one would take too long
+#define REPAIR_MAX_NESTED_SHELLS 4096
+#define NO_NEIGHBOUR UINT32_MAX
+#define NOT_REACHED 2
+// Flags of a facet found while linking it to its neighbours
+#define FACET_OPEN 1
+#define FACET_DISAGREES 2
+
+namespace {
+
+// Finds the root of a facet, halving the path on the way as MeshShells
+// does. A link holds the facet it goes to, shifted left by one, and in its
+// lowest bit whether the facet must be flipped to agree with that one, so
+// that a link is changed in one step. A facet is numbered on 31 bits, as
+// its corners are on 32 bits. The parity returned tells if the facet must
+// be flipped to agree with the root.
+uint32_t findRoot(::std::atomic<uint32_t> *links, uint32_t facet,
+                  uint32_t *parity) {
+  *parity = 0;
+  for (;;) {
+    uint32_t link = links[facet].load(::std::memory_order_relaxed);
+    uint32_t up = link >> 1;
+    if (up == facet)
+      return facet;
+    uint32_t upLink = links[up].load(::std::memory_order_relaxed);
+    uint32_t upper = upLink >> 1;
+    uint32_t halved = (upper << 1) | ((link ^ upLink) & 1);
+    if (upper != up) {
+      links[facet].compare_exchange_weak(link, halved,
+                                         ::std::memory_order_relaxed);
+    }
+    *parity ^= halved & 1;
+    facet = upper;
+  }
+}
+
+// Links the shells of facets a and b, one of them having to be flipped to
+// agree with the other if flip is 1. The root of a shell is linked under
+// the lower one, so that it ends up with its first facet as root whatever
+// the number of threads. Returns false if a and b were already in the same
+// shell and disagree.
+bool unite(::std::atomic<uint32_t> *links, uint32_t a, uint32_t b,
+           uint32_t flip) {
+  for (;;) {
+    uint32_t parityA;
+    uint32_t parityB;
+    a = findRoot(links, a, &parityA);
+    b = findRoot(links, b, &parityB);
+    flip ^= parityA ^ parityB;
+    if (a == b)
+      return flip == 0;
+    if (a < b)
+      ::std::swap(a, b);
+    // Fails if a stopped being a root, the roots are then found again
+    uint32_t expected = a << 1;
+    if (links[a].compare_exchange_strong(expected, (b << 1) | flip,
+                                         ::std::memory_order_relaxed))
+      return true;
+  }
+}
+
+// Six times the signed volume of the tetrahedron from origin to a facet
+double volume6(const StlFile::Facet& facet, const StlFile::Vertex& origin) {
+  double v[3][3];
+  for (int j = 0; j < 3; j++) {
+    v[j][0] = static_cast<double>(facet.vector[j].x) - origin.x;
+    v[j][1] = static_cast<double>(facet.vector[j].y) - origin.y;
+    v[j][2] = static_cast<double>(facet.vector[j].z) - origin.z;
+  }
+  return v[0][0] * (v[1][1] * v[2][2] - v[1][2] * v[2][1]) +
+         v[0][1] * (v[1][2] * v[2][0] - v[1][0] * v[2][2]) +
+         v[0][2] * (v[1][0] * v[2][1] - v[1][1] * v[2][0]);
+}
+
+// Whether a ray from point going along +x goes through the facet. The ray
+// often hits a vertex or an edge exactly, as the point is a vertex itself,
+// so it is taken as moved by a tiny e along y and e * e along z: on the
+// side of an edge the ray is exactly on, the facets sharing that edge then
+// agree, and the ray goes through exactly one of them.
+bool crosses(const StlFile::Facet& facet, const StlFile::Vertex& point) {
+  double w[3];
+  int sides[3];
+  for (int j = 0; j < 3; j++) {
+    const StlFile::Vertex &a = facet.vector[(j + 1) % 3];
+    const StlFile::Vertex &b = facet.vector[(j + 2) % 3];
+    w[j] = (static_cast<double>(a.y) - point.y) * (b.z - point.z) -
+           (static_cast<double>(a.z) - point.z) * (b.y - point.y);
+    double side = w[j] != 0.0 ? w[j] :
+                  a.z != b.z ? static_cast<double>(a.z) - b.z :
+                  static_cast<double>(b.y) - a.y;
+    if (side == 0.0)
+      return false;  // The facet is seen edge on
+    sides[j] = side > 0.0 ? 1 : -1;
+  }
+  if (sides[0] != sides[1] || sides[1] != sides[2])
+    return false;
+  double sum = w[0] + w[1] + w[2];
+  if (sum == 0.0)
+    return false;
+  double x = (w[0] * facet.vector[0].x + w[1] * facet.vector[1].x +
+              w[2] * facet.vector[2].x) / sum;
+  return x > point.x;
+}
+
+}  // namespace
+
+MeshRepair::MeshRepair() {
+  numShells = 0;
+  numClosedShells = 0;
+  numFlippedFacets = 0;
+  numInvertedShells = 0;
+  numNonOrientableShells = 0;
+}
+
+void MeshRepair::repair(StlFile::Facet *facets, const IndexedMesh *mesh) {
+  *this = MeshRepair();
+  findShells(mesh);
+  measureShells(facets);
+  nestShells(facets);
+  flipFacets(facets);
+  int64_t numFacets = mesh->getNumTriangles();
+  int numBlocks = static_cast<int>(
+      (numFacets + REPAIR_BLOCK_SIZE - 1) / REPAIR_BLOCK_SIZE);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * REPAIR_BLOCK_SIZE;
+    int64_t count = ::std::min<int64_t>(REPAIR_BLOCK_SIZE, numFacets - begin);
+    StatsKernel::computeNormals(facets + begin, count);
+  });
+  // Only the flips are needed by the caller
+  ::std::vector<uint32_t>().swap(order);
+  ::std::vector<int64_t>().swap(shellStarts);
+  ::std::vector<uint8_t>().swap(flipped);
+}
+
+void MeshRepair::findShells(const IndexedMesh *mesh) {
+  int64_t numFacets = mesh->getNumTriangles();
+  const uint32_t *indices = mesh->getIndices();
+  // Links each corner to the corner of the other facet along its edge, if
+  // exactly one other facet has that edge
+  ::std::vector<uint32_t> neighbours(3 * numFacets, NO_NEIGHBOUR);
+  {
+    ::std::vector<EdgeRecord> records;
+    ::std::vector<int64_t> starts;
+    sortEdges(indices, numFacets, &records, &starts);
+    Parallel::run(PARTITION_SORT_NUM_PARTITIONS, [&](int p) {
+      for (int64_t i = starts[p]; i < starts[p + 1]; ) {
+        int64_t end = i + 1;
+        while (end < starts[p + 1] && records[end].key == records[i].key)
+          end++;
+        if (end - i == 2) {
+          neighbours[records[i].corner] = records[i + 1].corner;
+          neighbours[records[i + 1].corner] = records[i].corner;
+        }
+        i = end;
+      }
+    });
+  }
+
+  // Each facet is linked under a lower facet of its shell, with a bit
+  // telling if one of them must be flipped to agree with the other. All
+  // the cores link the facets at once, then the flips of the facets are
+  // read along their links to the root of their shell, its first facet.
+  ::std::vector< ::std::atomic<uint32_t> > links(numFacets);
+  ::std::vector<uint8_t> facetFlags(numFacets, 0);
+  ::std::vector<uint32_t> roots(numFacets);
+  int numBlocks = static_cast<int>(
+      (numFacets + REPAIR_BLOCK_SIZE - 1) / REPAIR_BLOCK_SIZE);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * REPAIR_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + REPAIR_BLOCK_SIZE, numFacets);
+    for (int64_t i = begin; i < end; i++) {
+      links[i].store(static_cast<uint32_t>(i) << 1,
+                     ::std::memory_order_relaxed);
+    }
+  });
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * REPAIR_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + REPAIR_BLOCK_SIZE, numFacets);
+    for (int64_t facet = begin; facet < end; facet++) {
+      for (int j = 0; j < 3; j++) {
+        uint32_t corner = static_cast<uint32_t>(3 * facet + j);
+        uint32_t next = static_cast<uint32_t>(3 * facet + (j + 1) % 3);
+        if (indices[corner] == indices[next])
+          continue;  // Welded edge, it has no length
+        uint32_t other = neighbours[corner];
+        if (other == NO_NEIGHBOUR) {
+          facetFlags[facet] |= FACET_OPEN;
+          continue;
+        }
+        if (other < corner)
+          continue;  // The edge is taken from the other facet
+        // Two facets agree if they go along the edge in opposite directions
+        uint32_t flip = indices[corner] == indices[other];
+        if (!unite(links.data(), static_cast<uint32_t>(facet), other / 3,
+                   flip))
+          facetFlags[facet] |= FACET_DISAGREES;
+      }
+    }
+  });
+  // Number the roots in increasing order, as MeshShells does
+  ::std::vector<int64_t> counts(numBlocks, 0);
+  flipped.resize(numFacets);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * REPAIR_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + REPAIR_BLOCK_SIZE, numFacets);
+    for (int64_t i = begin; i < end; i++) {
+      uint32_t parity;
+      roots[i] = findRoot(links.data(), static_cast<uint32_t>(i), &parity);
+      flipped[i] = static_cast<uint8_t>(parity);
+      counts[block] += roots[i] == i;
+    }
+  });
+  numShells = 0;
+  for (int block = 0; block < numBlocks; block++) {
+    int64_t count = counts[block];
+    counts[block] = numShells;
+    numShells += count;
+  }
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * REPAIR_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + REPAIR_BLOCK_SIZE, numFacets);
+    uint32_t shell = static_cast<uint32_t>(counts[block]);
+    for (int64_t i = begin; i < end; i++) {
+      if (roots[i] == i)
+        links[i].store(shell++, ::std::memory_order_relaxed);
+    }
+  });
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * REPAIR_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + REPAIR_BLOCK_SIZE, numFacets);
+    for (int64_t i = begin; i < end; i++)
+      roots[i] = links[roots[i]].load(::std::memory_order_relaxed);
+  });
+
+  // Bucket the facets by shell, a single pass over the facets
+  shellStarts.assign(numShells + 1, 0);
+  closed.assign(numShells, 1);
+  ::std::vector<uint8_t> orientable(numShells, 1);
+  for (int64_t i = 0; i < numFacets; i++) {
+    shellStarts[roots[i] + 1]++;
+    if (facetFlags[i] & FACET_OPEN)
+      closed[roots[i]] = 0;
+    if (facetFlags[i] & FACET_DISAGREES)
+      orientable[roots[i]] = 0;
+  }
+  ::std::vector<int64_t> nonOrientableShells;
+  for (int64_t shell = 0; shell < numShells; shell++) {
+    shellStarts[shell + 1] += shellStarts[shell];
+    numClosedShells += closed[shell];
+    if (!orientable[shell])
+      nonOrientableShells.push_back(shell);
+  }
+  numNonOrientableShells = nonOrientableShells.size();
+  order.resize(numFacets);
+  ::std::vector<int64_t> positions(shellStarts.begin(),
+                                   shellStarts.end() - 1);
+  for (int64_t i = 0; i < numFacets; i++)
+    order[positions[roots[i]]++] = static_cast<uint32_t>(i);
+
+  // The flips of a shell that can't be oriented depend on the order the
+  // facets were linked in, so they are found again by walking the shell
+  // from its first facet. Each shell is walked by one task.
+  Parallel::run(static_cast<int>(numNonOrientableShells), [&](int n) {
+    int64_t shell = nonOrientableShells[n];
+    int64_t begin = shellStarts[shell];
+    int64_t end = shellStarts[shell + 1];
+    // The facets not reached yet
+    for (int64_t i = begin; i < end; i++)
+      flipped[order[i]] = NOT_REACHED;
+    ::std::vector<uint32_t> walk;
+    walk.reserve(end - begin);
+    flipped[order[begin]] = 0;
+    walk.push_back(order[begin]);
+    for (size_t i = 0; i < walk.size(); i++) {
+      uint32_t facet = walk[i];
+      for (int j = 0; j < 3; j++) {
+        uint32_t corner = 3 * facet + j;
+        uint32_t next = 3 * facet + (j + 1) % 3;
+        uint32_t other = neighbours[corner];
+        if (indices[corner] == indices[next] || other == NO_NEIGHBOUR)
+          continue;
+        uint32_t neighbour = other / 3;
+        if (flipped[neighbour] == NOT_REACHED) {
+          flipped[neighbour] =
+              flipped[facet] ^ (indices[corner] == indices[other]);
+          walk.push_back(neighbour);
+        }
+      }
+    }
+  });
+}
+
+void MeshRepair::measureShells(const StlFile::Facet *facets) {
+  volumes.assign(numShells, 0.0);
+  bounds.assign(6 * numShells, 0.0);
+  // Each task takes the shells starting in its block of facets
+  int64_t numFacets = order.size();
+  int numBlocks = static_cast<int>(
+      (numFacets + REPAIR_BLOCK_SIZE - 1) / REPAIR_BLOCK_SIZE);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * REPAIR_BLOCK_SIZE;
+    int64_t end = begin + REPAIR_BLOCK_SIZE;
+    int64_t shell = ::std::lower_bound(shellStarts.begin(),
+                                       shellStarts.end() - 1, begin) -
+                    shellStarts.begin();
+    for (; shell < numShells && shellStarts[shell] < end; shell++) {
+      const StlFile::Vertex &origin =
+          facets[order[shellStarts[shell]]].vector[0];
+      float *min = &bounds[6 * shell];
+      float *max = min + 3;
+      for (int k = 0; k < 3; k++) {
+        min[k] = FLT_MAX;
+        max[k] = -FLT_MAX;
+      }
+      double volume = 0.0;
+      for (int64_t i = shellStarts[shell]; i < shellStarts[shell + 1]; i++) {
+        const StlFile::Facet &facet = facets[order[i]];
+        double v = volume6(facet, origin);
+        volume += flipped[order[i]] ? -v : v;
+        for (int j = 0; j < 3; j++) {
+          const float *p = &facet.vector[j].x;
+          for (int k = 0; k < 3; k++) {
+            min[k] = ::std::min(min[k], p[k]);
+            max[k] = ::std::max(max[k], p[k]);
+          }
+        }
+      }
+      volumes[shell] = volume / 6.0;
+    }
+  });
+}
+
+void MeshRepair::nestShells(const StlFile::Facet *facets) {
+  // A closed shell is the wall of a cavity when an odd number of closed
+  // shells are around it, which a ray leaving it crosses an odd number of
+  // times. Only the shells whose bounds hold its bounds can be around it.
+  ::std::vector<int64_t> closedShells;
+  for (int64_t shell = 0; shell < numShells; shell++) {
+    if (closed[shell])
+      closedShells.push_back(shell);
+  }
+  bool nest = static_cast<int64_t>(closedShells.size()) <=
+              REPAIR_MAX_NESTED_SHELLS;
+  inverted.assign(numShells, 0);
+  Parallel::run(static_cast<int>(numShells), [&](int shell) {
+    bool inside = false;
+    if (nest && closed[shell]) {
+      const float *box = &bounds[6 * shell];
+      const StlFile::Vertex &point =
+          facets[order[shellStarts[shell]]].vector[0];
+      for (size_t i = 0; i < closedShells.size(); i++) {
+        int64_t other = closedShells[i];
+        const float *around = &bounds[6 * other];
+        if (other == shell || around[0] > box[0] || around[1] > box[1] ||
+            around[2] > box[2] || around[3] < box[3] || around[4] < box[4] ||
+            around[5] < box[5])
+          continue;
+        int64_t crossings = 0;
+        for (int64_t j = shellStarts[other]; j < shellStarts[other + 1]; j++)
+          crossings += crosses(facets[order[j]], point);
+        inside ^= crossings & 1;
+      }
+    }
+    if (volumes[shell] != 0.0 && (volumes[shell] < 0.0) != inside)
+      inverted[shell] = 1;
+  });
+  for (int64_t shell = 0; shell < numShells; shell++)
+    numInvertedShells += inverted[shell];
+}
+
+void MeshRepair::flipFacets(StlFile::Facet *facets) {
+  int64_t numFacets = order.size();
+  int numBlocks = static_cast<int>(
+      (numFacets + REPAIR_BLOCK_SIZE - 1) / REPAIR_BLOCK_SIZE);
+  ::std::vector<int64_t> counts(numBlocks, 0);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * REPAIR_BLOCK_SIZE;
+    int64_t end = ::std::min(begin + REPAIR_BLOCK_SIZE, numFacets);
+    int64_t shell = ::std::upper_bound(shellStarts.begin(),
+                                       shellStarts.end(), begin) -
+                    shellStarts.begin() - 1;
+    for (int64_t i = begin; i < end; i++) {
+      while (shellStarts[shell + 1] <= i)
+        shell++;
+      uint32_t facet = order[i];
+      if (flipped[facet] != inverted[shell]) {
+        ::std::swap(facets[facet].vector[1], facets[facet].vector[2]);
+        counts[block]++;
+      }
+    }
+  });
+  for (int block = 0; block < numBlocks; block++)
+    numFlippedFacets += counts[block];
+}
@@ -0,0 +1,82 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef MESHREPAIR_H
+#define MESHREPAIR_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "stlfile.h"
+
+class IndexedMesh;
+
+// MeshRepair Class - Orients the facets of a mesh consistently
+// The facets are grouped into shells, the sets of facets reached from each
+// other across edges shared by exactly two facets, by a union-find that
+// all the cores update at once as in MeshShells. Each link tells if a
+// facet goes along its edge in the same direction as the facet it is
+// linked to, so that the facets to flip to agree with the first facet of
+// their shell are known once the shells are found. A closed shell is then
+// turned inside out if its signed volume doesn't match the number of
+// closed shells around it: positive for an outer surface, negative for the
+// wall of a cavity. The normals are computed last, from the vertices, by
+// StatsKernel on all cores.
+class MeshRepair {
+ public:
+  MeshRepair();
+  // Repairs the facets, which must have been welded into mesh
+  void repair(StlFile::Facet *facets, const IndexedMesh *mesh);
+  int64_t getNumShells() const { return numShells; };
+  int64_t getNumClosedShells() const { return numClosedShells; };
+  // Facets whose vertices were swapped, whether to match their neighbours
+  // or because their whole shell was turned inside out
+  int64_t getNumFlippedFacets() const { return numFlippedFacets; };
+  int64_t getNumInvertedShells() const { return numInvertedShells; };
+  // Shells such as a Moebius strip, where some facets can't agree with all
+  // their neighbours whichever way they are turned
+  int64_t getNumNonOrientableShells() const {
+    return numNonOrientableShells;
+  };
+
+ private:
+  void findShells(const IndexedMesh *mesh);
+  void measureShells(const StlFile::Facet *facets);
+  void nestShells(const StlFile::Facet *facets);
+  void flipFacets(StlFile::Facet *facets);
+  int64_t numShells;
+  int64_t numClosedShells;
+  int64_t numFlippedFacets;
+  int64_t numInvertedShells;
+  int64_t numNonOrientableShells;
+  // The facets shell by shell, shell s going from shellStarts[s] to
+  // shellStarts[s + 1]
+  ::std::vector<uint32_t> order;
+  ::std::vector<int64_t> shellStarts;
+  // Whether a facet must be flipped to agree with the first of its shell
+  ::std::vector<uint8_t> flipped;
+  ::std::vector<uint8_t> closed;
+  ::std::vector<double> volumes;
+  ::std::vector<float> bounds;  // Min and max corners, 6 floats a shell
+  ::std::vector<uint8_t> inverted;
+};
+
+#endif  // MESHREPAIR_H
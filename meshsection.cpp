@@ -0,0 +1,197 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <math.h>
+#include <algorithm>
+#include <cfloat>
+
+#include "indexedmesh.h"
+#include "meshsection.h"
+#include "parallel.h"
+#include "stlfile.h"
+
+// The bins are about as wide as the facets along the axis, so that each
+// facet goes into a couple of them, with at least this many facets per bin
+// on average and at most SECTION_MAX_BINS bins
+#define SECTION_FACETS_PER_BIN 64
+#define SECTION_MAX_BINS 65536
+// The facets are binned by at most this many tasks, each keeping a count
+// per bin
+#define SECTION_MAX_BLOCKS 64
+#define SECTION_MIN_BLOCK_SIZE 65536
+
+namespace {
+
+float getCoordinate(const StlFile::Vertex& vertex, int axis) {
+  return axis == 0 ? vertex.x : axis == 1 ? vertex.y : vertex.z;
+}
+
+}  // namespace
+
+MeshSection::MeshSection() {
+  mesh = 0;
+  axis = 2;
+  min = 0.0;
+  binSize = 1.0;
+  position = 0.0;
+  contour.z = 0.0;
+  contour.starts.push_back(0);
+  area = 0.0;
+  perimeter = 0.0;
+  numVisitedFacets = 0;
+}
+
+int64_t MeshSection::getBin(double position) const {
+  int64_t numBins = binStarts.size() - 1;
+  double bin = floor((position - min) / binSize);
+  return static_cast<int64_t>(
+      ::std::max(0.0, ::std::min(bin, static_cast<double>(numBins - 1))));
+}
+
+void MeshSection::build(const IndexedMesh *mesh, int axis) {
+  *this = MeshSection();
+  this->mesh = mesh;
+  this->axis = axis;
+  int64_t numFacets = mesh->getNumTriangles();
+  const StlFile::Vertex *vertices = mesh->getVertices();
+  const uint32_t *indices = mesh->getIndices();
+  auto getInterval = [&](int64_t facet, float *low, float *high) {
+    const uint32_t *v = indices + 3 * facet;
+    float a = getCoordinate(vertices[v[0]], axis);
+    float b = getCoordinate(vertices[v[1]], axis);
+    float c = getCoordinate(vertices[v[2]], axis);
+    *low = ::std::min(a, ::std::min(b, c));
+    *high = ::std::max(a, ::std::max(b, c));
+  };
+  int64_t blockSize = ::std::max<int64_t>(
+      SECTION_MIN_BLOCK_SIZE,
+      (numFacets + SECTION_MAX_BLOCKS - 1) / SECTION_MAX_BLOCKS);
+  int numBlocks = static_cast<int>((numFacets + blockSize - 1) / blockSize);
+  // The bounds of the facets along the axis and the sum of their widths
+  ::std::vector<float> lows(numBlocks, FLT_MAX), highs(numBlocks, -FLT_MAX);
+  ::std::vector<double> widths(numBlocks, 0.0);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = block * blockSize;
+    int64_t end = ::std::min(begin + blockSize, numFacets);
+    for (int64_t i = begin; i < end; i++) {
+      float low, high;
+      getInterval(i, &low, &high);
+      lows[block] = ::std::min(lows[block], low);
+      highs[block] = ::std::max(highs[block], high);
+      widths[block] += static_cast<double>(high) - low;
+    }
+  });
+  float low = FLT_MAX, high = -FLT_MAX;
+  double width = 0.0;
+  for (int block = 0; block < numBlocks; block++) {
+    low = ::std::min(low, lows[block]);
+    high = ::std::max(high, highs[block]);
+    width += widths[block];
+  }
+  int64_t numBins = 1;
+  if (low < high) {
+    double range = static_cast<double>(high) - low;
+    double maxBins = ::std::min<int64_t>(
+        SECTION_MAX_BINS, numFacets / SECTION_FACETS_PER_BIN);
+    if (width > 0.0)
+      maxBins = ::std::min(maxBins, range / (width / numFacets));
+    numBins = ::std::max<int64_t>(1, static_cast<int64_t>(maxBins));
+    min = low;
+    binSize = range / numBins;
+  }
+  binStarts.resize(numBins + 1);
+  // The bins from the one of the lowest vertex of the facet to the one of
+  // its highest, a plane cutting the facet lying in between
+  auto getSpan = [&](int64_t facet, int64_t *first, int64_t *last) {
+    float low, high;
+    getInterval(facet, &low, &high);
+    *first = getBin(low);
+    *last = getBin(high);
+  };
+  ::std::vector<int64_t> counts(numBlocks * numBins, 0);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = block * blockSize;
+    int64_t end = ::std::min(begin + blockSize, numFacets);
+    int64_t *count = &counts[block * numBins];
+    for (int64_t i = begin; i < end; i++) {
+      int64_t first, last;
+      getSpan(i, &first, &last);
+      for (int64_t bin = first; bin <= last; bin++)
+        count[bin]++;
+    }
+  });
+  int64_t offset = 0;
+  for (int64_t bin = 0; bin < numBins; bin++) {
+    binStarts[bin] = offset;
+    for (int block = 0; block < numBlocks; block++) {
+      int64_t count = counts[block * numBins + bin];
+      counts[block * numBins + bin] = offset;
+      offset += count;
+    }
+  }
+  binStarts[numBins] = offset;
+  bins.resize(offset);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = block * blockSize;
+    int64_t end = ::std::min(begin + blockSize, numFacets);
+    int64_t *next = &counts[block * numBins];
+    for (int64_t i = begin; i < end; i++) {
+      int64_t first, last;
+      getSpan(i, &first, &last);
+      for (int64_t bin = first; bin <= last; bin++)
+        bins[next[bin]++] = static_cast<uint32_t>(i);
+    }
+  });
+}
+
+void MeshSection::cut(double position) {
+  this->position = position;
+  contour.z = static_cast<float>(position);
+  contour.points.clear();
+  contour.starts.resize(1);
+  contour.closed.clear();
+  area = 0.0;
+  perimeter = 0.0;
+  numVisitedFacets = 0;
+  if (mesh == 0)
+    return;
+  int64_t bin = getBin(position);
+  numVisitedFacets = binStarts[bin + 1] - binStarts[bin];
+  MeshSlicer::cut(mesh, bins.data() + binStarts[bin], numVisitedFacets, axis,
+                  position, &contour);
+  for (size_t p = 0; p < contour.closed.size(); p++) {
+    int64_t begin = contour.starts[p];
+    int64_t end = contour.starts[p + 1];
+    // An open polygon doesn't go back to its first point
+    int64_t last = contour.closed[p] ? end : end - 1;
+    for (int64_t i = begin; i < last; i++) {
+      const MeshSlicer::Point &a = contour.points[i];
+      const MeshSlicer::Point &b = contour.points[i + 1 < end ? i + 1 : begin];
+      perimeter += hypot(static_cast<double>(b.x) - a.x,
+                         static_cast<double>(b.y) - a.y);
+    }
+    if (contour.closed[p])
+      area += MeshSlicer::getArea(contour, p);
+  }
+  // The holes go clockwise, so they come out of the sum, which is negative
+  // if the mesh is inside out
+  area = fabs(area);
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef MESHSECTION_H
+#define MESHSECTION_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "meshslicer.h"
+
+class IndexedMesh;
+
+// MeshSection Class - Cuts a welded mesh by a plane moving along an axis
+// The facets are binned once along the axis by the span of their vertices,
+// so that a cut only visits the facets of the bin holding the plane rather
+// than the whole mesh, which is fast enough to follow the mouse. The mesh
+// must outlive the section.
+class MeshSection {
+ public:
+  MeshSection();
+  // Bins the facets of the mesh along axis, 0 for x, 1 for y and 2 for z
+  void build(const IndexedMesh *mesh, int axis);
+  int getAxis() const { return axis; };
+  // Cuts the mesh by the plane at position along the axis
+  void cut(double position);
+  double getPosition() const { return position; };
+  // The polygons of the last cut, see MeshSlicer::cut for their coordinates
+  const MeshSlicer::Layer& getContour() const { return contour; };
+  // The area inside the closed polygons, their holes taken out
+  double getArea() const { return area; };
+  // The length of all the polygons, the open ones included
+  double getPerimeter() const { return perimeter; };
+  int64_t getNumVisitedFacets() const { return numVisitedFacets; };
+
+ private:
+  int64_t getBin(double position) const;
+  const IndexedMesh *mesh;
+  int axis;
+  double min;
+  double binSize;
+  // The facets spanning bin b are bins[binStarts[b]] to
+  // bins[binStarts[b + 1] - 1]
+  ::std::vector<uint32_t> bins;
+  ::std::vector<int64_t> binStarts;
+  double position;
+  MeshSlicer::Layer contour;
+  double area;
+  double perimeter;
+  int64_t numVisitedFacets;
+};
+
+#endif  // MESHSECTION_H
@@ -0,0 +1,229 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <algorithm>
+#include <atomic>
+
+#include "indexedmesh.h"
+#include "meshshells.h"
+#include "parallel.h"
+#include "statskernel.h"
+
+// Vertices or facets handled by one task
+#define SHELLS_BLOCK_SIZE 65536
+// Facets gathered and measured at a time
+#define SHELLS_CHUNK_SIZE 8192
+
+namespace {
+
+// Finds the root of a vertex, halving the path on the way. Another thread
+// may link the root meanwhile, the root returned is then one that was
+// current during the call. The links only ever point to lower vertices,
+// so they never form a loop and relaxed ordering is enough.
+uint32_t findRoot(::std::atomic<uint32_t> *parent, uint32_t vertex) {
+  for (;;) {
+    uint32_t up = parent[vertex].load(::std::memory_order_relaxed);
+    if (up == vertex)
+      return vertex;
+    uint32_t upper = parent[up].load(::std::memory_order_relaxed);
+    if (upper != up) {
+      parent[vertex].compare_exchange_weak(up, upper,
+                                           ::std::memory_order_relaxed);
+    }
+    vertex = upper;
+  }
+}
+
+void unite(::std::atomic<uint32_t> *parent, uint32_t a, uint32_t b) {
+  for (;;) {
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a == b)
+      return;
+    if (a < b)
+      ::std::swap(a, b);
+    // Fails if a stopped being a root, the roots are then found again
+    uint32_t expected = a;
+    if (parent[a].compare_exchange_strong(expected, b,
+                                          ::std::memory_order_relaxed))
+      return;
+  }
+}
+
+// Sums of a run of facets of one shell
+typedef struct {
+  int64_t shell;
+  StatsKernel::Sums sums;
+} Piece;
+
+}  // namespace
+
+MeshShells::MeshShells() {}
+
+void MeshShells::analyze(const StlFile::Facet *facets,
+                         const IndexedMesh *mesh) {
+  *this = MeshShells();
+  findShells(mesh);
+  measureShells(facets);
+}
+
+void MeshShells::findShells(const IndexedMesh *mesh) {
+  int64_t numVertices = mesh->getNumVertices();
+  int64_t numFacets = mesh->getNumTriangles();
+  const uint32_t *indices = mesh->getIndices();
+  ::std::vector<uint32_t> roots(numVertices);
+  {
+    ::std::vector< ::std::atomic<uint32_t> > parent(numVertices);
+    int numBlocks = static_cast<int>(
+        (numVertices + SHELLS_BLOCK_SIZE - 1) / SHELLS_BLOCK_SIZE);
+    Parallel::run(numBlocks, [&](int block) {
+      int64_t begin = static_cast<int64_t>(block) * SHELLS_BLOCK_SIZE;
+      int64_t end = ::std::min(begin + SHELLS_BLOCK_SIZE, numVertices);
+      for (int64_t v = begin; v < end; v++)
+        parent[v].store(static_cast<uint32_t>(v), ::std::memory_order_relaxed);
+    });
+    int numFacetBlocks = static_cast<int>(
+        (numFacets + SHELLS_BLOCK_SIZE - 1) / SHELLS_BLOCK_SIZE);
+    Parallel::run(numFacetBlocks, [&](int block) {
+      int64_t begin = static_cast<int64_t>(block) * SHELLS_BLOCK_SIZE;
+      int64_t end = ::std::min(begin + SHELLS_BLOCK_SIZE, numFacets);
+      for (int64_t i = begin; i < end; i++) {
+        const uint32_t *v = indices + 3 * i;
+        unite(parent.data(), v[0], v[1]);
+        unite(parent.data(), v[0], v[2]);
+      }
+    });
+    // Number the roots in increasing order
+    ::std::vector<uint32_t> counts(numBlocks, 0);
+    Parallel::run(numBlocks, [&](int block) {
+      int64_t begin = static_cast<int64_t>(block) * SHELLS_BLOCK_SIZE;
+      int64_t end = ::std::min(begin + SHELLS_BLOCK_SIZE, numVertices);
+      for (int64_t v = begin; v < end; v++) {
+        roots[v] = findRoot(parent.data(), static_cast<uint32_t>(v));
+        counts[block] += roots[v] == v;
+      }
+    });
+    uint32_t numShells = 0;
+    for (int block = 0; block < numBlocks; block++) {
+      uint32_t count = counts[block];
+      counts[block] = numShells;
+      numShells += count;
+    }
+    shells.resize(numShells);
+    // The roots are numbered first, a root always being lower than the
+    // vertices under it, then the other vertices take the number of theirs
+    Parallel::run(numBlocks, [&](int block) {
+      int64_t begin = static_cast<int64_t>(block) * SHELLS_BLOCK_SIZE;
+      int64_t end = ::std::min(begin + SHELLS_BLOCK_SIZE, numVertices);
+      uint32_t shell = counts[block];
+      for (int64_t v = begin; v < end; v++) {
+        if (roots[v] == v)
+          parent[v].store(shell++, ::std::memory_order_relaxed);
+      }
+    });
+    Parallel::run(numBlocks, [&](int block) {
+      int64_t begin = static_cast<int64_t>(block) * SHELLS_BLOCK_SIZE;
+      int64_t end = ::std::min(begin + SHELLS_BLOCK_SIZE, numVertices);
+      for (int64_t v = begin; v < end; v++)
+        roots[v] = parent[roots[v]].load(::std::memory_order_relaxed);
+    });
+  }
+
+  facetShells.resize(numFacets);
+  int numBlocks = static_cast<int>(
+      (numFacets + SHELLS_BLOCK_SIZE - 1) / SHELLS_BLOCK_SIZE);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * SHELLS_BLOCK_SIZE;
+    int64_t end = ::std::min(begin + SHELLS_BLOCK_SIZE, numFacets);
+    for (int64_t i = begin; i < end; i++)
+      facetShells[i] = roots[indices[3 * i]];
+  });
+  // Bucket the facets by shell, a single pass over the facets
+  firstFacets.assign(shells.size() + 1, 0);
+  for (int64_t i = 0; i < numFacets; i++)
+    firstFacets[facetShells[i] + 1]++;
+  for (size_t s = 0; s < shells.size(); s++) {
+    shells[s].numFacets = firstFacets[s + 1];
+    firstFacets[s + 1] += firstFacets[s];
+  }
+  order.resize(numFacets);
+  ::std::vector<int64_t> next(firstFacets.begin(), firstFacets.end() - 1);
+  for (int64_t i = 0; i < numFacets; i++)
+    order[next[facetShells[i]]++] = static_cast<uint32_t>(i);
+}
+
+void MeshShells::measureShells(const StlFile::Facet *facets) {
+  // The facets are measured in chunks of the same size whatever the
+  // shells, a chunk being cut where a shell ends. The pieces of a shell
+  // are then merged along the same tree as the stats of the whole file.
+  int64_t numFacets = order.size();
+  int numChunks = static_cast<int>(
+      (numFacets + SHELLS_CHUNK_SIZE - 1) / SHELLS_CHUNK_SIZE);
+  ::std::vector< ::std::vector<Piece> > chunkPieces(numChunks);
+  Parallel::run(numChunks, [&](int chunk) {
+    int64_t begin = static_cast<int64_t>(chunk) * SHELLS_CHUNK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + SHELLS_CHUNK_SIZE, numFacets);
+    ::std::vector<StlFile::Facet> gathered(end - begin);
+    int64_t shell = facetShells[order[begin]];
+    while (begin < end) {
+      int64_t pieceEnd = ::std::min(end, firstFacets[shell + 1]);
+      for (int64_t i = begin; i < pieceEnd; i++)
+        gathered[i - begin] = facets[order[i]];
+      Piece piece;
+      piece.shell = shell;
+      StatsKernel::clear(&piece.sums);
+      // The volume of each shell is measured from its first vertex
+      const StlFile::Vertex &origin =
+          facets[order[firstFacets[shell]]].vector[0];
+      StatsKernel::run(gathered.data(), pieceEnd - begin, origin,
+                       &piece.sums);
+      chunkPieces[chunk].push_back(piece);
+      begin = pieceEnd;
+      shell++;
+    }
+  });
+  ::std::vector<int64_t> shellPieces;
+  ::std::vector<StatsKernel::Sums> pieces;
+  for (int chunk = 0; chunk < numChunks; chunk++) {
+    for (size_t i = 0; i < chunkPieces[chunk].size(); i++) {
+      const Piece &piece = chunkPieces[chunk][i];
+      shellPieces.push_back(piece.shell);
+      pieces.push_back(piece.sums);
+    }
+  }
+  for (size_t i = 0; i < pieces.size(); ) {
+    size_t end = i + 1;
+    while (end < pieces.size() && shellPieces[end] == shellPieces[i])
+      end++;
+    StatsKernel::Sums sums;
+    StatsKernel::merge(&pieces[i], end - i, &sums);
+    Shell &shell = shells[shellPieces[i]];
+    shell.min.x = sums.min[0];
+    shell.min.y = sums.min[1];
+    shell.min.z = sums.min[2];
+    shell.max.x = sums.max[0];
+    shell.max.y = sums.max[1];
+    shell.max.z = sums.max[2];
+    shell.surface = sums.surface;
+    shell.volume = sums.volume6 / 6.0;
+    i = end;
+  }
+}
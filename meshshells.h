@@ -0,0 +1,70 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef MESHSHELLS_H
+#define MESHSHELLS_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "stlfile.h"
+
+class IndexedMesh;
+
+// MeshShells Class - Splits a mesh into its disconnected shells
+// Two facets are in the same shell when a chain of facets sharing
+// vertices joins them. The welded vertices are merged by a union-find that
+// all the cores update at once without locks, each root being linked
+// under a lower one with compare-and-swap. Every shell ends up with its
+// lowest vertex as root, so the shells are numbered in the order of their
+// first facet whatever the number of threads.
+class MeshShells {
+ public:
+  typedef struct {
+    int64_t numFacets;
+    StlFile::Vertex min;
+    StlFile::Vertex max;
+    double surface;
+    double volume;  // Signed, negative if the shell is inside out
+  } Shell;
+  MeshShells();
+  void analyze(const StlFile::Facet *facets, const IndexedMesh *mesh);
+  int64_t getNumShells() const { return shells.size(); };
+  const Shell& getShell(int64_t shell) const { return shells[shell]; };
+  // The shell of each facet
+  const uint32_t* getFacetShells() const { return facetShells.data(); };
+  // The facets of shell s, in the order of the file, are
+  // getFacets()[getFirstFacet(s)] to getFacets()[getFirstFacet(s + 1) - 1]
+  const uint32_t* getFacets() const { return order.data(); };
+  int64_t getFirstFacet(int64_t shell) const { return firstFacets[shell]; };
+
+ private:
+  // Stores the results into its entries and restores them as they are
+  friend class MeshCache;
+  void findShells(const IndexedMesh *mesh);
+  void measureShells(const StlFile::Facet *facets);
+  ::std::vector<Shell> shells;
+  ::std::vector<uint32_t> facetShells;
+  ::std::vector<uint32_t> order;
+  ::std::vector<int64_t> firstFacets;
+};
+
+#endif  // MESHSHELLS_H
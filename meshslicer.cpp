@@ -0,0 +1,452 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <cfloat>
+
+#include "compressedfile.h"
+#include "indexedmesh.h"
+#include "meshslicer.h"
+#include "parallel.h"
+#include "stlfile.h"
+
+// The facets are bucketed by at most this many tasks, each keeping a count
+// per layer
+#define SLICER_MAX_BLOCKS 64
+#define SLICER_MIN_BLOCK_SIZE 65536
+// Layers formatted at a time before being written
+#define SLICER_WRITE_BATCH 64
+
+namespace {
+
+// A facet crossing a plane, from the edge where it goes down through the
+// plane to the one where it goes up. Following the segments of an outward
+// oriented mesh goes counterclockwise around its outer contours.
+typedef struct {
+  uint64_t startEdge;
+  uint64_t endEdge;
+  MeshSlicer::Point start;
+  MeshSlicer::Point end;
+} Segment;
+
+bool operator<(const Segment& a, const Segment& b) {
+  return a.startEdge < b.startEdge;
+}
+
+// A plane going through a vertex gives it to all the edges around it
+void addPoint(::std::vector<MeshSlicer::Point>& points, int64_t first,
+              const MeshSlicer::Point& point) {
+  if (static_cast<int64_t>(points.size()) > first &&
+      points.back().x == point.x && points.back().y == point.y)
+    return;
+  points.push_back(point);
+}
+
+uint64_t getEdgeKey(uint32_t a, uint32_t b) {
+  return (static_cast<uint64_t>(::std::min(a, b)) << 32) | ::std::max(a, b);
+}
+
+double getCoordinate(const StlFile::Vertex& vertex, int axis) {
+  return axis == 0 ? vertex.x : axis == 1 ? vertex.y : vertex.z;
+}
+
+// Where the edge crosses the plane, always interpolated from its lower
+// vertex so that both facets sharing the edge get the same point
+MeshSlicer::Point getCrossing(const StlFile::Vertex *vertices, uint32_t a,
+                              uint32_t b, int axis, double plane) {
+  if (a > b)
+    ::std::swap(a, b);
+  const StlFile::Vertex &p = vertices[a];
+  const StlFile::Vertex &q = vertices[b];
+  double t = (plane - getCoordinate(p, axis)) /
+             (getCoordinate(q, axis) - getCoordinate(p, axis));
+  int u = (axis + 1) % 3;
+  int v = (axis + 2) % 3;
+  MeshSlicer::Point point;
+  point.x = static_cast<float>(getCoordinate(p, u) + t *
+      (getCoordinate(q, u) - getCoordinate(p, u)));
+  point.y = static_cast<float>(getCoordinate(p, v) + t *
+      (getCoordinate(q, v) - getCoordinate(p, v)));
+  return point;
+}
+
+// Writes a text file, compressed if its name asks for it
+class TextOutput {
+ public:
+  explicit TextOutput(const ::std::string& fileName) : fileName(fileName) {
+    if (!file.openForWriting(
+        fileName, CompressedFile::compressionFromFileName(fileName)))
+      throw StlFile::error_opening_file("The file " + fileName +
+                                        " could not be created.");
+  }
+  void write(const ::std::string& text) {
+    if (!file.write(text.data(), text.size()))
+      fail();
+  }
+  void close() {
+    if (!file.close())
+      fail();
+  }
+
+ private:
+  void fail() {
+    file.close();
+    remove(fileName.c_str());
+    throw StlFile::error_writing_file("The file " + fileName +
+                                      " could not be written.");
+  }
+  ::std::string fileName;
+  CompressedFile file;
+};
+
+void appendFormat(::std::string& text, const char *format, double a,
+                  double b) {
+  char buffer[64];
+  int length = snprintf(buffer, sizeof(buffer), format, a, b);
+  text.append(buffer, length);
+}
+
+}  // namespace
+
+MeshSlicer::MeshSlicer() {
+  minZ = 0.0;
+  layerHeight = 0.0;
+}
+
+void MeshSlicer::slice(const IndexedMesh *mesh, float minZ, float maxZ,
+                       float layerHeight) {
+  *this = MeshSlicer();
+  if (!(layerHeight > 0.0))
+    throw StlFile::error("The layer height must be positive.");
+  double numLayers = ceil((static_cast<double>(maxZ) - minZ) / layerHeight);
+  if (numLayers > MAX_LAYERS)
+    throw StlFile::error("Too many layers, the layers are too thin.");
+  this->minZ = minZ;
+  this->layerHeight = layerHeight;
+  layers.resize(::std::max(1, static_cast<int>(numLayers)));
+  for (size_t layer = 0; layer < layers.size(); layer++) {
+    layers[layer].z = static_cast<float>(getPlane(layer));
+    layers[layer].starts.push_back(0);
+  }
+  bucketFacets(mesh);
+  Parallel::run(static_cast<int>(layers.size()), [&](int layer) {
+    sliceLayer(mesh, layer);
+  });
+  ::std::vector<uint32_t>().swap(bucket);
+  ::std::vector<int64_t>().swap(bucketStarts);
+}
+
+double MeshSlicer::getPlane(int64_t layer) const {
+  return minZ + (layer + 0.5) * static_cast<double>(layerHeight);
+}
+
+void MeshSlicer::bucketFacets(const IndexedMesh *mesh) {
+  int64_t numFacets = mesh->getNumTriangles();
+  int64_t numLayers = layers.size();
+  const StlFile::Vertex *vertices = mesh->getVertices();
+  const uint32_t *indices = mesh->getIndices();
+  // The layers whose plane is above the lowest vertex of the facet and not
+  // above its highest one
+  auto getSpan = [&](int64_t facet, int64_t *first, int64_t *last) {
+    const uint32_t *v = indices + 3 * facet;
+    float low = ::std::min(vertices[v[0]].z,
+                           ::std::min(vertices[v[1]].z, vertices[v[2]].z));
+    float high = ::std::max(vertices[v[0]].z,
+                            ::std::max(vertices[v[1]].z, vertices[v[2]].z));
+    int64_t layer = static_cast<int64_t>(
+        floor((static_cast<double>(low) - minZ) / layerHeight - 0.5));
+    layer = ::std::max<int64_t>(0, ::std::min(layer, numLayers - 1));
+    while (layer > 0 && getPlane(layer - 1) > low)
+      layer--;
+    while (layer < numLayers && getPlane(layer) <= low)
+      layer++;
+    *first = layer;
+    while (layer < numLayers && getPlane(layer) <= high)
+      layer++;
+    *last = layer - 1;
+  };
+  int64_t blockSize = ::std::max<int64_t>(
+      SLICER_MIN_BLOCK_SIZE,
+      (numFacets + SLICER_MAX_BLOCKS - 1) / SLICER_MAX_BLOCKS);
+  int numBlocks = static_cast<int>((numFacets + blockSize - 1) / blockSize);
+  ::std::vector<int64_t> counts(numBlocks * numLayers, 0);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = block * blockSize;
+    int64_t end = ::std::min(begin + blockSize, numFacets);
+    int64_t *count = &counts[block * numLayers];
+    for (int64_t i = begin; i < end; i++) {
+      int64_t first, last;
+      getSpan(i, &first, &last);
+      for (int64_t layer = first; layer <= last; layer++)
+        count[layer]++;
+    }
+  });
+  bucketStarts.resize(numLayers + 1);
+  int64_t offset = 0;
+  for (int64_t layer = 0; layer < numLayers; layer++) {
+    bucketStarts[layer] = offset;
+    for (int block = 0; block < numBlocks; block++) {
+      int64_t count = counts[block * numLayers + layer];
+      counts[block * numLayers + layer] = offset;
+      offset += count;
+    }
+  }
+  bucketStarts[numLayers] = offset;
+  bucket.resize(offset);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = block * blockSize;
+    int64_t end = ::std::min(begin + blockSize, numFacets);
+    int64_t *next = &counts[block * numLayers];
+    for (int64_t i = begin; i < end; i++) {
+      int64_t first, last;
+      getSpan(i, &first, &last);
+      for (int64_t layer = first; layer <= last; layer++)
+        bucket[next[layer]++] = static_cast<uint32_t>(i);
+    }
+  });
+}
+
+void MeshSlicer::sliceLayer(const IndexedMesh *mesh, int64_t layer) {
+  cut(mesh, bucket.data() + bucketStarts[layer],
+      bucketStarts[layer + 1] - bucketStarts[layer], 2, getPlane(layer),
+      &layers[layer]);
+}
+
+void MeshSlicer::cut(const IndexedMesh *mesh, const uint32_t *facets,
+                     int64_t numFacets, int axis, double position,
+                     Layer *layer) {
+  const StlFile::Vertex *vertices = mesh->getVertices();
+  const uint32_t *indices = mesh->getIndices();
+  ::std::vector<Segment> segments;
+  segments.reserve(numFacets);
+  for (int64_t i = 0; i < numFacets; i++) {
+    const uint32_t *v = indices + 3 * static_cast<int64_t>(facets[i]);
+    bool above[3];
+    for (int j = 0; j < 3; j++)
+      above[j] = getCoordinate(vertices[v[j]], axis) >= position;
+    int down = -1, up = -1;
+    for (int j = 0; j < 3; j++) {
+      if (above[j] != above[(j + 1) % 3]) {
+        if (above[j])
+          down = j;
+        else
+          up = j;
+      }
+    }
+    if (down < 0 || up < 0)
+      continue;
+    Segment segment;
+    segment.startEdge = getEdgeKey(v[down], v[(down + 1) % 3]);
+    segment.endEdge = getEdgeKey(v[up], v[(up + 1) % 3]);
+    segment.start = getCrossing(vertices, v[down], v[(down + 1) % 3], axis,
+                                position);
+    segment.end = getCrossing(vertices, v[up], v[(up + 1) % 3], axis,
+                              position);
+    segments.push_back(segment);
+  }
+  // Sorted by the edge they start from, in the order of the facets for the
+  // same edge, the segment following another one is looked up by its end
+  ::std::stable_sort(segments.begin(), segments.end());
+  ::std::vector<uint64_t> ends(segments.size());
+  for (size_t i = 0; i < segments.size(); i++)
+    ends[i] = segments[i].endEdge;
+  ::std::sort(ends.begin(), ends.end());
+  ::std::vector<bool> used(segments.size(), false);
+  Layer &result = *layer;
+  // The open chains are followed from their first segment, the one no
+  // other segment leads to, before the closed ones
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t i = 0; i < segments.size(); i++) {
+      if (used[i] || (pass == 0 && ::std::binary_search(
+          ends.begin(), ends.end(), segments[i].startEdge)))
+        continue;
+      bool isClosed = false;
+      int64_t first = result.points.size();
+      size_t j = i;
+      for (;;) {
+        used[j] = true;
+        addPoint(result.points, first, segments[j].start);
+        uint64_t edge = segments[j].endEdge;
+        if (edge == segments[i].startEdge) {
+          isClosed = true;
+          const Point &start = result.points[first];
+          if (result.points.size() - first > 1 &&
+              result.points.back().x == start.x &&
+              result.points.back().y == start.y)
+            result.points.pop_back();
+          break;
+        }
+        Segment key;
+        key.startEdge = edge;
+        size_t k = ::std::lower_bound(segments.begin(), segments.end(), key) -
+                   segments.begin();
+        while (k < segments.size() && segments[k].startEdge == edge &&
+               used[k])
+          k++;
+        if (k == segments.size() || segments[k].startEdge != edge) {
+          addPoint(result.points, first, segments[j].end);
+          break;
+        }
+        j = k;
+      }
+      result.starts.push_back(result.points.size());
+      result.closed.push_back(isClosed);
+    }
+  }
+}
+
+int64_t MeshSlicer::getNumPolygons() const {
+  int64_t numPolygons = 0;
+  for (size_t layer = 0; layer < layers.size(); layer++)
+    numPolygons += layers[layer].closed.size();
+  return numPolygons;
+}
+
+int64_t MeshSlicer::getNumOpenPolygons() const {
+  int64_t numOpen = 0;
+  for (size_t layer = 0; layer < layers.size(); layer++) {
+    const ::std::vector<bool> &closed = layers[layer].closed;
+    numOpen += ::std::count(closed.begin(), closed.end(), false);
+  }
+  return numOpen;
+}
+
+double MeshSlicer::getArea(const Layer& layer, int64_t polygon) {
+  int64_t begin = layer.starts[polygon];
+  int64_t end = layer.starts[polygon + 1];
+  double area = 0.0;
+  for (int64_t i = begin; i < end; i++) {
+    const Point &a = layer.points[i];
+    const Point &b = layer.points[i + 1 < end ? i + 1 : begin];
+    area += static_cast<double>(a.x) * b.y - static_cast<double>(b.x) * a.y;
+  }
+  return area / 2.0;
+}
+
+void MeshSlicer::writeCli(const ::std::string& fileName) const {
+  TextOutput output(fileName);
+  char header[128];
+  snprintf(header, sizeof(header),
+           "$$HEADERSTART\n$$ASCII\n$$UNITS/1\n$$VERSION/200\n$$LAYERS/%d\n"
+           "$$HEADEREND\n$$GEOMETRYSTART\n", static_cast<int>(layers.size()));
+  output.write(header);
+  // The layers are formatted on all cores a batch at a time
+  ::std::vector< ::std::string> texts(SLICER_WRITE_BATCH);
+  int64_t numLayers = layers.size();
+  for (int64_t batch = 0; batch < numLayers; batch += SLICER_WRITE_BATCH) {
+    int count = static_cast<int>(::std::min<int64_t>(SLICER_WRITE_BATCH,
+                                                     numLayers - batch));
+    Parallel::run(count, [&](int i) {
+      const Layer &layer = layers[batch + i];
+      ::std::string &text = texts[i];
+      text.clear();
+      char buffer[64];
+      snprintf(buffer, sizeof(buffer), "$$LAYER/%.9g\n", layer.z);
+      text += buffer;
+      for (size_t p = 0; p + 1 < layer.starts.size(); p++) {
+        int64_t begin = layer.starts[p];
+        int64_t end = layer.starts[p + 1];
+        // 1 for counterclockwise, 0 for clockwise, 2 for an open line. A
+        // closed polyline ends on its first point.
+        int direction = !layer.closed[p] ? 2 : getArea(layer, p) > 0.0;
+        int64_t numPoints = end - begin + (layer.closed[p] ? 1 : 0);
+        snprintf(buffer, sizeof(buffer), "$$POLYLINE/1,%d,%lld", direction,
+                 static_cast<long long>(numPoints));
+        text += buffer;
+        for (int64_t j = begin; j < begin + numPoints; j++) {
+          const Point &point = layer.points[j < end ? j : begin];
+          appendFormat(text, ",%.9g,%.9g", point.x, point.y);
+        }
+        text += "\n";
+      }
+    });
+    for (int i = 0; i < count; i++)
+      output.write(texts[i]);
+  }
+  output.write("$$GEOMETRYEND\n");
+  output.close();
+}
+
+void MeshSlicer::writeSvg(const ::std::string& prefix) const {
+  // All the layers share the bounds of the whole slice, the y axis of SVG
+  // going down
+  float min[2] = {FLT_MAX, FLT_MAX};
+  float max[2] = {-FLT_MAX, -FLT_MAX};
+  for (size_t layer = 0; layer < layers.size(); layer++) {
+    const ::std::vector<Point> &points = layers[layer].points;
+    for (size_t i = 0; i < points.size(); i++) {
+      min[0] = ::std::min(min[0], points[i].x);
+      min[1] = ::std::min(min[1], points[i].y);
+      max[0] = ::std::max(max[0], points[i].x);
+      max[1] = ::std::max(max[1], points[i].y);
+    }
+  }
+  if (min[0] > max[0]) {
+    min[0] = min[1] = 0.0;
+    max[0] = max[1] = 1.0;
+  }
+  double width = ::std::max(max[0] - min[0], FLT_MIN);
+  double height = ::std::max(max[1] - min[1], FLT_MIN);
+  int64_t numLayers = layers.size();
+  for (int64_t l = 0; l < numLayers; l++) {
+    const Layer &layer = layers[l];
+    ::std::string text;
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+             "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+             "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%.9gmm\" "
+             "height=\"%.9gmm\"\n     viewBox=\"%.9g %.9g %.9g %.9g\">\n",
+             width, height, min[0], -max[1], width, height);
+    text += buffer;
+    snprintf(buffer, sizeof(buffer), "<title>Layer %lld, z = %.9g</title>\n",
+             static_cast<long long>(l + 1), layer.z);
+    text += buffer;
+    // The closed polygons are filled, the holes being the polygons inside
+    // an odd number of others, and the open ones are drawn in red
+    for (int closed = 1; closed >= 0; closed--) {
+      ::std::string path;
+      for (size_t p = 0; p + 1 < layer.starts.size(); p++) {
+        if (layer.closed[p] != static_cast<bool>(closed))
+          continue;
+        for (int64_t j = layer.starts[p]; j < layer.starts[p + 1]; j++) {
+          const Point &point = layer.points[j];
+          appendFormat(path, j == layer.starts[p] ? "M%.9g %.9g"
+                                                  : " L%.9g %.9g",
+                       point.x, -point.y);
+        }
+        path += closed ? " Z\n" : "\n";
+      }
+      if (path.empty())
+        continue;
+      text += closed ? "<path fill=\"black\" fill-rule=\"evenodd\" d=\"" :
+                       "<path fill=\"none\" stroke=\"red\" d=\"";
+      text += path + "\"/>\n";
+    }
+    text += "</svg>\n";
+    snprintf(buffer, sizeof(buffer), "%04lld.svg",
+             static_cast<long long>(l + 1));
+    TextOutput output(prefix + buffer);
+    output.write(text);
+    output.close();
+  }
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef MESHSLICER_H
+#define MESHSLICER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class IndexedMesh;
+
+// MeshSlicer Class - Cuts a welded mesh into layers of contours
+// The mesh is cut by horizontal planes in the middle of each layer. A
+// facet crossing a plane gives a segment between two of its edges, and
+// the segments are chained into polygons through these edges, which the
+// welded mesh shares between facets, so that no positions are compared.
+// A vertex exactly on a plane is taken as above it, so every segment has
+// two distinct ends. The facets are first put into the buckets of the
+// layers they cross, then the layers are cut on all cores.
+class MeshSlicer {
+ public:
+  typedef struct {
+    float x;
+    float y;
+  } Point;
+  typedef struct {
+    float z;
+    ::std::vector<Point> points;
+    // Polygon p goes from points[starts[p]] to points[starts[p + 1] - 1]
+    ::std::vector<int64_t> starts;
+    // A polygon that doesn't close comes from a hole in the mesh
+    ::std::vector<bool> closed;
+  } Layer;
+  static const int64_t MAX_LAYERS = 65536;
+  MeshSlicer();
+  // Cuts the mesh into layers of layerHeight from minZ to maxZ, usually the
+  // bounds from StlFile::Stats. Throws StlFile::error if the layer height
+  // isn't positive or there would be more than MAX_LAYERS layers.
+  void slice(const IndexedMesh *mesh, float minZ, float maxZ,
+             float layerHeight);
+  int64_t getNumLayers() const { return layers.size(); };
+  const Layer& getLayer(int64_t layer) const { return layers[layer]; };
+  int64_t getNumPolygons() const;
+  // Number of polygons that don't close, 0 for a watertight mesh
+  int64_t getNumOpenPolygons() const;
+  // The signed area of a polygon, positive if counterclockwise seen from
+  // above, which is the case of outer contours if the mesh is well oriented
+  static double getArea(const Layer& layer, int64_t polygon);
+  // Cuts the facets by the plane at position along axis, 0 for x, 1 for y
+  // and 2 for z, adding their polygons to layer, whose starts must already
+  // begin with 0. The points are given in the two coordinates following
+  // the axis, (y, z) for x, (z, x) for y and (x, y) for z, so that outer
+  // contours stay counterclockwise seen from the positive side of the axis.
+  static void cut(const IndexedMesh *mesh, const uint32_t *facets,
+                  int64_t numFacets, int axis, double position,
+                  Layer *layer);
+  // Writes the layers into a Common Layer Interface file, in ASCII, which
+  // is compressed if its name ends with .gz or .zst
+  void writeCli(const ::std::string& fileName) const;
+  // Writes each layer into an SVG file named after prefix and the number
+  // of the layer, prefix0001.svg for the first one
+  void writeSvg(const ::std::string& prefix) const;
+
+ private:
+  void bucketFacets(const IndexedMesh *mesh);
+  void sliceLayer(const IndexedMesh *mesh, int64_t layer);
+  double getPlane(int64_t layer) const;
+  float minZ;
+  float layerHeight;
+  // The facets crossing layer l are bucket[bucketStarts[l]] to
+  // bucket[bucketStarts[l + 1] - 1]
+  ::std::vector<uint32_t> bucket;
+  ::std::vector<int64_t> bucketStarts;
+  ::std::vector<Layer> layers;
+};
+
+#endif  // MESHSLICER_H
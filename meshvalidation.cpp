@@ -0,0 +1,249 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <algorithm>
+
+#include "indexedmesh.h"
+#include "meshvalidation.h"
+#include "parallel.h"
+#include "partitionsort.h"
+
+// Facets handled by one task
+#define VALIDATION_BLOCK_SIZE 65536
+
+namespace {
+
+// The vertices of a facet in increasing order, whatever its orientation
+typedef struct {
+  uint32_t vertex[3];
+  uint32_t facet;
+} FacetRecord;
+
+bool operator<(const FacetRecord& a, const FacetRecord& b) {
+  for (int i = 0; i < 3; i++) {
+    if (a.vertex[i] != b.vertex[i])
+      return a.vertex[i] < b.vertex[i];
+  }
+  return a.facet < b.facet;
+}
+
+bool sameVertices(const FacetRecord& a, const FacetRecord& b) {
+  return a.vertex[0] == b.vertex[0] && a.vertex[1] == b.vertex[1] &&
+         a.vertex[2] == b.vertex[2];
+}
+
+uint64_t hashFacetRecord(const FacetRecord& record) {
+  return mixBits(mixBits((static_cast<uint64_t>(record.vertex[0]) << 32) |
+                         record.vertex[1]) ^ record.vertex[2]);
+}
+
+// Defects found in a partition, applied to the facets once all the
+// partitions are done
+typedef struct {
+  int64_t numEdges;
+  int64_t numNonManifoldEdges;
+  int64_t numBoundaryEdges;
+  int64_t numFlippedEdges;
+  ::std::vector< ::std::pair<uint32_t, uint8_t> > flags;
+  ::std::vector< ::std::pair<uint32_t, uint32_t> > boundaryEdges;
+} PartitionDefects;
+
+uint32_t findRoot(::std::vector<uint32_t>& parent, uint32_t vertex) {
+  while (parent[vertex] != vertex) {
+    parent[vertex] = parent[parent[vertex]];
+    vertex = parent[vertex];
+  }
+  return vertex;
+}
+
+}  // namespace
+
+MeshValidation::MeshValidation() {
+  numEdges = 0;
+  numNonManifoldEdges = 0;
+  numBoundaryEdges = 0;
+  numHoles = 0;
+  numFlippedEdges = 0;
+  numDegenerateFacets = 0;
+  numDuplicateFacets = 0;
+  numFlaggedFacets = 0;
+}
+
+bool MeshValidation::isWatertight() const {
+  return numNonManifoldEdges == 0 && numBoundaryEdges == 0 &&
+         numFlippedEdges == 0;
+}
+
+void MeshValidation::validate(const IndexedMesh *mesh) {
+  *this = MeshValidation();
+  facetFlags.assign(mesh->getNumTriangles(), 0);
+  checkFacets(mesh);
+  checkEdges(mesh);
+  checkDuplicates(mesh);
+  for (size_t i = 0; i < facetFlags.size(); i++)
+    numFlaggedFacets += facetFlags[i] != 0;
+}
+
+void MeshValidation::checkFacets(const IndexedMesh *mesh) {
+  int64_t numFacets = mesh->getNumTriangles();
+  const uint32_t *indices = mesh->getIndices();
+  const StlFile::Vertex *vertices = mesh->getVertices();
+  int numBlocks = static_cast<int>(
+      (numFacets + VALIDATION_BLOCK_SIZE - 1) / VALIDATION_BLOCK_SIZE);
+  ::std::vector<int64_t> counts(numBlocks, 0);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * VALIDATION_BLOCK_SIZE;
+    int64_t end = ::std::min(begin + VALIDATION_BLOCK_SIZE, numFacets);
+    for (int64_t i = begin; i < end; i++) {
+      const uint32_t *v = indices + 3 * i;
+      bool degenerate = v[0] == v[1] || v[1] == v[2] || v[2] == v[0];
+      if (!degenerate) {
+        // Three distinct points can still be on a line
+        const StlFile::Vertex &a = vertices[v[0]];
+        const StlFile::Vertex &b = vertices[v[1]];
+        const StlFile::Vertex &c = vertices[v[2]];
+        float e1[3] = {b.x - a.x, b.y - a.y, b.z - a.z};
+        float e2[3] = {c.x - a.x, c.y - a.y, c.z - a.z};
+        degenerate = e1[1] * e2[2] - e1[2] * e2[1] == 0.0 &&
+                     e1[2] * e2[0] - e1[0] * e2[2] == 0.0 &&
+                     e1[0] * e2[1] - e1[1] * e2[0] == 0.0;
+      }
+      if (degenerate) {
+        facetFlags[i] |= DEGENERATE;
+        counts[block]++;
+      }
+    }
+  });
+  for (int block = 0; block < numBlocks; block++)
+    numDegenerateFacets += counts[block];
+}
+
+void MeshValidation::checkEdges(const IndexedMesh *mesh) {
+  int64_t numFacets = mesh->getNumTriangles();
+  const uint32_t *indices = mesh->getIndices();
+  ::std::vector<EdgeRecord> records;
+  ::std::vector<int64_t> starts;
+  sortEdges(indices, numFacets, &records, &starts);
+
+  ::std::vector<PartitionDefects> defects(PARTITION_SORT_NUM_PARTITIONS);
+  Parallel::run(PARTITION_SORT_NUM_PARTITIONS, [&](int p) {
+    PartitionDefects &found = defects[p];
+    found.numEdges = 0;
+    found.numNonManifoldEdges = 0;
+    found.numBoundaryEdges = 0;
+    found.numFlippedEdges = 0;
+    for (int64_t i = starts[p]; i < starts[p + 1]; ) {
+      int64_t end = i + 1;
+      while (end < starts[p + 1] && records[end].key == records[i].key)
+        end++;
+      found.numEdges++;
+      if (end - i == 1) {
+        found.numBoundaryEdges++;
+        uint32_t corner = records[i].corner;
+        found.flags.push_back(::std::make_pair(corner / 3,
+                                               uint8_t(BOUNDARY)));
+        found.boundaryEdges.push_back(::std::make_pair(
+            indices[corner], indices[corner - corner % 3 + (corner + 1) % 3]));
+      } else if (end - i == 2) {
+        // The two facets must go along the edge in opposite directions
+        uint32_t first = records[i].corner;
+        uint32_t second = records[i + 1].corner;
+        if (indices[first] == indices[second]) {
+          found.numFlippedEdges++;
+          found.flags.push_back(::std::make_pair(first / 3, uint8_t(FLIPPED)));
+          found.flags.push_back(::std::make_pair(second / 3,
+                                                 uint8_t(FLIPPED)));
+        }
+      } else {
+        found.numNonManifoldEdges++;
+        for (int64_t j = i; j < end; j++) {
+          found.flags.push_back(::std::make_pair(records[j].corner / 3,
+                                                 uint8_t(NON_MANIFOLD)));
+        }
+      }
+      i = end;
+    }
+  });
+  ::std::vector<EdgeRecord>().swap(records);
+
+  ::std::vector<uint32_t> parent;
+  for (int p = 0; p < PARTITION_SORT_NUM_PARTITIONS; p++) {
+    const PartitionDefects &found = defects[p];
+    numEdges += found.numEdges;
+    numNonManifoldEdges += found.numNonManifoldEdges;
+    numBoundaryEdges += found.numBoundaryEdges;
+    numFlippedEdges += found.numFlippedEdges;
+    for (size_t i = 0; i < found.flags.size(); i++)
+      facetFlags[found.flags[i].first] |= found.flags[i].second;
+    // The boundary edges joined end to end make the holes
+    if (!found.boundaryEdges.empty() && parent.empty()) {
+      parent.resize(mesh->getNumVertices());
+      for (size_t v = 0; v < parent.size(); v++)
+        parent[v] = static_cast<uint32_t>(v);
+    }
+    for (size_t i = 0; i < found.boundaryEdges.size(); i++) {
+      uint32_t a = findRoot(parent, found.boundaryEdges[i].first);
+      uint32_t b = findRoot(parent, found.boundaryEdges[i].second);
+      if (a != b)
+        parent[::std::max(a, b)] = ::std::min(a, b);
+    }
+  }
+  // Each loop has a single root left
+  ::std::vector<uint32_t> roots;
+  for (int p = 0; p < PARTITION_SORT_NUM_PARTITIONS; p++) {
+    const PartitionDefects &found = defects[p];
+    for (size_t i = 0; i < found.boundaryEdges.size(); i++)
+      roots.push_back(findRoot(parent, found.boundaryEdges[i].first));
+  }
+  ::std::sort(roots.begin(), roots.end());
+  numHoles = ::std::unique(roots.begin(), roots.end()) - roots.begin();
+}
+
+void MeshValidation::checkDuplicates(const IndexedMesh *mesh) {
+  int64_t numFacets = mesh->getNumTriangles();
+  const uint32_t *indices = mesh->getIndices();
+  ::std::vector<FacetRecord> records;
+  ::std::vector<int64_t> starts;
+  partitionSort(numFacets, [this, indices](int64_t facet,
+                                           FacetRecord records[]) {
+    if (facetFlags[facet] & DEGENERATE)
+      return 0;
+    FacetRecord &record = records[0];
+    for (int j = 0; j < 3; j++)
+      record.vertex[j] = indices[3 * facet + j];
+    ::std::sort(record.vertex, record.vertex + 3);
+    record.facet = static_cast<uint32_t>(facet);
+    return 1;
+  }, hashFacetRecord, &records, &starts);
+  // Only the facets after the first of a group are duplicates, each facet
+  // belongs to a single group
+  ::std::vector<int64_t> counts(PARTITION_SORT_NUM_PARTITIONS, 0);
+  Parallel::run(PARTITION_SORT_NUM_PARTITIONS, [&](int p) {
+    for (int64_t i = starts[p] + 1; i < starts[p + 1]; i++) {
+      if (sameVertices(records[i], records[i - 1])) {
+        facetFlags[records[i].facet] |= DUPLICATE;
+        counts[p]++;
+      }
+    }
+  });
+  for (int p = 0; p < PARTITION_SORT_NUM_PARTITIONS; p++)
+    numDuplicateFacets += counts[p];
+}
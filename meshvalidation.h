@@ -0,0 +1,80 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef MESHVALIDATION_H
+#define MESHVALIDATION_H
+
+#include <stdint.h>
+#include <vector>
+
+class IndexedMesh;
+
+// MeshValidation Class - Finds the defects of a welded mesh
+// Each edge is looked up among the edges of all the other facets: a closed
+// and consistently oriented mesh has every edge shared by exactly two
+// facets going along it in opposite directions. The edges are sorted in
+// parallel into partitions by hash, so the whole check takes a few passes
+// over the mesh. The results don't depend on the number of threads.
+class MeshValidation {
+ public:
+  // Defects found on a facet, a facet can have several
+  enum FacetFlag {
+    NON_MANIFOLD = 1,  // Has an edge shared by more than two facets
+    BOUNDARY = 2,      // Has an edge that no other facet has
+    FLIPPED = 4,       // Is oriented unlike a neighbour
+    DEGENERATE = 8,    // Has a zero area
+    DUPLICATE = 16     // Has the same vertices as a facet before it
+  };
+  MeshValidation();
+  void validate(const IndexedMesh *mesh);
+  int64_t getNumEdges() const { return numEdges; };
+  int64_t getNumNonManifoldEdges() const { return numNonManifoldEdges; };
+  int64_t getNumBoundaryEdges() const { return numBoundaryEdges; };
+  // Number of loops formed by the boundary edges, each loop being a hole
+  int64_t getNumHoles() const { return numHoles; };
+  // Edges shared by two facets going along it in the same direction
+  int64_t getNumFlippedEdges() const { return numFlippedEdges; };
+  int64_t getNumDegenerateFacets() const { return numDegenerateFacets; };
+  int64_t getNumDuplicateFacets() const { return numDuplicateFacets; };
+  int64_t getNumFlaggedFacets() const { return numFlaggedFacets; };
+  // The volume of a mesh is only meaningful if it is watertight
+  bool isWatertight() const;
+  // One combination of FacetFlag per facet
+  const uint8_t* getFacetFlags() const { return facetFlags.data(); };
+
+ private:
+  // Stores the results into its entries and restores them as they are
+  friend class MeshCache;
+  void checkFacets(const IndexedMesh *mesh);
+  void checkEdges(const IndexedMesh *mesh);
+  void checkDuplicates(const IndexedMesh *mesh);
+  ::std::vector<uint8_t> facetFlags;
+  int64_t numEdges;
+  int64_t numNonManifoldEdges;
+  int64_t numBoundaryEdges;
+  int64_t numHoles;
+  int64_t numFlippedEdges;
+  int64_t numDegenerateFacets;
+  int64_t numDuplicateFacets;
+  int64_t numFlaggedFacets;
+};
+
+#endif  // MESHVALIDATION_H
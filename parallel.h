@@ -0,0 +1,90 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Parallel Class - Spreads independent tasks over all the available cores
+class Parallel {
+ public:
+  // Returns the number of threads used to run the tasks
+  static int getNumThreads();
+  // Sets the number of threads used to run the tasks, 0 means one per core
+  static void setNumThreads(int threads);
+  // Calls task(i) for every i in [0, numTasks). The threads pick the tasks
+  // up in any order, so each task must only write its own results.
+  // The first exception thrown by a task is rethrown once all threads are
+  // done, and the tasks that were not started yet are skipped.
+  // A task that calls run() itself runs the inner tasks on its own thread,
+  // since the cores are already busy with the outer tasks.
+  template <typename Task>
+  static void run(int numTasks, Task task);
+
+ private:
+  static ::std::atomic<int> numThreads;
+  // Set on the threads while they run the tasks of a parallel run()
+  static thread_local bool inTask;
+};
+
+template <typename Task>
+void Parallel::run(int numTasks, Task task) {
+  int numWorkers = ::std::min(getNumThreads(), numTasks);
+  if (numWorkers <= 1 || inTask) {
+    for (int i = 0; i < numTasks; i++)
+      task(i);
+    return;
+  }
+  ::std::atomic<int> nextTask(0);
+  ::std::exception_ptr error;
+  ::std::mutex errorMutex;
+  auto worker = [&]() {
+    inTask = true;
+    for (int i = nextTask++; i < numTasks; i = nextTask++) {
+      try {
+        task(i);
+      } catch (...) {
+        ::std::lock_guard<::std::mutex> lock(errorMutex);
+        if (!error)
+          error = ::std::current_exception();
+        nextTask = numTasks;
+      }
+    }
+    inTask = false;
+  };
+  ::std::vector<::std::thread> threads;
+  for (int i = 1; i < numWorkers; i++)
+    threads.push_back(::std::thread(worker));
+  // The calling thread takes its share of the work too
+  worker();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+  if (error)
+    ::std::rethrow_exception(error);
+}
+
+#endif  // PARALLEL_H
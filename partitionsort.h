@@ -0,0 +1,141 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef PARTITIONSORT_H
+#define PARTITIONSORT_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "parallel.h"
+
+// Items handled by one task
+#define PARTITION_SORT_BLOCK_SIZE 65536
+// The records are sorted in this many parts, in parallel
+#define PARTITION_SORT_BITS 8
+#define PARTITION_SORT_NUM_PARTITIONS (1 << PARTITION_SORT_BITS)
+
+// Final mix of splitmix64, spreads the bits of a key over the whole hash
+inline uint64_t mixBits(uint64_t hash) {
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  return hash ^ (hash >> 31);
+}
+
+// Makes up to three records per item with makeRecords(item, records),
+// which returns how many it made, and sorts them so that equal records end
+// up next to each other. The records are split by hashRecord(record) into
+// partitions, partition p going from starts[p] to starts[p + 1], which
+// are sorted on all cores. Records that are equal must have the same hash.
+// The records keep the order of the items within a partition before the
+// sort, so the result doesn't depend on the threads as long as operator<
+// breaks all ties.
+template <typename Record, typename MakeRecords, typename HashRecord>
+void partitionSort(int64_t numItems, MakeRecords makeRecords,
+                   HashRecord hashRecord, ::std::vector<Record> *records,
+                   ::std::vector<int64_t> *starts) {
+  int numBlocks = static_cast<int>(
+      (numItems + PARTITION_SORT_BLOCK_SIZE - 1) / PARTITION_SORT_BLOCK_SIZE);
+  auto getPartition = [&hashRecord](const Record& record) {
+    return static_cast<int>(hashRecord(record) >> (64 - PARTITION_SORT_BITS));
+  };
+  ::std::vector<int64_t> counts(
+      static_cast<size_t>(numBlocks) * PARTITION_SORT_NUM_PARTITIONS, 0);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * PARTITION_SORT_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + PARTITION_SORT_BLOCK_SIZE,
+                                      numItems);
+    int64_t *count = &counts[block * PARTITION_SORT_NUM_PARTITIONS];
+    Record itemRecords[3];
+    for (int64_t i = begin; i < end; i++) {
+      int numRecords = makeRecords(i, itemRecords);
+      for (int j = 0; j < numRecords; j++)
+        count[getPartition(itemRecords[j])]++;
+    }
+  });
+  starts->assign(PARTITION_SORT_NUM_PARTITIONS + 1, 0);
+  int64_t offset = 0;
+  for (int p = 0; p < PARTITION_SORT_NUM_PARTITIONS; p++) {
+    (*starts)[p] = offset;
+    for (int block = 0; block < numBlocks; block++) {
+      int64_t count = counts[block * PARTITION_SORT_NUM_PARTITIONS + p];
+      counts[block * PARTITION_SORT_NUM_PARTITIONS + p] = offset;
+      offset += count;
+    }
+  }
+  (*starts)[PARTITION_SORT_NUM_PARTITIONS] = offset;
+  records->resize(offset);
+  Parallel::run(numBlocks, [&](int block) {
+    int64_t begin = static_cast<int64_t>(block) * PARTITION_SORT_BLOCK_SIZE;
+    int64_t end = ::std::min<int64_t>(begin + PARTITION_SORT_BLOCK_SIZE,
+                                      numItems);
+    int64_t *next = &counts[block * PARTITION_SORT_NUM_PARTITIONS];
+    Record itemRecords[3];
+    for (int64_t i = begin; i < end; i++) {
+      int numRecords = makeRecords(i, itemRecords);
+      for (int j = 0; j < numRecords; j++)
+        (*records)[next[getPartition(itemRecords[j])]++] = itemRecords[j];
+    }
+  });
+  Parallel::run(PARTITION_SORT_NUM_PARTITIONS, [&](int p) {
+    ::std::sort(records->begin() + (*starts)[p],
+                records->begin() + (*starts)[p + 1]);
+  });
+}
+
+// An edge of a facet of an indexed mesh. The key holds its two vertices,
+// the lower one in the upper bits, so that the edge has the same key in
+// both directions.
+typedef struct {
+  uint64_t key;
+  uint32_t corner;  // The corner of the facet the edge starts from
+} EdgeRecord;
+
+inline bool operator<(const EdgeRecord& a, const EdgeRecord& b) {
+  return a.key < b.key || (a.key == b.key && a.corner < b.corner);
+}
+
+// Sorts the edges of the facets of an indexed mesh by their vertices, so
+// that the edges facets share are next to each other. The edges whose ends
+// were welded together are left out.
+inline void sortEdges(const uint32_t *indices, int64_t numFacets,
+                      ::std::vector<EdgeRecord> *records,
+                      ::std::vector<int64_t> *starts) {
+  partitionSort(numFacets, [indices](int64_t facet, EdgeRecord records[]) {
+    int numRecords = 0;
+    for (int j = 0; j < 3; j++) {
+      uint32_t a = indices[3 * facet + j];
+      uint32_t b = indices[3 * facet + (j + 1) % 3];
+      if (a != b) {
+        records[numRecords].key =
+            (static_cast<uint64_t>(::std::min(a, b)) << 32) | ::std::max(a, b);
+        records[numRecords].corner = static_cast<uint32_t>(3 * facet + j);
+        numRecords++;
+      }
+    }
+    return numRecords;
+  }, [](const EdgeRecord& record) {
+    return mixBits(record.key);
+  }, records, starts);
+}
+
+#endif  // PARTITIONSORT_H
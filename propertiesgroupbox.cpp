@@ -20,6 +20,8 @@
 
 #include <QtGui/QtGui>
 
+#include "edgeanalysis.h"
+#include "histogramwidget.h"
 #include "propertiesgroupbox.h"
 
 PropertiesGroupBox::PropertiesGroupBox(QWidget *parent)
@@ -37,6 +39,28 @@ PropertiesGroupBox::PropertiesGroupBox(QWidget *parent)
   layout->addWidget(surface, 1, 1);
   layout->addWidget(new QLabel("mm^3"), 0, 2);
   layout->addWidget(new QLabel("mm^2"), 1, 2);
+  // Lengths of the edges
+  layout->addWidget(new QLabel("Shortest edge:"), 2, 0);
+  shortestEdge = new QLabel("");
+  shortestEdge->setAlignment(Qt::AlignRight);
+  layout->addWidget(shortestEdge, 2, 1);
+  layout->addWidget(new QLabel("Longest edge:"), 3, 0);
+  longestEdge = new QLabel("");
+  longestEdge->setAlignment(Qt::AlignRight);
+  layout->addWidget(longestEdge, 3, 1);
+  layout->addWidget(new QLabel("Mean edge:"), 4, 0);
+  meanEdge = new QLabel("");
+  meanEdge->setAlignment(Qt::AlignRight);
+  layout->addWidget(meanEdge, 4, 1);
+  layout->addWidget(new QLabel("Median edge:"), 5, 0);
+  medianEdge = new QLabel("");
+  medianEdge->setAlignment(Qt::AlignRight);
+  layout->addWidget(medianEdge, 5, 1);
+  for (int i = 2; i <= 5; i++)
+    layout->addWidget(new QLabel("mm"), i, 2);
+  // Number of edges by length, on a log scale
+  edgeHistogram = new HistogramWidget;
+  layout->addWidget(edgeHistogram, 6, 0, 1, 3);
   setLayout(layout);
 }
 
@@ -46,6 +70,11 @@ void PropertiesGroupBox::reset() {
   // Reset values
   volume->setText("");
   surface->setText("");
+  shortestEdge->setText("");
+  longestEdge->setText("");
+  meanEdge->setText("");
+  medianEdge->setText("");
+  edgeHistogram->reset();
 }
 
 void PropertiesGroupBox::setValues(const StlFile::Stats stats) {
@@ -56,3 +85,27 @@ void PropertiesGroupBox::setValues(const StlFile::Stats stats) {
   data.setNum(stats.surface, 'f', 3);
   surface->setText(data);
 }
+
+void PropertiesGroupBox::setEdges(const EdgeAnalysis *edges, bool computing) {
+  if (edges == 0) {
+    QString state = computing ? tr("computing...") : tr("unavailable");
+    shortestEdge->setText(state);
+    longestEdge->setText(state);
+    meanEdge->setText(state);
+    medianEdge->setText(state);
+    edgeHistogram->reset();
+    return;
+  }
+  // Short edges need more than a fixed number of decimals
+  shortestEdge->setText(QString::number(edges->getShortest(), 'g', 6));
+  longestEdge->setText(QString::number(edges->getLongest(), 'g', 6));
+  meanEdge->setText(QString::number(edges->getMean(), 'g', 6));
+  medianEdge->setText(QString::number(edges->getMedian(), 'g', 6));
+  QVector<qint64> counts(EdgeAnalysis::NUM_BINS);
+  QVector<double> limits(EdgeAnalysis::NUM_BINS + 1);
+  for (int i = 0; i < EdgeAnalysis::NUM_BINS; i++)
+    counts[i] = edges->getBinCount(i);
+  for (int i = 0; i <= EdgeAnalysis::NUM_BINS; i++)
+    limits[i] = edges->getBinLimit(i);
+  edgeHistogram->setBins(counts, limits);
+}
@@ -26,6 +26,8 @@
 #include "stlfile.h"
 
 class QLabel;
+class EdgeAnalysis;
+class HistogramWidget;
 
 class PropertiesGroupBox : public QGroupBox {
 
@@ -36,9 +38,14 @@ class PropertiesGroupBox : public QGroupBox {
   ~PropertiesGroupBox();
   void reset();
   void setValues(const StlFile::Stats stats);
+  // Without edges, the values are shown as being computed, or as
+  // unavailable if they aren't
+  void setEdges(const EdgeAnalysis *edges, bool computing = false);
 
  private:
   QLabel *volume, *surface;
+  QLabel *shortestEdge, *longestEdge, *meanEdge, *medianEdge;
+  HistogramWidget *edgeHistogram;
 };
 
 #endif  // PROPERTIESGROUPBOX_H
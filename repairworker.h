@@ -0,0 +1,55 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef REPAIRWORKER_H
+#define REPAIRWORKER_H
+
+#include <QtCore/QThread>
+
+#include "meshrepair.h"
+#include "stlfile.h"
+
+// Repairs a file in a worker thread, so that the window stays responsive
+// while the facets are reoriented. finished() is delivered to the window
+// once the repair is done. The file must not be read, changed or closed
+// before the thread is finished.
+class RepairWorker : public QThread {
+
+  Q_OBJECT
+
+ public:
+  RepairWorker(StlFile *stlFile, QObject *parent = 0);
+  ~RepairWorker();
+  // What the repair changed, once the thread is finished
+  MeshRepair getRepair() const { return repair; };
+  // Returns the reason why the file couldn't be repaired, empty on success
+  QString errorMessage() const { return error; };
+
+ protected:
+  void run();
+
+ private:
+  StlFile *stlFile;
+  MeshRepair repair;
+  QString error;
+};
+
+#endif  // REPAIRWORKER_H
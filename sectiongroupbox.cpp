@@ -0,0 +1,149 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <QtGui/QtGui>
+#include <algorithm>
+
+#include "meshsection.h"
+#include "sectiongroupbox.h"
+
+SectionGroupBox::SectionGroupBox(QWidget *parent)
+    : QGroupBox(tr("Section"), parent) {
+  for (int axis = 0; axis < 3; axis++)
+    min[axis] = max[axis] = 0.0;
+  QGridLayout *layout = new QGridLayout;
+  showCheckBox = new QCheckBox(tr("Show"));
+  layout->addWidget(showCheckBox, 0, 0);
+  axisComboBox = new QComboBox;
+  axisComboBox->addItem("X");
+  axisComboBox->addItem("Y");
+  axisComboBox->addItem("Z");
+  axisComboBox->setCurrentIndex(2);
+  layout->addWidget(axisComboBox, 0, 1, 1, 2);
+  positionSlider = new QSlider(Qt::Horizontal);
+  positionSlider->setRange(0, SLIDER_STEPS);
+  positionSlider->setValue(SLIDER_STEPS / 2);
+  layout->addWidget(positionSlider, 1, 0, 1, 3);
+  // Write labels and values
+  layout->addWidget(new QLabel("Position:"), 2, 0);
+  position = new QLabel("");
+  position->setAlignment(Qt::AlignRight);
+  layout->addWidget(position, 2, 1);
+  layout->addWidget(new QLabel("mm"), 2, 2);
+  layout->addWidget(new QLabel("Area:"), 3, 0);
+  area = new QLabel("");
+  area->setAlignment(Qt::AlignRight);
+  layout->addWidget(area, 3, 1);
+  layout->addWidget(new QLabel("mm^2"), 3, 2);
+  layout->addWidget(new QLabel("Perimeter:"), 4, 0);
+  perimeter = new QLabel("");
+  perimeter->setAlignment(Qt::AlignRight);
+  layout->addWidget(perimeter, 4, 1);
+  layout->addWidget(new QLabel("mm"), 4, 2);
+  layout->addWidget(new QLabel("Contours:"), 5, 0);
+  numPolygons = new QLabel("");
+  numPolygons->setAlignment(Qt::AlignRight);
+  layout->addWidget(numPolygons, 5, 1);
+  setLayout(layout);
+  connect(showCheckBox, SIGNAL(toggled(bool)), this, SLOT(updateSection()));
+  connect(axisComboBox, SIGNAL(currentIndexChanged(int)), this,
+          SLOT(updateSection()));
+  // The slider tracks the mouse, the plane moves while it is dragged
+  connect(positionSlider, SIGNAL(valueChanged(int)), this,
+          SLOT(updateSection()));
+  reset();
+}
+
+SectionGroupBox::~SectionGroupBox() {}
+
+void SectionGroupBox::reset() {
+  showCheckBox->blockSignals(true);
+  showCheckBox->setChecked(false);
+  showCheckBox->blockSignals(false);
+  position->setText("");
+  area->setText("");
+  perimeter->setText("");
+  numPolygons->setText("");
+  setEnabled(false);
+}
+
+void SectionGroupBox::setValues(const StlFile::Stats &stats,
+                                const MeshSection *section, bool computing) {
+  min[0] = stats.min.x;
+  min[1] = stats.min.y;
+  min[2] = stats.min.z;
+  max[0] = stats.max.x;
+  max[1] = stats.max.y;
+  max[2] = stats.max.z;
+  if (section == 0) {
+    reset();
+    // The section shares the mesh the stats are computed from
+    setEnabled(!computing && stats.numFacets > 0);
+    if (computing)
+      numPolygons->setText(tr("computing..."));
+    return;
+  }
+  setEnabled(true);
+  // Follow the section of the window without moving it again
+  showCheckBox->blockSignals(true);
+  axisComboBox->blockSignals(true);
+  positionSlider->blockSignals(true);
+  showCheckBox->setChecked(true);
+  int axis = section->getAxis();
+  axisComboBox->setCurrentIndex(axis);
+  if (max[axis] > min[axis]) {
+    positionSlider->setValue(qRound((section->getPosition() - min[axis]) /
+                                    (max[axis] - min[axis]) * SLIDER_STEPS));
+  }
+  showCheckBox->blockSignals(false);
+  axisComboBox->blockSignals(false);
+  positionSlider->blockSignals(false);
+  QString data;
+  data.setNum(section->getPosition(), 'f', 3);
+  position->setText(data);
+  data.setNum(section->getArea(), 'f', 3);
+  area->setText(data);
+  data.setNum(section->getPerimeter(), 'f', 3);
+  perimeter->setText(data);
+  // The open contours come from holes in the mesh
+  const MeshSlicer::Layer &contour = section->getContour();
+  int numOpen = ::std::count(contour.closed.begin(), contour.closed.end(),
+                             false);
+  if (numOpen > 0) {
+    numPolygons->setText(tr("%1 (%2 open)").arg(contour.closed.size())
+                         .arg(numOpen));
+  } else {
+    numPolygons->setText(QString::number(contour.closed.size()));
+  }
+}
+
+double SectionGroupBox::getPosition() const {
+  int axis = axisComboBox->currentIndex();
+  return min[axis] + (static_cast<double>(max[axis]) - min[axis]) *
+                     positionSlider->value() / SLIDER_STEPS;
+}
+
+void SectionGroupBox::updateSection() {
+  if (showCheckBox->isChecked())
+    emit sectionShown(axisComboBox->currentIndex(), getPosition());
+  else
+    emit sectionHidden();
+}
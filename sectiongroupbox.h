@@ -0,0 +1,67 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef SECTIONGROUPBOX_H
+#define SECTIONGROUPBOX_H
+
+#include <QtGui/QGroupBox>
+
+#include "stlfile.h"
+
+class QCheckBox;
+class QComboBox;
+class QLabel;
+class QSlider;
+class MeshSection;
+
+// Moves a section plane along an axis of the model and shows the area and
+// the perimeter of its cut. The plane follows the slider as it is dragged.
+class SectionGroupBox : public QGroupBox {
+
+  Q_OBJECT
+
+ public:
+  static const int SLIDER_STEPS = 1000;
+  SectionGroupBox(QWidget *parent = 0);
+  ~SectionGroupBox();
+  void reset();
+  // The plane moves between the bounds of the model. Without a section,
+  // the plane isn't shown, and can't be while the stats are computed.
+  void setValues(const StlFile::Stats &stats, const MeshSection *section,
+                 bool computing = false);
+
+ signals:
+  void sectionShown(int axis, double position);
+  void sectionHidden();
+
+ private slots:
+  void updateSection();
+
+ private:
+  double getPosition() const;
+  float min[3], max[3];
+  QCheckBox *showCheckBox;
+  QComboBox *axisComboBox;
+  QSlider *positionSlider;
+  QLabel *position, *area, *perimeter, *numPolygons;
+};
+
+#endif  // SECTIONGROUPBOX_H
@@ -0,0 +1,164 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <QtGui/QtGui>
+
+#include "meshshells.h"
+#include "shellsgroupbox.h"
+
+ShellsGroupBox::ShellsGroupBox(QWidget *parent)
+    : QGroupBox(tr("Shells"), parent) {
+  shells = 0;
+  QGridLayout *layout = new QGridLayout;
+  layout->addWidget(new QLabel("Shells:"), 0, 0);
+  numShells = new QLabel("");
+  numShells->setAlignment(Qt::AlignRight);
+  layout->addWidget(numShells, 0, 1, 1, 3);
+  // One row per shell, numbered from 1 in the order of their first facet
+  table = new QTableWidget(0, 6);
+  QStringList headers;
+  headers << tr("Shell") << tr("Facets") << tr("Size") << tr("Surface")
+          << tr("Volume") << tr("Shown");
+  table->setHorizontalHeaderLabels(headers);
+  table->verticalHeader()->hide();
+  table->setSelectionBehavior(QAbstractItemView::SelectRows);
+  table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  table->setSortingEnabled(true);
+  layout->addWidget(table, 1, 0, 1, 4);
+  hideButton = new QPushButton(tr("Hide"));
+  showButton = new QPushButton(tr("Show"));
+  isolateButton = new QPushButton(tr("Isolate"));
+  showAllButton = new QPushButton(tr("Show All"));
+  exportButton = new QPushButton(tr("Export..."));
+  layout->addWidget(hideButton, 2, 0);
+  layout->addWidget(showButton, 2, 1);
+  layout->addWidget(isolateButton, 2, 2);
+  layout->addWidget(showAllButton, 2, 3);
+  layout->addWidget(exportButton, 3, 3);
+  setLayout(layout);
+  connect(hideButton, SIGNAL(clicked()), this, SLOT(hideSelected()));
+  connect(showButton, SIGNAL(clicked()), this, SLOT(showSelected()));
+  connect(isolateButton, SIGNAL(clicked()), this, SLOT(isolateSelected()));
+  connect(showAllButton, SIGNAL(clicked()), this, SIGNAL(showAllRequested()));
+  connect(exportButton, SIGNAL(clicked()), this, SLOT(exportSelected()));
+  connect(table, SIGNAL(itemSelectionChanged()), this, SLOT(updateButtons()));
+  updateButtons();
+}
+
+ShellsGroupBox::~ShellsGroupBox() {}
+
+void ShellsGroupBox::reset() {
+  shells = 0;
+  numShells->setText("");
+  table->setRowCount(0);
+  updateButtons();
+}
+
+void ShellsGroupBox::setValues(const MeshShells *shells,
+                               const QVector<bool> &hidden, bool computing) {
+  if (shells == 0) {
+    reset();
+    numShells->setText(computing ? tr("computing...") : tr("unavailable"));
+    return;
+  }
+  int numRows = static_cast<int>(qMin<int64_t>(shells->getNumShells(),
+                                               MAX_ROWS));
+  if (shells != this->shells) {
+    // Fill the table once per mesh, the selection is kept afterwards
+    this->shells = shells;
+    if (shells->getNumShells() > MAX_ROWS) {
+      numShells->setText(tr("%1 (first %2 listed)")
+                         .arg(shells->getNumShells()).arg(MAX_ROWS));
+    } else {
+      numShells->setText(QString::number(shells->getNumShells()));
+    }
+    table->setSortingEnabled(false);
+    table->clearContents();
+    table->setRowCount(numRows);
+    for (int row = 0; row < numRows; row++) {
+      const MeshShells::Shell &shell = shells->getShell(row);
+      QTableWidgetItem *item = new QTableWidgetItem;
+      item->setData(Qt::DisplayRole, row + 1);
+      table->setItem(row, 0, item);
+      item = new QTableWidgetItem;
+      item->setData(Qt::DisplayRole, static_cast<qlonglong>(shell.numFacets));
+      table->setItem(row, 1, item);
+      item = new QTableWidgetItem(QString("%1 x %2 x %3")
+          .arg(shell.max.x - shell.min.x, 0, 'g', 4)
+          .arg(shell.max.y - shell.min.y, 0, 'g', 4)
+          .arg(shell.max.z - shell.min.z, 0, 'g', 4));
+      table->setItem(row, 2, item);
+      item = new QTableWidgetItem;
+      item->setData(Qt::DisplayRole, shell.surface);
+      table->setItem(row, 3, item);
+      item = new QTableWidgetItem;
+      item->setData(Qt::DisplayRole, shell.volume);
+      // A negative volume means the shell is inside out, or not closed
+      if (shell.volume < 0.0)
+        item->setToolTip(tr("The shell is inside out or not closed"));
+      table->setItem(row, 4, item);
+      table->setItem(row, 5, new QTableWidgetItem);
+    }
+    table->setSortingEnabled(true);
+    table->resizeColumnsToContents();
+  }
+  for (int row = 0; row < numRows; row++) {
+    int shell = table->item(row, 0)->data(Qt::DisplayRole).toInt() - 1;
+    bool isHidden = shell < hidden.size() && hidden[shell];
+    table->item(row, 5)->setText(isHidden ? tr("No") : tr("Yes"));
+  }
+  updateButtons();
+}
+
+QList<int> ShellsGroupBox::selectedShells() const {
+  QList<int> selected;
+  QList<QTableWidgetSelectionRange> ranges = table->selectedRanges();
+  for (int i = 0; i < ranges.size(); i++) {
+    for (int row = ranges[i].topRow(); row <= ranges[i].bottomRow(); row++)
+      selected << table->item(row, 0)->data(Qt::DisplayRole).toInt() - 1;
+  }
+  return selected;
+}
+
+void ShellsGroupBox::hideSelected() {
+  emit hideRequested(selectedShells());
+}
+
+void ShellsGroupBox::showSelected() {
+  emit showRequested(selectedShells());
+}
+
+void ShellsGroupBox::isolateSelected() {
+  emit isolateRequested(selectedShells());
+}
+
+void ShellsGroupBox::exportSelected() {
+  emit exportRequested(selectedShells());
+}
+
+void ShellsGroupBox::updateButtons() {
+  bool hasSelection = !table->selectedRanges().isEmpty();
+  hideButton->setEnabled(hasSelection);
+  showButton->setEnabled(hasSelection);
+  isolateButton->setEnabled(hasSelection);
+  exportButton->setEnabled(hasSelection);
+  showAllButton->setEnabled(shells != 0);
+}
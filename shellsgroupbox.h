@@ -0,0 +1,71 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef SHELLSGROUPBOX_H
+#define SHELLSGROUPBOX_H
+
+#include <QtGui/QGroupBox>
+
+class QLabel;
+class QPushButton;
+class QTableWidget;
+class MeshShells;
+
+// Lists the shells of a mesh, so that they can be hidden, isolated or
+// exported. Only the first MAX_ROWS shells are listed.
+class ShellsGroupBox : public QGroupBox {
+
+  Q_OBJECT
+
+ public:
+  static const int MAX_ROWS = 1000;
+  ShellsGroupBox(QWidget *parent = 0);
+  ~ShellsGroupBox();
+  void reset();
+  // Without shells, they are shown as being computed, or as unavailable if
+  // they aren't. hidden tells whether each shell is hidden.
+  void setValues(const MeshShells *shells, const QVector<bool> &hidden,
+                 bool computing = false);
+
+ signals:
+  void hideRequested(const QList<int> &shells);
+  void showRequested(const QList<int> &shells);
+  void isolateRequested(const QList<int> &shells);
+  void showAllRequested();
+  void exportRequested(const QList<int> &shells);
+
+ private slots:
+  void hideSelected();
+  void showSelected();
+  void isolateSelected();
+  void exportSelected();
+  void updateButtons();
+
+ private:
+  QList<int> selectedShells() const;
+  const MeshShells *shells;
+  QLabel *numShells;
+  QTableWidget *table;
+  QPushButton *hideButton, *showButton, *isolateButton, *showAllButton;
+  QPushButton *exportButton;
+};
+
+#endif  // SHELLSGROUPBOX_H
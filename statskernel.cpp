@@ -0,0 +1,410 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <math.h>
+#include <algorithm>
+#include <cfloat>
+
+#include "statskernel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STATS_KERNEL_SSE
+#include <emmintrin.h>
+#endif
+// The AVX kernel is compiled on its own with the target attribute, and
+// only called if the processor and the system support AVX
+#if defined(STATS_KERNEL_SSE) && defined(__GNUC__)
+#define STATS_KERNEL_AVX
+#include <immintrin.h>
+#endif
+
+// A facet is read as 13 floats, the extra bytes taking the last one
+static_assert(sizeof(StlFile::Facet) == 13 * sizeof(float),
+              "StlFile::Facet must be packed for the stats kernel");
+
+void StatsKernel::clear(Sums *sums) {
+  for (int i = 0; i < 3; i++) {
+    sums->min[i] = FLT_MAX;
+    sums->max[i] = -FLT_MAX;
+  }
+  sums->shortestEdge2 = FLT_MAX;
+  sums->longestEdge2 = 0.0;
+  sums->surface = 0.0;
+  sums->volume6 = 0.0;
+}
+
+static void runScalar(const StlFile::Facet *facets, int64_t numFacets,
+                      const StlFile::Vertex& origin, StatsKernel::Sums *sums) {
+  for (int64_t i = 0; i < numFacets; i++) {
+    const StlFile::Vertex *v = facets[i].vector;
+    for (int j = 0; j < 3; j++) {
+      sums->min[0] = ::std::min(sums->min[0], v[j].x);
+      sums->min[1] = ::std::min(sums->min[1], v[j].y);
+      sums->min[2] = ::std::min(sums->min[2], v[j].z);
+      sums->max[0] = ::std::max(sums->max[0], v[j].x);
+      sums->max[1] = ::std::max(sums->max[1], v[j].y);
+      sums->max[2] = ::std::max(sums->max[2], v[j].z);
+    }
+    float e[3][3];
+    float edge2[3];
+    for (int j = 0; j < 3; j++) {
+      const StlFile::Vertex &a = v[j];
+      const StlFile::Vertex &b = v[(j + 1) % 3];
+      e[j][0] = b.x - a.x;
+      e[j][1] = b.y - a.y;
+      e[j][2] = b.z - a.z;
+      edge2[j] = e[j][0] * e[j][0] + e[j][1] * e[j][1] + e[j][2] * e[j][2];
+    }
+    sums->shortestEdge2 = ::std::min(sums->shortestEdge2,
+                                     ::std::min(edge2[0],
+                                                ::std::min(edge2[1],
+                                                           edge2[2])));
+    sums->longestEdge2 = ::std::max(sums->longestEdge2,
+                                    ::std::max(edge2[0],
+                                               ::std::max(edge2[1],
+                                                          edge2[2])));
+    // Cross product of v1 - v0 and v2 - v0, twice the area of the facet
+    float cx = e[2][1] * e[0][2] - e[2][2] * e[0][1];
+    float cy = e[2][2] * e[0][0] - e[2][0] * e[0][2];
+    float cz = e[2][0] * e[0][1] - e[2][1] * e[0][0];
+    sums->surface += 0.5f * sqrtf(cx * cx + cy * cy + cz * cz);
+    // Six times the signed volume of the tetrahedron from the origin
+    sums->volume6 += (v[0].x - origin.x) * cx + (v[0].y - origin.y) * cy +
+                     (v[0].z - origin.z) * cz;
+  }
+}
+
+static void computeNormalsScalar(StlFile::Facet *facets, int64_t numFacets) {
+  for (int64_t i = 0; i < numFacets; i++) {
+    const StlFile::Vertex *v = facets[i].vector;
+    float e0[3] = {v[1].x - v[0].x, v[1].y - v[0].y, v[1].z - v[0].z};
+    float e2[3] = {v[0].x - v[2].x, v[0].y - v[2].y, v[0].z - v[2].z};
+    float cx = e2[1] * e0[2] - e2[2] * e0[1];
+    float cy = e2[2] * e0[0] - e2[0] * e0[2];
+    float cz = e2[0] * e0[1] - e2[1] * e0[0];
+    float c2 = cx * cx + cy * cy + cz * cz;
+    float factor = c2 > 0.0f ? 1.0f / sqrtf(c2) : 0.0f;
+    facets[i].normal.x = cx * factor;
+    facets[i].normal.y = cy * factor;
+    facets[i].normal.z = cz * factor;
+  }
+}
+
+#ifdef STATS_KERNEL_SSE
+
+// Loads four facets and transposes them, so that each register holds the
+// same coordinate of the four facets: the normal, then the three vertices
+static inline void loadFacets(const StlFile::Facet *facets, __m128 r[12]) {
+  for (int k = 0; k < 3; k++) {
+    __m128 f0 = _mm_loadu_ps(&facets[0].normal.x + 4 * k);
+    __m128 f1 = _mm_loadu_ps(&facets[1].normal.x + 4 * k);
+    __m128 f2 = _mm_loadu_ps(&facets[2].normal.x + 4 * k);
+    __m128 f3 = _mm_loadu_ps(&facets[3].normal.x + 4 * k);
+    _MM_TRANSPOSE4_PS(f0, f1, f2, f3);
+    r[4 * k] = f0;
+    r[4 * k + 1] = f1;
+    r[4 * k + 2] = f2;
+    r[4 * k + 3] = f3;
+  }
+}
+
+// Computes the normals of four facets at a time. The normal and the first
+// coordinate of the first vertex share a register, which is transposed
+// back and stored whole, writing that coordinate back unchanged.
+static void computeNormalsSse(StlFile::Facet *facets, int64_t numFacets) {
+  __m128 zero = _mm_setzero_ps();
+  __m128 one = _mm_set1_ps(1.0f);
+  int64_t numBlocks = numFacets / 4;
+  for (int64_t i = 0; i < numBlocks; i++) {
+    StlFile::Facet *block = facets + 4 * i;
+    __m128 r[12];
+    loadFacets(block, r);
+    __m128 *v[3] = {r + 3, r + 6, r + 9};
+    __m128 e0[3], e2[3];
+    for (int k = 0; k < 3; k++) {
+      e0[k] = _mm_sub_ps(v[1][k], v[0][k]);
+      e2[k] = _mm_sub_ps(v[0][k], v[2][k]);
+    }
+    __m128 cx = _mm_sub_ps(_mm_mul_ps(e2[1], e0[2]),
+                           _mm_mul_ps(e2[2], e0[1]));
+    __m128 cy = _mm_sub_ps(_mm_mul_ps(e2[2], e0[0]),
+                           _mm_mul_ps(e2[0], e0[2]));
+    __m128 cz = _mm_sub_ps(_mm_mul_ps(e2[0], e0[1]),
+                           _mm_mul_ps(e2[1], e0[0]));
+    __m128 c2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx),
+                                      _mm_mul_ps(cy, cy)),
+                           _mm_mul_ps(cz, cz));
+    // The lanes of the degenerate facets are cleared rather than divided
+    __m128 factor = _mm_and_ps(_mm_cmpgt_ps(c2, zero),
+                               _mm_div_ps(one, _mm_sqrt_ps(c2)));
+    __m128 f0 = _mm_mul_ps(cx, factor);
+    __m128 f1 = _mm_mul_ps(cy, factor);
+    __m128 f2 = _mm_mul_ps(cz, factor);
+    __m128 f3 = v[0][0];
+    _MM_TRANSPOSE4_PS(f0, f1, f2, f3);
+    _mm_storeu_ps(&block[0].normal.x, f0);
+    _mm_storeu_ps(&block[1].normal.x, f1);
+    _mm_storeu_ps(&block[2].normal.x, f2);
+    _mm_storeu_ps(&block[3].normal.x, f3);
+  }
+  computeNormalsScalar(facets + 4 * numBlocks, numFacets - 4 * numBlocks);
+}
+
+static void runSse(const StlFile::Facet *facets, int64_t numFacets,
+                   const StlFile::Vertex& origin, StatsKernel::Sums *sums) {
+  __m128 min[3], max[3];
+  for (int j = 0; j < 3; j++) {
+    min[j] = _mm_set1_ps(sums->min[j]);
+    max[j] = _mm_set1_ps(sums->max[j]);
+  }
+  __m128 shortest = _mm_set1_ps(sums->shortestEdge2);
+  __m128 longest = _mm_set1_ps(sums->longestEdge2);
+  // Two doubles for the lower lanes, two for the upper ones
+  __m128d surface[2] = {_mm_setzero_pd(), _mm_setzero_pd()};
+  __m128d volume6[2] = {_mm_setzero_pd(), _mm_setzero_pd()};
+  __m128 half = _mm_set1_ps(0.5f);
+  __m128 o[3] = {_mm_set1_ps(origin.x), _mm_set1_ps(origin.y),
+                 _mm_set1_ps(origin.z)};
+  int64_t numBlocks = numFacets / 4;
+  for (int64_t i = 0; i < numBlocks; i++) {
+    __m128 r[12];
+    loadFacets(facets + 4 * i, r);
+    __m128 *v[3] = {r + 3, r + 6, r + 9};
+    for (int j = 0; j < 3; j++) {
+      for (int k = 0; k < 3; k++) {
+        min[k] = _mm_min_ps(min[k], v[j][k]);
+        max[k] = _mm_max_ps(max[k], v[j][k]);
+      }
+    }
+    __m128 e[3][3];
+    for (int j = 0; j < 3; j++) {
+      for (int k = 0; k < 3; k++)
+        e[j][k] = _mm_sub_ps(v[(j + 1) % 3][k], v[j][k]);
+      __m128 edge2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[j][0], e[j][0]),
+                                           _mm_mul_ps(e[j][1], e[j][1])),
+                                _mm_mul_ps(e[j][2], e[j][2]));
+      shortest = _mm_min_ps(shortest, edge2);
+      longest = _mm_max_ps(longest, edge2);
+    }
+    __m128 cx = _mm_sub_ps(_mm_mul_ps(e[2][1], e[0][2]),
+                           _mm_mul_ps(e[2][2], e[0][1]));
+    __m128 cy = _mm_sub_ps(_mm_mul_ps(e[2][2], e[0][0]),
+                           _mm_mul_ps(e[2][0], e[0][2]));
+    __m128 cz = _mm_sub_ps(_mm_mul_ps(e[2][0], e[0][1]),
+                           _mm_mul_ps(e[2][1], e[0][0]));
+    __m128 c2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx),
+                                      _mm_mul_ps(cy, cy)),
+                           _mm_mul_ps(cz, cz));
+    __m128 area = _mm_mul_ps(half, _mm_sqrt_ps(c2));
+    surface[0] = _mm_add_pd(surface[0], _mm_cvtps_pd(area));
+    surface[1] = _mm_add_pd(surface[1],
+                            _mm_cvtps_pd(_mm_movehl_ps(area, area)));
+    __m128 h = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(_mm_sub_ps(v[0][0], o[0]), cx),
+                   _mm_mul_ps(_mm_sub_ps(v[0][1], o[1]), cy)),
+        _mm_mul_ps(_mm_sub_ps(v[0][2], o[2]), cz));
+    volume6[0] = _mm_add_pd(volume6[0], _mm_cvtps_pd(h));
+    volume6[1] = _mm_add_pd(volume6[1], _mm_cvtps_pd(_mm_movehl_ps(h, h)));
+  }
+  float lanes[4];
+  for (int j = 0; j < 3; j++) {
+    _mm_storeu_ps(lanes, min[j]);
+    sums->min[j] = ::std::min(::std::min(lanes[0], lanes[1]),
+                              ::std::min(lanes[2], lanes[3]));
+    _mm_storeu_ps(lanes, max[j]);
+    sums->max[j] = ::std::max(::std::max(lanes[0], lanes[1]),
+                              ::std::max(lanes[2], lanes[3]));
+  }
+  _mm_storeu_ps(lanes, shortest);
+  sums->shortestEdge2 = ::std::min(::std::min(lanes[0], lanes[1]),
+                                   ::std::min(lanes[2], lanes[3]));
+  _mm_storeu_ps(lanes, longest);
+  sums->longestEdge2 = ::std::max(::std::max(lanes[0], lanes[1]),
+                                  ::std::max(lanes[2], lanes[3]));
+  double sumLanes[4];
+  _mm_storeu_pd(sumLanes, surface[0]);
+  _mm_storeu_pd(sumLanes + 2, surface[1]);
+  sums->surface += (sumLanes[0] + sumLanes[1]) + (sumLanes[2] + sumLanes[3]);
+  _mm_storeu_pd(sumLanes, volume6[0]);
+  _mm_storeu_pd(sumLanes + 2, volume6[1]);
+  sums->volume6 += (sumLanes[0] + sumLanes[1]) + (sumLanes[2] + sumLanes[3]);
+  runScalar(facets + 4 * numBlocks, numFacets - 4 * numBlocks, origin, sums);
+}
+
+#endif  // STATS_KERNEL_SSE
+
+#ifdef STATS_KERNEL_AVX
+
+__attribute__((target("avx")))
+static void runAvx(const StlFile::Facet *facets, int64_t numFacets,
+                   const StlFile::Vertex& origin, StatsKernel::Sums *sums) {
+  __m256 min[3], max[3];
+  for (int j = 0; j < 3; j++) {
+    min[j] = _mm256_set1_ps(sums->min[j]);
+    max[j] = _mm256_set1_ps(sums->max[j]);
+  }
+  __m256 shortest = _mm256_set1_ps(sums->shortestEdge2);
+  __m256 longest = _mm256_set1_ps(sums->longestEdge2);
+  // Four doubles for the lower lanes, four for the upper ones
+  __m256d surface[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+  __m256d volume6[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+  __m256 half = _mm256_set1_ps(0.5f);
+  __m256 o[3] = {_mm256_set1_ps(origin.x), _mm256_set1_ps(origin.y),
+                 _mm256_set1_ps(origin.z)};
+  int64_t numBlocks = numFacets / 8;
+  for (int64_t i = 0; i < numBlocks; i++) {
+    // Two groups of four facets, transposed the same way as with SSE
+    __m128 low[12], high[12];
+    loadFacets(facets + 8 * i, low);
+    loadFacets(facets + 8 * i + 4, high);
+    __m256 r[12];
+    for (int k = 0; k < 12; k++)
+      r[k] = _mm256_insertf128_ps(_mm256_castps128_ps256(low[k]), high[k], 1);
+    __m256 *v[3] = {r + 3, r + 6, r + 9};
+    for (int j = 0; j < 3; j++) {
+      for (int k = 0; k < 3; k++) {
+        min[k] = _mm256_min_ps(min[k], v[j][k]);
+        max[k] = _mm256_max_ps(max[k], v[j][k]);
+      }
+    }
+    __m256 e[3][3];
+    for (int j = 0; j < 3; j++) {
+      for (int k = 0; k < 3; k++)
+        e[j][k] = _mm256_sub_ps(v[(j + 1) % 3][k], v[j][k]);
+      __m256 edge2 = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(e[j][0], e[j][0]),
+                        _mm256_mul_ps(e[j][1], e[j][1])),
+          _mm256_mul_ps(e[j][2], e[j][2]));
+      shortest = _mm256_min_ps(shortest, edge2);
+      longest = _mm256_max_ps(longest, edge2);
+    }
+    __m256 cx = _mm256_sub_ps(_mm256_mul_ps(e[2][1], e[0][2]),
+                              _mm256_mul_ps(e[2][2], e[0][1]));
+    __m256 cy = _mm256_sub_ps(_mm256_mul_ps(e[2][2], e[0][0]),
+                              _mm256_mul_ps(e[2][0], e[0][2]));
+    __m256 cz = _mm256_sub_ps(_mm256_mul_ps(e[2][0], e[0][1]),
+                              _mm256_mul_ps(e[2][1], e[0][0]));
+    __m256 c2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, cx),
+                                            _mm256_mul_ps(cy, cy)),
+                              _mm256_mul_ps(cz, cz));
+    __m256 area = _mm256_mul_ps(half, _mm256_sqrt_ps(c2));
+    surface[0] = _mm256_add_pd(
+        surface[0], _mm256_cvtps_pd(_mm256_castps256_ps128(area)));
+    surface[1] = _mm256_add_pd(
+        surface[1], _mm256_cvtps_pd(_mm256_extractf128_ps(area, 1)));
+    __m256 h = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(v[0][0], o[0]), cx),
+                      _mm256_mul_ps(_mm256_sub_ps(v[0][1], o[1]), cy)),
+        _mm256_mul_ps(_mm256_sub_ps(v[0][2], o[2]), cz));
+    volume6[0] = _mm256_add_pd(
+        volume6[0], _mm256_cvtps_pd(_mm256_castps256_ps128(h)));
+    volume6[1] = _mm256_add_pd(
+        volume6[1], _mm256_cvtps_pd(_mm256_extractf128_ps(h, 1)));
+  }
+  float lanes[8];
+  for (int j = 0; j < 3; j++) {
+    _mm256_storeu_ps(lanes, min[j]);
+    sums->min[j] = *::std::min_element(lanes, lanes + 8);
+    _mm256_storeu_ps(lanes, max[j]);
+    sums->max[j] = *::std::max_element(lanes, lanes + 8);
+  }
+  _mm256_storeu_ps(lanes, shortest);
+  sums->shortestEdge2 = *::std::min_element(lanes, lanes + 8);
+  _mm256_storeu_ps(lanes, longest);
+  sums->longestEdge2 = *::std::max_element(lanes, lanes + 8);
+  double sumLanes[8];
+  _mm256_storeu_pd(sumLanes, surface[0]);
+  _mm256_storeu_pd(sumLanes + 4, surface[1]);
+  sums->surface += ((sumLanes[0] + sumLanes[1]) + (sumLanes[2] + sumLanes[3])) +
+                   ((sumLanes[4] + sumLanes[5]) + (sumLanes[6] + sumLanes[7]));
+  _mm256_storeu_pd(sumLanes, volume6[0]);
+  _mm256_storeu_pd(sumLanes + 4, volume6[1]);
+  sums->volume6 += ((sumLanes[0] + sumLanes[1]) + (sumLanes[2] + sumLanes[3])) +
+                   ((sumLanes[4] + sumLanes[5]) + (sumLanes[6] + sumLanes[7]));
+  // Less than eight facets left, SSE is always there with AVX
+  runSse(facets + 8 * numBlocks, numFacets - 8 * numBlocks, origin, sums);
+}
+
+static bool hasAvx() {
+  static const bool avx = __builtin_cpu_supports("avx");
+  return avx;
+}
+
+#endif  // STATS_KERNEL_AVX
+
+void StatsKernel::run(const StlFile::Facet *facets, int64_t numFacets,
+                      const StlFile::Vertex& origin, Sums *sums) {
+#if defined(STATS_KERNEL_AVX)
+  if (hasAvx())
+    runAvx(facets, numFacets, origin, sums);
+  else
+    runSse(facets, numFacets, origin, sums);
+#elif defined(STATS_KERNEL_SSE)
+  runSse(facets, numFacets, origin, sums);
+#else
+  runScalar(facets, numFacets, origin, sums);
+#endif
+}
+
+void StatsKernel::merge(const Sums *partials, int64_t numPartials,
+                        Sums *total) {
+  if (numPartials <= 0) {
+    clear(total);
+    return;
+  }
+  if (numPartials == 1) {
+    *total = partials[0];
+    return;
+  }
+  Sums low, high;
+  int64_t half = numPartials / 2;
+  merge(partials, half, &low);
+  merge(partials + half, numPartials - half, &high);
+  for (int i = 0; i < 3; i++) {
+    total->min[i] = ::std::min(low.min[i], high.min[i]);
+    total->max[i] = ::std::max(low.max[i], high.max[i]);
+  }
+  total->shortestEdge2 = ::std::min(low.shortestEdge2, high.shortestEdge2);
+  total->longestEdge2 = ::std::max(low.longestEdge2, high.longestEdge2);
+  total->surface = low.surface + high.surface;
+  total->volume6 = low.volume6 + high.volume6;
+}
+
+void StatsKernel::computeNormals(StlFile::Facet *facets, int64_t numFacets) {
+#ifdef STATS_KERNEL_SSE
+  computeNormalsSse(facets, numFacets);
+#else
+  computeNormalsScalar(facets, numFacets);
+#endif
+}
+
+const char* StatsKernel::getInstructionSet() {
+#if defined(STATS_KERNEL_AVX)
+  if (hasAvx())
+    return "avx";
+  return "sse";
+#elif defined(STATS_KERNEL_SSE)
+  return "sse";
+#else
+  return "scalar";
+#endif
+}
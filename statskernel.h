@@ -0,0 +1,64 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef STATSKERNEL_H
+#define STATSKERNEL_H
+
+#include <stdint.h>
+
+#include "stlfile.h"
+
+// StatsKernel Class - Computes the stats of the facets in a single pass
+// The bounding box, the surface, the signed volume and the shortest and
+// longest edges are all gathered while each facet is loaded once. Four or
+// eight facets are processed at a time with SSE or AVX when the processor
+// has them, the choice being made when the program runs. The areas and the
+// volumes are computed in single precision, but added up in double.
+class StatsKernel {
+ public:
+  // Partial results of a range of facets. The edges are kept squared and
+  // the volume six times over, they are only fixed up once by the caller.
+  typedef struct {
+    float min[3];
+    float max[3];
+    float shortestEdge2;
+    float longestEdge2;
+    double surface;
+    double volume6;
+  } Sums;
+  // Sets the sums of an empty range
+  static void clear(Sums *sums);
+  // Adds the facets to the sums. The volume is measured from origin, which
+  // must stay the same for all the facets of a mesh.
+  static void run(const StlFile::Facet *facets, int64_t numFacets,
+                  const StlFile::Vertex& origin, Sums *sums);
+  // Merges partial sums. The surfaces and the volumes are added up along a
+  // pairwise tree whose shape only depends on numPartials, so the result
+  // is the same whatever the order the partials were computed in.
+  static void merge(const Sums *partials, int64_t numPartials, Sums *total);
+  // Sets the normals of the facets to the unit normals of their vertices,
+  // turning counterclockwise. Degenerate facets get a zero normal.
+  static void computeNormals(StlFile::Facet *facets, int64_t numFacets);
+  // Returns the name of the instruction set used by run()
+  static const char* getInstructionSet();
+};
+
+#endif  // STATSKERNEL_H
@@ -0,0 +1,61 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef STATSWORKER_H
+#define STATSWORKER_H
+
+#include <QtCore/QThread>
+
+#include "stlfile.h"
+
+// Computes the stats that take a while, the number of points, the defects
+// of the mesh, the lengths of the edges and the shells, in a worker thread
+// once a file is loaded, so that the model is shown without waiting for
+// them. The file is then stored into the cache with them. The file must not
+// be changed or closed before the thread is finished.
+class StatsWorker : public QThread {
+
+  Q_OBJECT
+
+ public:
+  StatsWorker(StlFile *stlFile, QObject *parent = 0);
+  ~StatsWorker();
+  // Returns the reason why the stats couldn't be computed, empty on success
+  QString errorMessage() const { return error; };
+
+ signals:
+  void pointsCounted(qlonglong numPoints);
+  // StlFile::getValidation() can be called from now on
+  void validated();
+  // StlFile::getEdgeAnalysis() can be called from now on
+  void edgesAnalysed();
+  // StlFile::getShells() can be called from now on
+  void shellsFound();
+
+ protected:
+  void run();
+
+ private:
+  StlFile *stlFile;
+  QString error;
+};
+
+#endif  // STATSWORKER_H
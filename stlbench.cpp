@@ -0,0 +1,263 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+// stlbench - Times the loading of a large synthetic STL file
+// A binary file of 100M facets by default, over 4 GB, is generated then
+// loaded, so that the sizes and the counts past 32 bits are exercised. The
+// file is a bumpy grid whose cells are each cut into two facets, so that
+// the vertices are shared as in a scanned mesh. The mesh is then welded and
+// analysed, and each step is timed.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "edgeanalysis.h"
+#include "indexedmesh.h"
+#include "meshshells.h"
+#include "meshvalidation.h"
+#include "parallel.h"
+#include "stlfile.h"
+
+// Facets generated at a time
+#define BENCH_BLOCK_SIZE 65536
+#define BENCH_RECORD_SIZE 50
+#define BENCH_HEADER_SIZE 80
+
+typedef struct {
+  ::std::string fileName;
+  int64_t numFacets;
+  bool loadOnly;
+  bool keep;
+  int threads;
+} Options;
+
+static void printUsage() {
+  fprintf(stderr,
+      "Usage: stlbench [OPTION]... [FILE]\n"
+      "Generates a synthetic binary STL file into FILE, stlbench.stl by\n"
+      "default, then times its loading and the analysis of its mesh.\n"
+      "\n"
+      "  -n, --facets COUNT      Generate COUNT facets, 100000000 by\n"
+      "                          default\n"
+      "  -l, --load-only         Only time the loading, the mesh of 100M\n"
+      "                          facets taking several GB\n"
+      "  -k, --keep              Keep the file once done, and load it\n"
+      "                          again instead of generating it if it\n"
+      "                          exists\n"
+      "  -j, --threads N         Use N threads, all the cores by default\n"
+      "  -h, --help              Show this help\n");
+}
+
+static double getSeconds(::std::chrono::steady_clock::time_point start) {
+  return ::std::chrono::duration<double>(
+      ::std::chrono::steady_clock::now() - start).count();
+}
+
+static void writeBytesFromUint32(char *bytes, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    bytes[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+// Little-endian whatever the platform, as in a binary STL file
+static void writeBytesFromFloat(char *bytes, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  writeBytesFromUint32(bytes, bits);
+}
+
+static void getGridPoint(int64_t column, int64_t row, float point[3]) {
+  point[0] = static_cast<float>(column);
+  point[1] = static_cast<float>(row);
+  point[2] = static_cast<float>(0.25 * sin(0.1 * column) * cos(0.1 * row));
+}
+
+// Writes the facets first to first + numFacets - 1 of the grid. Facet 2i
+// and 2i + 1 split cell i, the cells going row by row.
+static void writeGridFacets(int64_t first, int64_t numFacets,
+                            int64_t numColumns, char *records) {
+  for (int64_t i = 0; i < numFacets; i++) {
+    int64_t facet = first + i;
+    int64_t cell = facet / 2;
+    int64_t column = cell % numColumns;
+    int64_t row = cell / numColumns;
+    float corners[3][3];
+    if (facet % 2 == 0) {
+      getGridPoint(column, row, corners[0]);
+      getGridPoint(column + 1, row, corners[1]);
+      getGridPoint(column + 1, row + 1, corners[2]);
+    } else {
+      getGridPoint(column, row, corners[0]);
+      getGridPoint(column + 1, row + 1, corners[1]);
+      getGridPoint(column, row + 1, corners[2]);
+    }
+    char *record = records + i * BENCH_RECORD_SIZE;
+    memset(record, 0, BENCH_RECORD_SIZE);
+    // The normals are left to 0, the loader doesn't need them
+    for (int j = 0; j < 3; j++) {
+      for (int k = 0; k < 3; k++)
+        writeBytesFromFloat(record + 12 + 12 * j + 4 * k, corners[j][k]);
+    }
+  }
+}
+
+static bool generateFile(const Options& options) {
+  FILE *file = fopen(options.fileName.c_str(), "wb");
+  if (file == 0)
+    return false;
+  char header[BENCH_HEADER_SIZE + 4];
+  memset(header, ' ', BENCH_HEADER_SIZE);
+  memcpy(header, "stlbench", 8);
+  // The count of the header is only 32 bits, the loader trusts the size
+  // of the file past it
+  writeBytesFromUint32(header + BENCH_HEADER_SIZE, static_cast<uint32_t>(
+      ::std::min<int64_t>(options.numFacets, 0xFFFFFFFF)));
+  bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+  int64_t numColumns = static_cast<int64_t>(
+      ceil(sqrt((options.numFacets + 1) / 2.0)));
+  ::std::vector<char> records(BENCH_BLOCK_SIZE * BENCH_RECORD_SIZE);
+  for (int64_t first = 0; first < options.numFacets && written;
+       first += BENCH_BLOCK_SIZE) {
+    int64_t numFacets = ::std::min<int64_t>(BENCH_BLOCK_SIZE,
+                                            options.numFacets - first);
+    writeGridFacets(first, numFacets, numColumns, &records[0]);
+    size_t size = static_cast<size_t>(numFacets * BENCH_RECORD_SIZE);
+    written = fwrite(&records[0], 1, size, file) == size;
+  }
+  written = fclose(file) == 0 && written;
+  if (!written)
+    remove(options.fileName.c_str());
+  return written;
+}
+
+static bool parseOptions(int argc, char *argv[], Options *options) {
+  options->fileName = "stlbench.stl";
+  options->numFacets = 100000000;
+  options->loadOnly = false;
+  options->keep = false;
+  options->threads = 0;
+  bool hasFileName = false;
+  for (int i = 1; i < argc; i++) {
+    ::std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    ::std::string value = hasValue ? argv[i + 1] : "";
+    if ((arg == "-n" || arg == "--facets") && hasValue) {
+      options->numFacets = atoll(value.c_str());
+      if (options->numFacets <= 0)
+        return false;
+      i++;
+    } else if (arg == "-l" || arg == "--load-only") {
+      options->loadOnly = true;
+    } else if (arg == "-k" || arg == "--keep") {
+      options->keep = true;
+    } else if ((arg == "-j" || arg == "--threads") && hasValue) {
+      options->threads = atoi(value.c_str());
+      if (options->threads <= 0)
+        return false;
+      i++;
+    } else if (arg.empty() || arg[0] == '-' || hasFileName) {
+      return false;
+    } else {
+      options->fileName = arg;
+      hasFileName = true;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, &options)) {
+    printUsage();
+    return 2;
+  }
+  if (options.threads > 0)
+    Parallel::setNumThreads(options.threads);
+  ::std::chrono::steady_clock::time_point start;
+  FILE *existing = options.keep ? fopen(options.fileName.c_str(), "rb") : 0;
+  if (existing != 0) {
+    fclose(existing);
+    printf("reusing %s\n", options.fileName.c_str());
+  } else {
+    start = ::std::chrono::steady_clock::now();
+    if (!generateFile(options)) {
+      fprintf(stderr, "stlbench: %s could not be written.\n",
+              options.fileName.c_str());
+      return 1;
+    }
+    printf("generate  %12lld facets  %9.3f s\n",
+           static_cast<long long>(options.numFacets), getSeconds(start));
+  }
+  int status = 0;
+  try {
+    StlFile stlFile;
+    start = ::std::chrono::steady_clock::now();
+    stlFile.open(options.fileName);
+    double seconds = getSeconds(start);
+    StlFile::Stats stats = stlFile.getStats();
+    double megabytes = (BENCH_HEADER_SIZE + 4 +
+        stats.numFacets * static_cast<double>(BENCH_RECORD_SIZE)) /
+        (1024.0 * 1024.0);
+    printf("open      %12lld facets  %9.3f s  %9.1f MB/s\n",
+           static_cast<long long>(stats.numFacets), seconds,
+           seconds > 0 ? megabytes / seconds : 0.0);
+    if (!options.keep && stats.numFacets != options.numFacets) {
+      fprintf(stderr, "stlbench: %lld facets were loaded instead of %lld.\n",
+              static_cast<long long>(stats.numFacets),
+              static_cast<long long>(options.numFacets));
+      status = 1;
+    }
+    if (!options.loadOnly && status == 0) {
+      start = ::std::chrono::steady_clock::now();
+      const IndexedMesh *mesh = stlFile.getMesh();
+      printf("weld      %12lld points  %9.3f s\n",
+             static_cast<long long>(mesh->getNumVertices()),
+             getSeconds(start));
+      start = ::std::chrono::steady_clock::now();
+      const MeshValidation *validation = stlFile.getValidation();
+      printf("validate  %12lld edges   %9.3f s\n",
+             static_cast<long long>(validation->getNumEdges()),
+             getSeconds(start));
+      start = ::std::chrono::steady_clock::now();
+      const EdgeAnalysis *edgeAnalysis = stlFile.getEdgeAnalysis();
+      printf("edges     %12lld edges   %9.3f s\n",
+             static_cast<long long>(edgeAnalysis->getNumEdges()),
+             getSeconds(start));
+      start = ::std::chrono::steady_clock::now();
+      const MeshShells *shells = stlFile.getShells();
+      printf("shells    %12lld shells  %9.3f s\n",
+             static_cast<long long>(shells->getNumShells()),
+             getSeconds(start));
+    }
+  } catch (const ::std::exception& e) {
+    fprintf(stderr, "stlbench: %s: %s\n", options.fileName.c_str(),
+            e.what());
+    status = 1;
+  }
+  if (!options.keep)
+    remove(options.fileName.c_str());
+  return status;
+}
@@ -18,48 +18,518 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 
-#include <QtCore/QtGlobal>
-#include <QtGui/QApplication>
-#include <QErrorMessage>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <errno.h>
 #include <math.h>
+#include <stdio.h>
 #include <string>
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <charconv>
+#include <cstring>
+#include <iterator>
+#include <mutex>
 #include <vector>
 
+#include "compressedfile.h"
+#include "edgeanalysis.h"
+#include "indexedmesh.h"
+#include "meshcache.h"
+#include "meshdecimator.h"
+#include "meshrepair.h"
+#include "meshshells.h"
+#include "meshvalidation.h"
+#include "parallel.h"
+#include "statskernel.h"
 #include "stlfile.h"
 
 #define HEADER_SIZE 84
 #define JUNK_SIZE 80
 #define SIZE_OF_FACET 50
-#define ASCII_LINES_PER_FACET 7
+// Approximate size of the chunks an ASCII file is split into for parsing
+#define ASCII_CHUNK_SIZE (1 << 20)
+// Number of binary facets read between two progress reports
+#define PROGRESS_INTERVAL 65536
+// Number of bytes looked at on each end of a file to guess its format
+#define FORMAT_PROBE_SIZE 4096
+// Number of facets converted at a time when a binary file is written
+#define WRITE_BLOCK_SIZE 65536
+// Number of facets formatted by a thread at a time when an ASCII file is
+// written
+#define ASCII_WRITE_CHUNK_SIZE 16384
+// Upper bound of the length of a facet written in ASCII
+#define ASCII_FACET_MAX_SIZE 320
+// Number of facets summed up by a thread at a time when the stats are
+// computed. It must not depend on the number of threads.
+#define STATS_CHUNK_SIZE 8192
+// Bound of the number of bytes a compressed byte expands into, deflate
+// can't do better and zstd rarely does. It caps the facets allocated from
+// the count in the header of a compressed binary file.
+#define MAX_COMPRESSION_RATIO 1032
+
+// STL binary files are little-endian, so the bytes have to be swapped when
+// they are read on a big-endian host
+static bool isLittleEndian() {
+  const int one = 1;
+  return *reinterpret_cast<const char*>(&one) == 1;
+}
+
+static void swapBytes(char *bytes, int size) {
+  for (int i = 0; i < size / 2; i++)
+    ::std::swap(bytes[i], bytes[size - 1 - i]);
+}
+
+// Moves a file over another one, which is replaced in a single step
+static bool replaceFile(const ::std::string& from, const ::std::string& to) {
+#ifdef _WIN32
+  return MoveFileExA(from.c_str(), to.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Creates an empty file next to fileName, under a name no other file has,
+// and returns its name. Returns an empty name if it can't be created.
+static ::std::string makeTempFile(const ::std::string& fileName) {
+  static ::std::atomic<unsigned> counter(0);
+  for (int attempt = 0; attempt < 100; attempt++) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%u.tmp", counter++);
+    ::std::string tempFileName = fileName + suffix;
+    // Fails if the file exists, whoever created it
+    FILE *file = fopen(tempFileName.c_str(), "wbx");
+    if (file != 0) {
+      fclose(file);
+      return tempFileName;
+    }
+    if (errno != EEXIST)
+      break;
+  }
+  return "";
+}
+
+static bool isSpace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' ||
+         c == '\v';
+}
+
+// Finds the next whitespace separated token in [p, end)
+static const char* nextToken(const char *p, const char *end,
+                             const char **tokenEnd) {
+  while (p < end && isSpace(*p))
+    p++;
+  const char *q = p;
+  while (q < end && !isSpace(*q))
+    q++;
+  *tokenEnd = q;
+  return p;
+}
+
+// Compares length characters at p with a lowercase keyword, whatever their
+// case. Setting the bit 0x20 only turns the letters into lowercase ones.
+static bool matchesKeyword(const char *p, const char *keyword,
+                           size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if ((p[i] | 0x20) != keyword[i])
+      return false;
+  }
+  return true;
+}
+
+static bool isToken(const char *token, const char *tokenEnd,
+                    const char *keyword) {
+  size_t length = strlen(keyword);
+  return static_cast<size_t>(tokenEnd - token) == length &&
+         matchesKeyword(token, keyword, length);
+}
+
+// Returns the beginning of the first "facet normal" in [p, end), or end if
+// there is none
+static const char* findAsciiFacet(const char *p, const char *end) {
+  for (const char *q = p; end - q > 5; q++) {
+    if ((*q | 0x20) == 'f' && (q == p || isSpace(q[-1])) && isSpace(q[5]) &&
+        matchesKeyword(q, "facet", 5)) {
+      const char *tokenEnd;
+      const char *token = nextToken(q + 5, end, &tokenEnd);
+      if (isToken(token, tokenEnd, "normal"))
+        return q;
+    }
+  }
+  return end;
+}
+
+// Returns the first line of an ASCII file
+static ::std::string readAsciiHeader(const char *begin, const char *end) {
+  const char *endOfLine = ::std::find(begin, end, '\n');
+  if (endOfLine > begin && endOfLine[-1] == '\r')
+    endOfLine--;
+  return ::std::string(begin, endOfLine);
+}
+
+// Returns the 80 byte header of a binary file, which is not necessarily
+// null-terminated
+static ::std::string readBinaryHeader(const char *begin) {
+  return ::std::string(begin, ::std::find(begin, begin + JUNK_SIZE, '\0'));
+}
+
+// Returns true if [p, end) contains bytes that are not printable ASCII
+// characters or whitespace, as the floats of a binary file usually do
+static bool containsBinaryBytes(const char *p, const char *end) {
+  for (; p < end; p++) {
+    unsigned char c = static_cast<unsigned char>(*p);
+    if (c > 127 || (c < 32 && !isSpace(*p)))
+      return true;
+  }
+  return false;
+}
+
+// Returns the beginning of the line that contains p
+static const char* findLineStart(const char *begin, const char *p) {
+  while (p > begin && p[-1] != '\n')
+    p--;
+  return p;
+}
+
+// Returns the end of the last "endfacet" in [begin, end), or begin if there
+// is none
+static const char* findAsciiFacetsEnd(const char *begin, const char *end) {
+  for (const char *p = end - 8; p >= begin; p--) {
+    if (p + 8 < end && isSpace(p[8]) && (p == begin || isSpace(p[-1])) &&
+        matchesKeyword(p, "endfacet", 8))
+      return p + 8;
+  }
+  return begin;
+}
+
+// Counts the "endfacet" in [begin, end), whatever their case. The facets
+// parsed from the same range are never more, as each ends with one. The
+// last letter of each 8 bytes tells how far the next one can start, as in
+// Horspool's search, so most of the numbers are skipped 8 bytes at a time.
+static int64_t countAsciiFacets(const char *begin, const char *end) {
+  int64_t count = 0;
+  const char *p = begin;
+  while (end - p >= 8) {
+    switch (p[7] | 0x20) {
+      case 't':
+        if ((p + 8 == end || isSpace(p[8])) &&
+            (p == begin || isSpace(p[-1])) && matchesKeyword(p, "endfacet", 8))
+          count++;
+        p += 8;
+        break;
+      case 'e': p += 1; break;
+      case 'c': p += 2; break;
+      case 'a': p += 3; break;
+      case 'f': p += 4; break;
+      case 'd': p += 5; break;
+      case 'n': p += 6; break;
+      default: p += 8; break;
+    }
+  }
+  return count;
+}
+
+// Reads count floats from [p, end). The numbers are parsed without going
+// through the C locale, which might not use a dot as decimal separator.
+static const char* parseAsciiFloats(const char *p, const char *end,
+                                    float values[], int count) {
+  for (int i = 0; i < count; i++) {
+    const char *tokenEnd;
+    p = nextToken(p, end, &tokenEnd);
+    // from_chars doesn't accept an explicit positive sign
+    if (p < tokenEnd && *p == '+')
+      p++;
+    ::std::from_chars_result result = ::std::from_chars(p, tokenEnd,
+                                                        values[i]);
+    if (result.ec != ::std::errc() || result.ptr != tokenEnd)
+      throw StlFile::wrong_file_format("Invalid number in an ASCII facet.");
+    p = tokenEnd;
+  }
+  return p;
+}
+
+// Parses all the facets of an ASCII .STL file found in [p, end) into out,
+// and returns out past the last facet.
+// The keywords are matched one token at a time, whatever their case, so the
+// layout of the lines doesn't matter. Any other token, or a facet left open
+// at the end, is an error.
+template <typename Output>
+static Output parseAsciiFacets(const char *p, const char *end, Output out) {
+  StlFile::Facet facet;
+  facet.extra[0] = facet.extra[1] = 0;
+  enum {OUTSIDE, IN_FACET, IN_LOOP, LOOP_CLOSED} state = OUTSIDE;
+  int numVertices = 0;
+  const char *tokenEnd;
+  for (p = nextToken(p, end, &tokenEnd); p < end;
+       p = nextToken(p, end, &tokenEnd)) {
+    if (isToken(p, tokenEnd, "vertex")) {
+      if (state != IN_LOOP || numVertices >= 3)
+        throw StlFile::wrong_file_format("Unexpected vertex in an ASCII "
+                                         "file.");
+      float v[3];
+      p = parseAsciiFloats(tokenEnd, end, v, 3);
+      facet.vector[numVertices].x = v[0];
+      facet.vector[numVertices].y = v[1];
+      facet.vector[numVertices].z = v[2];
+      numVertices++;
+    } else if (isToken(p, tokenEnd, "facet")) {
+      if (state != OUTSIDE)
+        throw StlFile::wrong_file_format("An ASCII facet isn't closed.");
+      p = nextToken(tokenEnd, end, &tokenEnd);
+      if (!isToken(p, tokenEnd, "normal"))
+        throw StlFile::wrong_file_format("Missing normal in an ASCII facet.");
+      float n[3];
+      p = parseAsciiFloats(tokenEnd, end, n, 3);
+      facet.normal.x = n[0];
+      facet.normal.y = n[1];
+      facet.normal.z = n[2];
+      state = IN_FACET;
+    } else if (isToken(p, tokenEnd, "outer")) {
+      p = nextToken(tokenEnd, end, &tokenEnd);
+      if (state != IN_FACET || !isToken(p, tokenEnd, "loop"))
+        throw StlFile::wrong_file_format("Unexpected loop in an ASCII "
+                                         "file.");
+      p = tokenEnd;
+      numVertices = 0;
+      state = IN_LOOP;
+    } else if (isToken(p, tokenEnd, "endloop")) {
+      if (state != IN_LOOP || numVertices != 3)
+        throw StlFile::wrong_file_format("An ASCII facet doesn't have 3 "
+                                         "vertices.");
+      p = tokenEnd;
+      state = LOOP_CLOSED;
+    } else if (isToken(p, tokenEnd, "endfacet")) {
+      if (state != LOOP_CLOSED)
+        throw StlFile::wrong_file_format("An ASCII facet has no loop.");
+      *out++ = facet;
+      p = tokenEnd;
+      state = OUTSIDE;
+    } else if (state == OUTSIDE && (isToken(p, tokenEnd, "solid") ||
+                                    isToken(p, tokenEnd, "endsolid"))) {
+      // Skip the name of the solid
+      p = ::std::find(tokenEnd, end, '\n');
+    } else {
+      throw StlFile::wrong_file_format(
+          "Unexpected \"" + ::std::string(p, tokenEnd).substr(0, 32) +
+          "\" in an ASCII file.");
+    }
+  }
+  if (state != OUTSIDE)
+    throw StlFile::wrong_file_format("The last ASCII facet is incomplete.");
+  return out;
+}
+
+// Writes " x y z\n" with the shortest representation of each float that
+// reads back to the same value
+static char* formatAsciiFloats(char *p, char *end, float x, float y,
+                               float z) {
+  *p++ = ' ';
+  p = ::std::to_chars(p, end, x).ptr;
+  *p++ = ' ';
+  p = ::std::to_chars(p, end, y).ptr;
+  *p++ = ' ';
+  p = ::std::to_chars(p, end, z).ptr;
+  *p++ = '\n';
+  return p;
+}
+
+static char* appendString(char *p, const char *string) {
+  size_t length = strlen(string);
+  memcpy(p, string, length);
+  return p + length;
+}
+
+static void formatAsciiFacets(const StlFile::Facet *facets,
+                              int64_t numFacets, ::std::vector<char>& buffer) {
+  buffer.resize(numFacets * ASCII_FACET_MAX_SIZE);
+  char *p = &buffer[0];
+  char *end = p + buffer.size();
+  for (int64_t i = 0; i < numFacets; i++) {
+    const StlFile::Facet& facet = facets[i];
+    p = appendString(p, "  facet normal");
+    p = formatAsciiFloats(p, end, facet.normal.x, facet.normal.y,
+                          facet.normal.z);
+    p = appendString(p, "    outer loop\n");
+    for (int j = 0; j < 3; j++) {
+      p = appendString(p, "      vertex");
+      p = formatAsciiFloats(p, end, facet.vector[j].x, facet.vector[j].y,
+                            facet.vector[j].z);
+    }
+    p = appendString(p, "    endloop\n  endfacet\n");
+  }
+  buffer.resize(p - &buffer[0]);
+}
+
+// Accumulates the bounding box, the edges, the surface and the volume of
+// the facets it visits, so that they can be computed on a streamed file as
+// well. The facets are cut into chunks counted from the first facet,
+// whatever the blocks they are visited in, and the chunks are summed up on
+// all cores then merged along a fixed tree. So the stats are the same bit
+// for bit whatever the number of threads and the size of the blocks.
+class StlFile::StatsVisitor : public StlFile::FacetVisitor {
+ public:
+  StatsVisitor(Stats *stats);
+  void visit(const Facet *block, int64_t numFacets);
+  // Completes the stats once all the facets have been visited
+  void finish();
+
+ private:
+  void addChunks(const Facet *facets, int64_t numFacets);
+  Stats *stats;
+  bool first;
+  Vertex p0;
+  ::std::vector<StatsKernel::Sums> chunks;
+  // The facets of the last chunk, until it is complete
+  ::std::vector<Facet> pending;
+};
+
+// The key and the stats of a file read while a cache was set, kept until
+// the file is stored into the cache. The stats are those of the file as it
+// was read, the format may be changed meanwhile to save it.
+class StlFile::PendingEntry {
+ public:
+  PendingEntry(const MeshCache::Key& key, const Stats& stats)
+      : key(key), stats(stats) {}
+  MeshCache::Key key;
+  Stats stats;
+};
 
 StlFile::StlFile() {
+  pendingEntry = 0;
+  repaired = false;
   facets = 0;
+  mesh = 0;
+  edgeAnalysis = 0;
+  validation = 0;
+  shells = 0;
+  observer = 0;
+  cache = 0;
+  compression = CompressedFile::NONE;
+  weldTolerance = 0.0;
 }
 
 StlFile::~StlFile() {
   close();
 }
 
-void StlFile::open(const ::std::string& fileName) {
-  initialize(fileName);
-  allocate();
-  readData(0, 1);
-  file.close();
+void StlFile::open(const ::std::string& fileName,
+                   ProgressObserver *observer) {
+  this->observer = observer;
+  try {
+    // The key is taken before the file is read, so that an entry is never
+    // stored for a newer version of the file than the one read
+    MeshCache::Key cacheKey;
+    bool cacheable = cache != 0 && MeshCache::getKey(fileName, &cacheKey);
+    if (cacheable) {
+      close();
+      const Facet *cachedFacets = cache->lookup(cacheKey, &cacheEntry,
+                                                &stats);
+      if (cachedFacets != 0) {
+        // The entry is mapped copy-on-write, the facets can be changed
+        facets = const_cast<Facet*>(cachedFacets);
+        warnings.clear();
+        formatDetection.format = static_cast<Format>(stats.type);
+        formatDetection.confidence = 1.0;
+        formatDetection.reason = "the file was read from the cache";
+        restoreFromCache();
+        reportProgress(cacheKey.fileSize, stats.numFacets);
+        this->observer = 0;
+        return;
+      }
+    }
+    initialize(fileName);
+    if (compression != CompressedFile::NONE)
+      readCompressedData(fileName);
+    else
+      readData();
+    // Stored once the mesh is analysed, so that the loading isn't slowed
+    // down by writing the entry
+    if (cacheable)
+      pendingEntry = new PendingEntry(cacheKey, stats);
+  } catch (...) {
+    // Free whatever was read so far
+    close();
+    mappedFile.close();
+    this->observer = 0;
+    throw;
+  }
+  mappedFile.close();
+  this->observer = 0;
 }
 
 void StlFile::write(const ::std::string& fileName) {
   if (facets != 0) {
-    if (stats.type == ASCII)
-      writeAscii(fileName);
-    else
-      writeBinary(fileName);
+    // Never leave a half written file behind, or break the one being
+    // replaced, if the writing fails. Each writer has its own temporary
+    // file, the files written at the same time don't overwrite each other.
+    ::std::string tempFileName = makeTempFile(fileName);
+    CompressedFile output;
+    if (tempFileName.empty() || !output.openForWriting(
+        tempFileName, CompressedFile::compressionFromFileName(fileName))) {
+      if (!tempFileName.empty())
+        remove(tempFileName.c_str());
+      throw error_opening_file("The file " + fileName + " could not be found.");
+    }
+    try {
+      if (stats.type == ASCII)
+        writeAscii(output);
+      else
+        writeBinary(output);
+      if (!output.close())
+        throw error_writing_file();
+    } catch (const error_writing_file&) {
+      output.close();
+      remove(tempFileName.c_str());
+      throw error_writing_file("The file " + fileName +
+                               " could not be written.");
+    } catch (...) {
+      output.close();
+      remove(tempFileName.c_str());
+      throw;
+    }
+    if (!replaceFile(tempFileName, fileName)) {
+      remove(tempFileName.c_str());
+      throw error_writing_file("The file " + fileName +
+                               " could not be replaced.");
+    }
   }
 }
 
+void StlFile::setFacets(const Facet *facets, int64_t numFacets) {
+  close();
+  warnings.clear();
+  stats.header = "";
+  stats.type = BINARY;
+  stats.numFacets = numFacets;
+  allocate();
+  memcpy(this->facets, facets, numFacets * sizeof(Facet));
+  StatsVisitor statsVisitor(&stats);
+  statsVisitor.visit(this->facets, numFacets);
+  statsVisitor.finish();
+  stats.numPoints = -1;
+}
+
 void StlFile::close() {
-  if (facets != 0) {
+  delete pendingEntry;
+  pendingEntry = 0;
+  repaired = false;
+  delete mesh;
+  mesh = 0;
+  delete edgeAnalysis;
+  edgeAnalysis = 0;
+  delete validation;
+  validation = 0;
+  delete shells;
+  shells = 0;
+  clearLevels();
+  if (cacheEntry.isOpen()) {
+    // The facets belong to the cache entry
+    cacheEntry.close();
+    facets = 0;
+  } else if (facets != 0) {
 	  delete[] facets;
     facets = 0;
   }
@@ -73,422 +543,875 @@ void StlFile::setFormat(const int format) {
 }
 
 void StlFile::initialize(const ::std::string& fileName) {
+  close();
+  warnings.clear();
   stats.numFacets = 0;
   stats.numPoints = 0;
   stats.surface = -1.0;
   stats.volume = -1.0;
-  facets = 0;
-  // Open the file
-  file.open(fileName.c_str(), ::std::ios::binary);
-  if (file.is_open()) {
-    int numFacets;
-    // Find length of file
-    file.seekg(0, ::std::ios::end);
-    int fileSize = file.tellg();
+  // Map the file, both formats are read in place from the mapping
+  if (mappedFile.open(fileName)) {
+    int64_t numFacets = 0;
+    const char *data = mappedFile.getData();
+    int64_t fileSize = mappedFile.getSize();
+    // A compressed file is decompressed while it is parsed, its format is
+    // only known once it starts being decompressed
+    compression = CompressedFile::detectCompression(data, fileSize);
+    if (compression != CompressedFile::NONE) {
+      if (!CompressedFile::isSupported(compression)) {
+        throw wrong_file_format("The compression of " + fileName +
+                                " is not supported.");
+      }
+      return;
+    }
     // Check for binary or ASCII file
-    file.seekg(0, ::std::ios::beg);
-    stats.type = BINARY;
-    int c;
-    while((c = file.get()) != EOF && c <= 127) 
-        ;
-    if(c == EOF) {
-      stats.type = ASCII;
+    formatDetection = detectFormat(data, mappedFile.getSize());
+    stats.type = formatDetection.format;
+    if (formatDetection.confidence < 0.9) {
+      addWarning(UNCERTAIN_FORMAT, "The file " + fileName +
+                 " is assumed to be " +
+                 (stats.type == BINARY ? "binary" : "ASCII") + ": " +
+                 formatDetection.reason + ".");
     }
-    file.seekg(0, ::std::ios::beg);
     // Get the header and the number of facets in the .STL file 
     // If the .STL file is binary, then do the following 
     if (stats.type == BINARY) {
       // Test if the STL file has the right size
-      if ((fileSize - HEADER_SIZE) % SIZE_OF_FACET != 0) {
-        ::std::cerr << "The file " << file << " has a wrong size."
-                    << ::std::endl;
-        throw wrong_header_size();
+      if (fileSize < HEADER_SIZE ||
+          (fileSize - HEADER_SIZE) % SIZE_OF_FACET != 0) {
+        throw wrong_header_size("The file " + fileName + " has a wrong size.");
       }
       numFacets = (fileSize - HEADER_SIZE) / SIZE_OF_FACET;
       // Read the header
-      char buffer[JUNK_SIZE];
-      file.read(buffer, JUNK_SIZE);
-      stats.header = buffer;
+      stats.header = readBinaryHeader(data);
       // Read the int following the header.
       // This should contain the number of facets
-      int headerNumFacets = readIntFromBytes(file);
+      // This count is unsigned, files of more than 2^31 facets are valid
+      int64_t headerNumFacets =
+          static_cast<uint32_t>(readIntFromBytes(data + JUNK_SIZE));
       if (numFacets != headerNumFacets) {
-        ::std::cerr << "Warning: File size doesn't match number of "
-                    << "facets in the header." << ::std::endl;
-        QErrorMessage errMessage;
-        errMessage.showMessage("File size doesn't match number of facets "
-                               "in the header.");
-        QApplication::restoreOverrideCursor();
-        errMessage.exec();
-        QApplication::setOverrideCursor(Qt::WaitCursor);
+        addWarning(FACET_COUNT_MISMATCH, "File size doesn't match number "
+                   "of facets in the header.");
       }
     }
     else {  // Otherwise, if the .STL file is ASCII, then do the following
-      file.seekg(0, ::std::ios::beg);
-      // Get the header
-      getline(file, stats.header);
-      // Find the number of facets
-      int numLines = 0;
-      ::std::string line;
-      while (!getline(file, line).eof()) {
-        if (line.size() > 4) {  // don't count short lines
-          numLines++;
-        }
-      }
-      file.seekg(0, ::std::ios::beg);
-      numFacets = numLines / ASCII_LINES_PER_FACET;
+      // Get the header, the facets are counted while they are parsed
+      stats.header = readAsciiHeader(data, data + fileSize);
     }
     stats.numFacets += numFacets;
   } else {
-    ::std::cerr << "The file " << file << " could not be found." << ::std::endl;
-    throw error_opening_file();
+    throw error_opening_file("The file " + fileName + " could not be found.");
   }
 }
 
+StlFile::FormatDetection StlFile::detectFormat(const char *data,
+                                               size_t size) {
+  // Only look at the beginning and the end of the file, whatever its size
+  size_t headSize = ::std::min(size, static_cast<size_t>(FORMAT_PROBE_SIZE));
+  size_t tailSize = ::std::min(size - headSize,
+                         static_cast<size_t>(FORMAT_PROBE_SIZE));
+  return detectFormat(data, headSize, data + size - tailSize, tailSize, size);
+}
+
+StlFile::FormatDetection StlFile::detectFormat(const char *head,
+                                               size_t headSize,
+                                               const char *tail,
+                                               size_t tailSize,
+                                               int64_t size) {
+  FormatDetection detection;
+  bool hasBinaryBytes = containsBinaryBytes(head, head + headSize) ||
+                        containsBinaryBytes(tail, tail + tailSize);
+  const char *tokenEnd;
+  const char *token = nextToken(head, head + headSize, &tokenEnd);
+  bool startsWithSolid = isToken(token, tokenEnd, "solid");
+  bool hasFacet = findAsciiFacet(head, head + headSize) != head + headSize;
+  bool endsWithEndsolid = false;
+  const char *begin = tailSize > 0 ? tail : head;
+  const char *end = tailSize > 0 ? tail + tailSize : head + headSize;
+  const char *lastLine = end;
+  // Look for "endsolid" at the beginning of one of the last lines
+  for (int i = 0; i < 3 && lastLine > begin && !endsWithEndsolid; i++) {
+    lastLine = findLineStart(begin, lastLine - 1);
+    token = nextToken(lastLine, end, &tokenEnd);
+    endsWithEndsolid = isToken(token, tokenEnd, "endsolid");
+  }
+  bool looksAscii = startsWithSolid && hasFacet && !hasBinaryBytes;
+  // A binary file has an exact size given by the number of facets stored
+  // after its 80 byte header, which may well start with "solid" too
+  if (size >= HEADER_SIZE && headSize >= HEADER_SIZE) {
+    int64_t headerNumFacets =
+        static_cast<uint32_t>(readIntFromBytes(head + JUNK_SIZE));
+    bool sizeMatches =
+        (size - HEADER_SIZE) / SIZE_OF_FACET == headerNumFacets &&
+        (size - HEADER_SIZE) % SIZE_OF_FACET == 0;
+    if (sizeMatches && !looksAscii) {
+      detection.format = BINARY;
+      detection.confidence = 1.0;
+      detection.reason = "the file size matches the number of facets in "
+                         "the header";
+      return detection;
+    }
+    if (sizeMatches && looksAscii && !endsWithEndsolid) {
+      detection.format = BINARY;
+      detection.confidence = 0.6;
+      detection.reason = "the file size matches the number of facets in "
+                         "the header, though the header looks like text";
+      return detection;
+    }
+  }
+  if (looksAscii) {
+    detection.format = ASCII;
+    detection.confidence = endsWithEndsolid ? 1.0 : 0.8;
+    detection.reason = endsWithEndsolid ?
+        "the file is text from \"solid\" to \"endsolid\"" :
+        "the file is text starting with \"solid\" but has no \"endsolid\"";
+  } else if (hasBinaryBytes) {
+    detection.format = BINARY;
+    detection.confidence = 0.7;
+    detection.reason = "the file contains non-text bytes, but its size "
+                       "doesn't match the number of facets in the header";
+  } else {
+    detection.format = ASCII;
+    detection.confidence = 0.3;
+    detection.reason = "the file is text but doesn't look like an STL file";
+  }
+  return detection;
+}
+
 void StlFile::allocate() {
   // Allocate memory for the entire .STL file
   facets = new Facet[stats.numFacets];
-  if (facets == 0) {
-    ::std::cerr << "Problem allocating memory" << ::std::endl;
-    throw ::std::bad_alloc();
+}
+
+void StlFile::readData() {
+  if (stats.type == BINARY) {
+    allocate();
+    readBinaryData();
+  } else {
+    readAsciiData();
+  }
+  StatsVisitor statsVisitor(&stats);
+  statsVisitor.visit(facets, stats.numFacets);
+  statsVisitor.finish();
+  reportProgress(mappedFile.getSize(), stats.numFacets);
+  // Counting the points takes longer than reading the file, it is left
+  // to getMesh()
+  stats.numPoints = -1;
+}
+
+void StlFile::readBinaryData() {
+  const char *record = mappedFile.getData() + HEADER_SIZE;
+  for (int64_t i = 0; i < stats.numFacets; i++) {
+    if (i % PROGRESS_INTERVAL == 0)
+      reportProgress(HEADER_SIZE + i * SIZE_OF_FACET, i);
+    // Read a single facet from a binary .STL file into memory
+    readFacetFromBytes(&facets[i], record);
+    record += SIZE_OF_FACET;
   }
 }
 
-void StlFile::readData(int firstFacet, int first) {
+void StlFile::readAsciiData() {
+  const char *begin = mappedFile.getData();
+  const char *end = begin + mappedFile.getSize();
+  // Split the file into chunks that start on a facet, so that they can be
+  // parsed independently on all cores
+  int numChunks = static_cast<int>((end - begin) / ASCII_CHUNK_SIZE) + 1;
+  ::std::vector<const char*> bounds(numChunks + 1);
+  bounds[0] = begin;
+  bounds[numChunks] = end;
+  for (int i = 1; i < numChunks; i++) {
+    const char *start = begin + (end - begin) / numChunks * i;
+    bounds[i] = findAsciiFacet(::std::max(start, bounds[i - 1]), end);
+  }
+  // The facets of each chunk are counted first, so that each chunk is
+  // parsed straight into its own part of the facets
+  ::std::vector<int64_t> firstFacets(numChunks + 1, 0);
+  Parallel::run(numChunks, [&](int i) {
+    firstFacets[i + 1] = countAsciiFacets(bounds[i], bounds[i + 1]);
+  });
+  for (int i = 0; i < numChunks; i++)
+    firstFacets[i + 1] += firstFacets[i];
+  stats.numFacets = firstFacets[numChunks];
+  allocate();
+  ::std::vector<int64_t> numParsed(numChunks);
+  int64_t bytesRead = 0;
+  int64_t facetsRead = 0;
+  ::std::mutex progressMutex;
+  Parallel::run(numChunks, [&](int i) {
+    Facet *first = facets + firstFacets[i];
+    numParsed[i] = parseAsciiFacets(bounds[i], bounds[i + 1], first) - first;
+    ::std::lock_guard< ::std::mutex> lock(progressMutex);
+    bytesRead += bounds[i + 1] - bounds[i];
+    facetsRead += numParsed[i];
+    reportProgress(bytesRead, facetsRead);
+  });
+  // An "endfacet" may have been counted where it isn't a keyword, as in
+  // the name of a solid, the facets are then moved over the gaps left
+  Facet *facet = facets;
+  for (int i = 0; i < numChunks; i++) {
+    Facet *first = facets + firstFacets[i];
+    facet = ::std::copy(first, first + numParsed[i], facet);
+  }
+  stats.numFacets = facet - facets;
+}
+
+namespace {
+
+// Gathers all the facets of a file into a single array, which is only
+// grown if the file holds more facets than it was sized for
+class FacetCollector : public StlFile::FacetVisitor {
+ public:
+  explicit FacetCollector(int64_t capacity)
+      : facets(new StlFile::Facet[capacity]), capacity(capacity),
+        numFacets(0) {}
+  ~FacetCollector() { delete[] facets; }
+  void visit(const StlFile::Facet *block, int64_t numFacets) {
+    if (this->numFacets + numFacets > capacity) {
+      int64_t newCapacity = ::std::max(this->numFacets + numFacets,
+                                       capacity * 2);
+      StlFile::Facet *newFacets = new StlFile::Facet[newCapacity];
+      ::std::copy(facets, facets + this->numFacets, newFacets);
+      delete[] facets;
+      facets = newFacets;
+      capacity = newCapacity;
+    }
+    ::std::copy(block, block + numFacets, facets + this->numFacets);
+    this->numFacets += numFacets;
+  }
+  int64_t getNumFacets() const { return numFacets; }
+  // Hands the array over to the caller
+  StlFile::Facet* release() {
+    StlFile::Facet *released = facets;
+    facets = 0;
+    return released;
+  }
+
+ private:
+  FacetCollector(const FacetCollector&);
+  FacetCollector& operator=(const FacetCollector&);
+  StlFile::Facet *facets;
+  int64_t capacity;
+  int64_t numFacets;
+};
+
+}  // namespace
+
+void StlFile::readCompressedData(const ::std::string& fileName) {
+  // The file is decompressed a block at a time straight into the parser
+  int64_t compressedSize = mappedFile.getSize();
+  mappedFile.close();
+  // The facets of a binary file are counted in its header, so that they
+  // can be decompressed into an array of the right size. It is looked at
+  // the way streamFile() does.
+  CompressedFile input;
+  char head[FORMAT_PROBE_SIZE];
+  int64_t headSize = -1;
+  if (input.openForReading(fileName))
+    headSize = input.read(head, FORMAT_PROBE_SIZE);
+  input.close();
+  int64_t headerNumFacets = -1;
+  if (headSize >= HEADER_SIZE &&
+      detectFormat(head, headSize, head + headSize, 0, -1).format == BINARY)
+    headerNumFacets = static_cast<uint32_t>(readIntFromBytes(head +
+                                                             JUNK_SIZE));
+  int64_t capacity = ::std::min(::std::max(headerNumFacets,
+                                           static_cast<int64_t>(0)),
+      compressedSize * MAX_COMPRESSION_RATIO / SIZE_OF_FACET);
+  FacetCollector collector(::std::max(capacity,
+                                      static_cast<int64_t>(PROGRESS_INTERVAL)));
+  Stats fileStats = streamFile(fileName, &collector, PROGRESS_INTERVAL,
+                               observer, &formatDetection);
+  stats.header = fileStats.header;
+  stats.type = fileStats.type;
+  stats.numFacets = collector.getNumFacets();
+  facets = collector.release();
+  // The same checks as for a file that isn't compressed
+  if (formatDetection.confidence < 0.9) {
+    addWarning(UNCERTAIN_FORMAT, "The file " + fileName +
+               " is assumed to be " +
+               (stats.type == BINARY ? "binary" : "ASCII") + ": " +
+               formatDetection.reason + ".");
+  }
+  if (stats.type == BINARY && stats.numFacets != headerNumFacets) {
+    addWarning(FACET_COUNT_MISMATCH, "File size doesn't match number "
+               "of facets in the header.");
+  }
+  StatsVisitor statsVisitor(&stats);
+  statsVisitor.visit(facets, stats.numFacets);
+  statsVisitor.finish();
+  // The points are counted by getMesh()
+  stats.numPoints = -1;
+}
+
+StlFile::Stats StlFile::stream(const ::std::string& fileName,
+                               FacetVisitor *visitor, int64_t blockSize,
+                               ProgressObserver *observer) {
+  FormatDetection detection;
+  return streamFile(fileName, visitor, blockSize, observer, &detection);
+}
+
+StlFile::Stats StlFile::streamFile(const ::std::string& fileName,
+                                   FacetVisitor *visitor, int64_t blockSize,
+                                   ProgressObserver *observer,
+                                   FormatDetection *detection) {
+  Stats stats;
+  stats.numFacets = 0;
+  stats.numPoints = 0;
+  stats.surface = -1.0;
+  stats.volume = -1.0;
+  CompressedFile input;
+  if (!input.openForReading(fileName)) {
+    throw error_opening_file("The file " + fileName + " could not be found.");
+  }
+  char head[FORMAT_PROBE_SIZE];
+  int64_t headSize = input.read(head, FORMAT_PROBE_SIZE);
+  if (headSize < 0)
+    throw wrong_file_format("The file " + fileName + " is corrupted.");
+  int64_t fileSize = -1;
+  if (input.getCompression() == CompressedFile::NONE) {
+    // Read both ends of the file to find out its format
+    ::std::ifstream file(fileName.c_str(), ::std::ios::binary);
+    file.seekg(0, ::std::ios::end);
+    fileSize = file.tellg();
+    *detection = probeFormat(file, fileSize, head);
+  } else {
+    // The end of a compressed file can't be reached without decompressing
+    // all of it, so only its beginning is looked at
+    *detection = detectFormat(head, headSize, head + headSize, 0, -1);
+  }
+  stats.type = detection->format;
+  // The end of a compressed file is kept as it is decompressed, so that
+  // its format can be checked as for another file once it is all read
+  int64_t decompressedSize = headSize;
+  ::std::vector<char> tail;
+  auto keepTail = [&](const char *data, int64_t size) {
+    decompressedSize += size;
+    if (input.getCompression() == CompressedFile::NONE)
+      return;
+    int64_t kept = ::std::min(size, static_cast<int64_t>(FORMAT_PROBE_SIZE));
+    tail.insert(tail.end(), data + size - kept, data + size);
+    if (tail.size() > FORMAT_PROBE_SIZE)
+      tail.erase(tail.begin(), tail.end() - FORMAT_PROBE_SIZE);
+  };
+  if (input.getCompression() != CompressedFile::NONE)
+    tail.assign(head, head + headSize);
+  // The data read so far is carried over to the first block
+  ::std::vector<Facet> block;
+  ::std::vector<char> buffer;
+  size_t carried;
+  bool atEnd = false;
   if (stats.type == BINARY) {
-    file.seekg(HEADER_SIZE, ::std::ios::beg);
+    if (headSize < HEADER_SIZE || (fileSize >= 0 &&
+        (fileSize - HEADER_SIZE) % SIZE_OF_FACET != 0)) {
+      throw wrong_header_size("The file " + fileName + " has a wrong size.");
+    }
+    stats.header = readBinaryHeader(head);
+    carried = headSize - HEADER_SIZE;
+    buffer.resize(::std::max(blockSize * SIZE_OF_FACET,
+                       static_cast<int64_t>(FORMAT_PROBE_SIZE)));
+    memcpy(&buffer[0], head + HEADER_SIZE, carried);
+    block.resize(blockSize);
+    while (!atEnd) {
+      int64_t read = input.read(&buffer[carried], buffer.size() - carried);
+      if (read < 0)
+        throw wrong_file_format("The file " + fileName + " is corrupted.");
+      keepTail(&buffer[carried], read);
+      size_t size = carried + read;
+      atEnd = size < buffer.size();
+      int64_t numFacets = size / SIZE_OF_FACET;
+      for (int64_t i = 0; i < numFacets; i += blockSize) {
+        int64_t numBlockFacets = ::std::min(blockSize, numFacets - i);
+        for (int64_t j = 0; j < numBlockFacets; j++)
+          readFacetFromBytes(&block[j], &buffer[(i + j) * SIZE_OF_FACET]);
+        visitor->visit(&block[0], numBlockFacets);
+      }
+      stats.numFacets += numFacets;
+      carried = size - numFacets * SIZE_OF_FACET;
+      memmove(&buffer[0], &buffer[numFacets * SIZE_OF_FACET], carried);
+      reportStreamProgress(observer, input.getBytesRead(), stats.numFacets);
+    }
+    // A compressed file is only known to be truncated once it is read
+    if (carried != 0) {
+      throw wrong_header_size("The file " + fileName + " has a wrong size.");
+    }
   } else {
-    file.seekg(0, ::std::ios::beg);
-    ::std::string line;
-    // Skip the first line of the file
-    getline(file, line);
-  }
-  Facet facet;
-  for (int i = firstFacet; i < stats.numFacets; i++) {
-    if (stats.type == BINARY) {  // Read a single facet from a binary .STL file
-	    facet.normal.x = readFloatFromBytes(file);
-	    facet.normal.y = readFloatFromBytes(file);
-	    facet.normal.z = readFloatFromBytes(file);
-	    facet.vector[0].x = readFloatFromBytes(file);
-	    facet.vector[0].y = readFloatFromBytes(file);
-	    facet.vector[0].z = readFloatFromBytes(file);
-	    facet.vector[1].x = readFloatFromBytes(file);
-	    facet.vector[1].y = readFloatFromBytes(file);
-	    facet.vector[1].z = readFloatFromBytes(file);
-	    facet.vector[2].x = readFloatFromBytes(file);
-	    facet.vector[2].y = readFloatFromBytes(file);
-	    facet.vector[2].z = readFloatFromBytes(file);
-	    facet.extra[0] = file.get();
-	    facet.extra[1] = file.get();
-    } else {  // Read a single facet from an ASCII .STL file
-      ::std::string junk;
-      file >> junk >> junk;
-      file >> facet.normal.x >> facet.normal.y >> facet.normal.z;
-      file >> junk >> junk >> junk;
-      file >> facet.vector[0].x >> facet.vector[0].y >> facet.vector[0].z;
-      file >> junk;
-      file >> facet.vector[1].x >> facet.vector[1].y >> facet.vector[1].z;
-      file >> junk;
-      file >> facet.vector[2].x >> facet.vector[2].y >> facet.vector[2].z;
-      file >> junk >> junk;
+    stats.header = readAsciiHeader(head, head + headSize);
+    // Parse the file one chunk at a time. The end of a chunk that follows
+    // its last complete facet is carried over to the next chunk.
+    carried = headSize;
+    buffer.resize(ASCII_CHUNK_SIZE);
+    memcpy(&buffer[0], head, carried);
+    while (!atEnd) {
+      // Make room if a single facet doesn't fit in the chunk
+      if (carried == buffer.size())
+        buffer.resize(buffer.size() * 2);
+      int64_t read = input.read(&buffer[carried], buffer.size() - carried);
+      if (read < 0)
+        throw wrong_file_format("The file " + fileName + " is corrupted.");
+      keepTail(&buffer[carried], read);
+      size_t size = carried + read;
+      atEnd = size < buffer.size();
+      const char *begin = &buffer[0];
+      const char *end = begin + size;
+      const char *cut = atEnd ? end : findAsciiFacetsEnd(begin, end);
+      block.clear();
+      parseAsciiFacets(begin, cut, ::std::back_inserter(block));
+      for (size_t i = 0; i < block.size(); i += blockSize) {
+        int64_t numFacets = ::std::min(blockSize,
+                                 static_cast<int64_t>(block.size() - i));
+        visitor->visit(&block[i], numFacets);
+      }
+      stats.numFacets += block.size();
+      carried = end - cut;
+      memmove(&buffer[0], cut, carried);
+      reportStreamProgress(observer, input.getBytesRead(), stats.numFacets);
     }
-    // Write the facet into memory.
-    facets[i] = facet;
-    // While we are going through all of the facets, let's find the
-    // maximum and minimum values for x, y, and z
-    // Initialize the max and min values the first time through
-    if (first) {
-	    stats.max.x = facet.vector[0].x;
-	    stats.min.x = facet.vector[0].x;
-	    stats.max.y = facet.vector[0].y;
-	    stats.min.y = facet.vector[0].y;
-	    stats.max.z = facet.vector[0].z;
-	    stats.min.z = facet.vector[0].z;
-  	  
-	    float xDiff = qAbs(facet.vector[0].x - facet.vector[1].x);
-	    float yDiff = qAbs(facet.vector[0].y - facet.vector[1].y);
-	    float zDiff = qAbs(facet.vector[0].z - facet.vector[1].z);
-	    float maxDiff = qMax(xDiff, yDiff);
-	    maxDiff = qMax(zDiff, maxDiff);
-	    stats.shortestEdge = maxDiff;
-
-      first = 0;
+  }
+  if (input.getCompression() != CompressedFile::NONE) {
+    // Only the bytes past the beginning belong to the end
+    int64_t tailSize = ::std::min(decompressedSize - headSize,
+                                  static_cast<int64_t>(tail.size()));
+    FormatDetection fullDetection = detectFormat(
+        head, headSize, tail.data() + tail.size() - tailSize, tailSize,
+        decompressedSize);
+    // The format the file was parsed in stays
+    if (fullDetection.format == stats.type)
+      *detection = fullDetection;
+  }
+  return stats;
+}
+
+bool StlFile::openPreview(const ::std::string& fileName,
+                          int64_t maxFacets) {
+  close();
+  warnings.clear();
+  stats.numFacets = 0;
+  stats.numPoints = 0;
+  stats.surface = -1.0;
+  stats.volume = -1.0;
+  ::std::ifstream file(fileName.c_str(), ::std::ios::binary);
+  if (!file.is_open()) {
+    throw error_opening_file("The file " + fileName + " could not be found.");
+  }
+  file.seekg(0, ::std::ios::end);
+  int64_t fileSize = file.tellg();
+  char head[FORMAT_PROBE_SIZE];
+  formatDetection = probeFormat(file, fileSize, head);
+  // Only uncompressed binary files have fixed size records that can be
+  // picked at random
+  if (CompressedFile::detectCompression(head, ::std::min(fileSize,
+          static_cast<int64_t>(FORMAT_PROBE_SIZE))) != CompressedFile::NONE ||
+      formatDetection.format != BINARY || fileSize < HEADER_SIZE ||
+      (fileSize - HEADER_SIZE) % SIZE_OF_FACET != 0)
+    return false;
+  int64_t fileNumFacets = (fileSize - HEADER_SIZE) / SIZE_OF_FACET;
+  if (maxFacets <= 0 || fileNumFacets <= maxFacets)
+    return false;
+  int64_t stride = (fileNumFacets + maxFacets - 1) / maxFacets;
+  stats.type = BINARY;
+  stats.header = readBinaryHeader(head);
+  stats.numFacets = (fileNumFacets + stride - 1) / stride;
+  allocate();
+  // Seek to each record, the ones in between are never read
+  char record[SIZE_OF_FACET];
+  for (int64_t i = 0; i < stats.numFacets; i++) {
+    file.seekg(HEADER_SIZE + i * stride * SIZE_OF_FACET, ::std::ios::beg);
+    if (!file.read(record, SIZE_OF_FACET)) {
+      close();
+      throw wrong_header_size("The file " + fileName + " has a wrong size.");
     }
-    // Now find the max and min values
-    stats.max.x = qMax(stats.max.x, facet.vector[0].x);
-    stats.min.x = qMin(stats.min.x, facet.vector[0].x);
-    stats.max.y = qMax(stats.max.y, facet.vector[0].y);
-    stats.min.y = qMin(stats.min.y, facet.vector[0].y);
-    stats.max.z = qMax(stats.max.z, facet.vector[0].z);
-    stats.min.z = qMin(stats.min.z, facet.vector[0].z);
-
-    stats.max.x = qMax(stats.max.x, facet.vector[1].x);
-    stats.min.x = qMin(stats.min.x, facet.vector[1].x);
-    stats.max.y = qMax(stats.max.y, facet.vector[1].y);
-    stats.min.y = qMin(stats.min.y, facet.vector[1].y);
-    stats.max.z = qMax(stats.max.z, facet.vector[1].z);
-    stats.min.z = qMin(stats.min.z, facet.vector[1].z);
-
-    stats.max.x = qMax(stats.max.x, facet.vector[2].x);
-    stats.min.x = qMin(stats.min.x, facet.vector[2].x);
-    stats.max.y = qMax(stats.max.y, facet.vector[2].y);
-    stats.min.y = qMin(stats.min.y, facet.vector[2].y);
-    stats.max.z = qMax(stats.max.z, facet.vector[2].z);
-    stats.min.z = qMin(stats.min.z, facet.vector[2].z);
-  }
-  stats.size.x = stats.max.x - stats.min.x;
-  stats.size.y = stats.max.y - stats.min.y;
-  stats.size.z = stats.max.z - stats.min.z;
-  stats.boundingDiameter =  sqrt(stats.size.x * stats.size.x +
-                                   stats.size.y * stats.size.y +
-                                   stats.size.z * stats.size.z);
-  stats.numPoints = getNumPoints();
-  stats.surface = getSurface();
-  stats.volume = getVolume();
-}
-
-int StlFile::readIntFromBytes(::std::ifstream& file) {
+    readFacetFromBytes(&facets[i], record);
+  }
+  // The bounding box of the sample is close enough to place the view, the
+  // other stats only make sense for the whole file
+  StatsVisitor statsVisitor(&stats);
+  statsVisitor.visit(facets, stats.numFacets);
+  statsVisitor.finish();
+  stats.numPoints = -1;
+  return true;
+}
+
+StlFile::Stats StlFile::readStats(const ::std::string& fileName) {
+  Stats stats;
+  StatsVisitor statsVisitor(&stats);
+  Stats fileStats = stream(fileName, &statsVisitor);
+  statsVisitor.finish();
+  stats.header = fileStats.header;
+  stats.type = fileStats.type;
+  stats.numFacets = fileStats.numFacets;
+  // Counting the points requires all of them at once
+  stats.numPoints = -1;
+  return stats;
+}
+
+void StlFile::addWarning(WarningCode code, const ::std::string& message) {
+  Warning warning;
+  warning.code = code;
+  warning.message = message;
+  warnings.push_back(warning);
+}
+
+void StlFile::reportProgress(int64_t bytesRead, int64_t facetsRead) {
+  reportStreamProgress(observer, bytesRead, facetsRead);
+}
+
+void StlFile::reportStreamProgress(ProgressObserver *observer,
+                                   int64_t bytesRead, int64_t facetsRead) {
+  if (observer != 0) {
+    observer->progress(bytesRead, facetsRead);
+    if (observer->isCancelled())
+      throw load_cancelled("The loading was cancelled.");
+  }
+}
+
+StlFile::FormatDetection StlFile::probeFormat(::std::ifstream& file,
+                                              int64_t fileSize,
+                                              char head[]) {
+  // Read both ends of the file to find out its format, head is left with
+  // the beginning of the file
+  char tail[FORMAT_PROBE_SIZE];
+  int64_t headSize = ::std::min(fileSize,
+                               static_cast<int64_t>(FORMAT_PROBE_SIZE));
+  int64_t tailSize = ::std::min(fileSize - headSize,
+                          static_cast<int64_t>(FORMAT_PROBE_SIZE));
+  file.seekg(0, ::std::ios::beg);
+  file.read(head, headSize);
+  file.seekg(fileSize - tailSize, ::std::ios::beg);
+  file.read(tail, tailSize);
+  return detectFormat(head, headSize, tail, tailSize, fileSize);
+}
+
+int StlFile::readIntFromBytes(const char *bytes) {
   int value;
-  value  =  file.get() & 0xFF;
-  value |= (file.get() & 0xFF) << 0x08;
-  value |= (file.get() & 0xFF) << 0x10;
-  value |= (file.get() & 0xFF) << 0x18;
+  value  =  bytes[0] & 0xFF;
+  value |= (bytes[1] & 0xFF) << 0x08;
+  value |= (bytes[2] & 0xFF) << 0x10;
+  value |= (bytes[3] & 0xFF) << 0x18;
   return(value);
 }
 
-float StlFile::readFloatFromBytes(::std::ifstream& file) {
-  union {
-    int intValue;
-    float floatValue;
-  } value;
-  value.intValue  =  file.get() & 0xFF;
-  value.intValue |= (file.get() & 0xFF) << 0x08;
-  value.intValue |= (file.get() & 0xFF) << 0x10;
-  value.intValue |= (file.get() & 0xFF) << 0x18;
-  return(value.floatValue);
-}
-
-void StlFile::writeBytesFromInt(::std::ofstream& file, int valueIn) {
-  union {
-    int intValue;
-    char charValue[4];
-  } value;
-  value.intValue = valueIn;
-  int newValue  = value.charValue[0] & 0xFF;
-  newValue |= (value.charValue[1] & 0xFF) << 0x08;
-  newValue |= (value.charValue[2] & 0xFF) << 0x10;
-  newValue |= (value.charValue[3] & 0xFF) << 0x18;
-  file.write(reinterpret_cast<char *>(&newValue), sizeof(newValue));
-}
-
-void StlFile::writeBytesFromFloat(::std::ofstream& file, float valueIn) {
-  union {
-    float floatValue;
-    char charValue[4];
-  } value;
-  value.floatValue = valueIn;
-  int newValue  = value.charValue[0] & 0xFF;
-  newValue |= (value.charValue[1] & 0xFF) << 0x08;
-  newValue |= (value.charValue[2] & 0xFF) << 0x10;
-  newValue |= (value.charValue[3] & 0xFF) << 0x18;
-  file.write(reinterpret_cast<char *>(&newValue), sizeof(newValue));
-}
-
-void StlFile::writeBinary(const ::std::string& fileName) {
-  // Open the file
-  ::std::ofstream file(fileName.c_str(), ::std::ios::out|::std::ios::binary);
-  if (file.is_open()) {
-    for (int i = 0; i < JUNK_SIZE; i++) file.put(0);
-    writeBytesFromInt(file, stats.numFacets);
-    for (int i = 0; i < stats.numFacets; i++) {
-      writeBytesFromFloat(file, facets[i].normal.x);
-      writeBytesFromFloat(file, facets[i].normal.y);
-      writeBytesFromFloat(file, facets[i].normal.z);
-      writeBytesFromFloat(file, facets[i].vector[0].x);
-      writeBytesFromFloat(file, facets[i].vector[0].y);
-      writeBytesFromFloat(file, facets[i].vector[0].z);
-      writeBytesFromFloat(file, facets[i].vector[1].x);
-      writeBytesFromFloat(file, facets[i].vector[1].y);
-      writeBytesFromFloat(file, facets[i].vector[1].z);
-      writeBytesFromFloat(file, facets[i].vector[2].x);
-      writeBytesFromFloat(file, facets[i].vector[2].y);
-      writeBytesFromFloat(file, facets[i].vector[2].z);
-      file << facets[i].extra[0];
-      file << facets[i].extra[1];
-    }
-    file.close();
-  } else {
-    ::std::cerr << "The file " << file << " could not be found." << ::std::endl;
-    throw error_opening_file();
-  }
-}
-
-void StlFile::writeAscii(const ::std::string& fileName) {
-  // Open the file
-  ::std::ofstream file(fileName.c_str(), ::std::ios::out);
-  file.setf(::std::ios::scientific);
-  file.precision(8);
-  if (file.is_open()) {
-    file << "solid" << ::std::endl;
-    for (int i = 0; i < stats.numFacets; i++) {
-      file << "  facet normal " << facets[i].normal.x << " "
-           << facets[i].normal.y << " " << facets[i].normal.z << ::std::endl;
-      file << "    outer loop " << ::std::endl;
-      file << "      Vector " << facets[i].vector[0].x << " "
-           << facets[i].vector[0].y << " " << facets[i].vector[0].z
-           << ::std::endl;
-      file << "      Vector " << facets[i].vector[1].x << " " 
-           << facets[i].vector[1].y << " " << facets[i].vector[1].z
-           << ::std::endl;
-      file << "      Vector " << facets[i].vector[2].x << " "
-           << facets[i].vector[2].y << " " << facets[i].vector[2].z
-           << ::std::endl;
-      file << "    endloop" << ::std::endl;
-      file << "  endfacet" << ::std::endl;
-    }
-    file << "endsolid" << ::std::endl;
-    file.close();
+void StlFile::readFacetFromBytes(Facet *facet, const char *bytes) {
+  float values[12];
+  readFloatsFromBytes(values, bytes, 12);
+  facet->normal.x = values[0];
+  facet->normal.y = values[1];
+  facet->normal.z = values[2];
+  facet->vector[0].x = values[3];
+  facet->vector[0].y = values[4];
+  facet->vector[0].z = values[5];
+  facet->vector[1].x = values[6];
+  facet->vector[1].y = values[7];
+  facet->vector[1].z = values[8];
+  facet->vector[2].x = values[9];
+  facet->vector[2].y = values[10];
+  facet->vector[2].z = values[11];
+  facet->extra[0] = bytes[48];
+  facet->extra[1] = bytes[49];
+}
+
+void StlFile::readFloatsFromBytes(float values[], const char *bytes,
+                                  int count) {
+  // The bytes may not be aligned, so copy them rather than casting them
+  memcpy(values, bytes, count * sizeof(float));
+  if (!isLittleEndian()) {
+    for (int i = 0; i < count; i++)
+      swapBytes(reinterpret_cast<char*>(&values[i]), sizeof(float));
+  }
+}
+
+void StlFile::writeBytesFromInt(char *bytes, uint32_t value) {
+  bytes[0] = value & 0xFF;
+  bytes[1] = (value >> 0x08) & 0xFF;
+  bytes[2] = (value >> 0x10) & 0xFF;
+  bytes[3] = (value >> 0x18) & 0xFF;
+}
+
+void StlFile::writeBytesFromFacet(char *bytes, const Facet *facet) {
+  float values[12] = {
+    facet->normal.x, facet->normal.y, facet->normal.z,
+    facet->vector[0].x, facet->vector[0].y, facet->vector[0].z,
+    facet->vector[1].x, facet->vector[1].y, facet->vector[1].z,
+    facet->vector[2].x, facet->vector[2].y, facet->vector[2].z
+  };
+  writeBytesFromFloats(bytes, values, 12);
+  bytes[48] = facet->extra[0];
+  bytes[49] = facet->extra[1];
+}
+
+void StlFile::writeBytesFromFloats(char *bytes, const float values[],
+                                   int count) {
+  // The records are 50 bytes long, so the bytes may not be aligned
+  memcpy(bytes, values, count * sizeof(float));
+  if (!isLittleEndian()) {
+    for (int i = 0; i < count; i++)
+      swapBytes(bytes + i * sizeof(float), sizeof(float));
+  }
+}
+
+void StlFile::writeBinary(CompressedFile& output) {
+  // The number of facets of a binary file is stored on 32 bits
+  if (stats.numFacets > UINT32_MAX) {
+    throw wrong_header_size("Too many facets to write as a binary file.");
+  }
+  // The facets are converted a block at a time, each block is written with
+  // a single call
+  ::std::vector<char> buffer(WRITE_BLOCK_SIZE * SIZE_OF_FACET);
+  char header[HEADER_SIZE] = {0};
+  writeBytesFromInt(header + JUNK_SIZE, static_cast<uint32_t>(stats.numFacets));
+  bool written = output.write(header, HEADER_SIZE);
+  for (int64_t i = 0; i < stats.numFacets && written; i += WRITE_BLOCK_SIZE) {
+    int64_t numFacets = ::std::min(static_cast<int64_t>(WRITE_BLOCK_SIZE),
+                             stats.numFacets - i);
+    for (int64_t j = 0; j < numFacets; j++)
+      writeBytesFromFacet(&buffer[j * SIZE_OF_FACET], &facets[i + j]);
+    written = output.write(&buffer[0], numFacets * SIZE_OF_FACET);
+  }
+  if (!written)
+    throw error_writing_file();
+}
+
+void StlFile::writeAscii(CompressedFile& output) {
+  bool written = output.write("solid\n", 6);
+  // The chunks of a batch are formatted on all cores, then written in
+  // order. Only one batch is held in memory at a time.
+  int64_t numChunks = (stats.numFacets + ASCII_WRITE_CHUNK_SIZE - 1) /
+                      ASCII_WRITE_CHUNK_SIZE;
+  int batchSize = Parallel::getNumThreads() * 4;
+  ::std::vector< ::std::vector<char> > buffers(batchSize);
+  for (int64_t batch = 0; batch < numChunks && written; batch += batchSize) {
+    int numBatchChunks = static_cast<int>(
+        ::std::min(static_cast<int64_t>(batchSize), numChunks - batch));
+    Parallel::run(numBatchChunks, [&](int i) {
+      int64_t first = (batch + i) * ASCII_WRITE_CHUNK_SIZE;
+      int64_t last = ::std::min(first + ASCII_WRITE_CHUNK_SIZE,
+                                stats.numFacets);
+      formatAsciiFacets(facets + first, last - first, buffers[i]);
+    });
+    for (int i = 0; i < numBatchChunks && written; i++)
+      written = output.write(&buffers[i][0], buffers[i].size());
+  }
+  if (!written || !output.write("endsolid\n", 9))
+    throw error_writing_file();
+}
+
+const IndexedMesh* StlFile::getMesh() {
+  if (mesh == 0 && facets != 0) {
+    mesh = new IndexedMesh();
+    mesh->build(facets, stats.numFacets, weldTolerance);
+  }
+  return mesh;
+}
+
+void StlFile::setWeldTolerance(float tolerance) {
+  if (tolerance == weldTolerance)
+    return;
+  weldTolerance = tolerance;
+  delete mesh;
+  mesh = 0;
+  delete edgeAnalysis;
+  edgeAnalysis = 0;
+  delete validation;
+  validation = 0;
+  delete shells;
+  shells = 0;
+  clearLevels();
+  // The cache may hold the results of this tolerance
+  restoreFromCache();
+}
+
+bool StlFile::storeInCache() {
+  if (pendingEntry == 0 || cache == 0 || facets == 0)
+    return false;
+  // The results are stored together or not at all
+  bool hasResults = mesh != 0 && validation != 0 && edgeAnalysis != 0 &&
+                    shells != 0;
+  bool stored = cache->store(pendingEntry->key, pendingEntry->stats, facets,
+                             weldTolerance, hasResults ? mesh : 0,
+                             validation, edgeAnalysis, shells);
+  delete pendingEntry;
+  pendingEntry = 0;
+  return stored;
+}
+
+void StlFile::restoreFromCache() {
+  if (!cacheEntry.isOpen() || repaired || mesh != 0)
+    return;
+  IndexedMesh *cachedMesh = new IndexedMesh();
+  MeshValidation *cachedValidation = new MeshValidation();
+  EdgeAnalysis *cachedEdgeAnalysis = new EdgeAnalysis();
+  MeshShells *cachedShells = new MeshShells();
+  bool restored = false;
+  try {
+    restored = MeshCache::restore(cacheEntry, weldTolerance, cachedMesh,
+                                  cachedValidation, cachedEdgeAnalysis,
+                                  cachedShells);
+  } catch (...) {
+    delete cachedMesh;
+    delete cachedValidation;
+    delete cachedEdgeAnalysis;
+    delete cachedShells;
+    throw;
+  }
+  if (restored) {
+    mesh = cachedMesh;
+    validation = cachedValidation;
+    edgeAnalysis = cachedEdgeAnalysis;
+    shells = cachedShells;
+    stats.numPoints = mesh->getNumVertices();
   } else {
-    ::std::cerr << "The file " << file << " could not be found." << ::std::endl;
-    throw error_opening_file();
-  }
-  /*FILE *fp = fopen(fileName.c_str(), "w");
-  fprintf(fp, "solid\n");
-  for (int i = 0; i < stats.numFacets; i++) {
-    fprintf(fp, "  facet normal % 0.8f % 0.8f % 0.8f\n",
-    facets[i].normal.x, facets[i].normal.y,
-    facets[i].normal.z);
-    fprintf(fp, "    outer loop\n");
-    fprintf(fp, "      vertex % 0.8f % 0.8f % 0.8f\n",
-    facets[i].vector[0].x, facets[i].vector[0].y,
-    facets[i].vector[0].z);
-    fprintf(fp, "      vertex % 0.8f % 0.8f % 0.8f\n",
-    facets[i].vector[1].x, facets[i].vector[1].y,
-    facets[i].vector[1].z);
-    fprintf(fp, "      vertex % 0.8f % 0.8f % 0.8f\n",
-    facets[i].vector[2].x, facets[i].vector[2].y,
-    facets[i].vector[2].z);
-    fprintf(fp, "    endloop\n");
-    fprintf(fp, "  endfacet\n");
-  }
-  fprintf(fp, "endsolid\n");
-  fclose(fp);*/
-}
-
-static bool compareVectors(Vector i, Vector j)
-{
-  Vector diff;
-  diff = i - j;
-  return (diff.Magnitude() < 0);
-}
-
-static bool equalVectors(Vector i, Vector j)
-{
-  Vector diff;
-  diff = i - j;
-  return (diff.Magnitude() == 0);
-}
-
-int StlFile::getNumPoints() {
-  ::std::vector<Vector> vectors;
-  for (int i = 0; i < stats.numFacets; i++) {
-    for (int j = 0; j < 3; j++) {
-      vectors.push_back(facets[i].vector[j]);
-    }
+    delete cachedMesh;
+    delete cachedValidation;
+    delete cachedEdgeAnalysis;
+    delete cachedShells;
+    // The points stored were counted with another tolerance, if at all
+    stats.numPoints = -1;
+  }
+}
+
+const EdgeAnalysis* StlFile::getEdgeAnalysis() {
+  if (edgeAnalysis == 0 && getMesh() != 0) {
+    edgeAnalysis = new EdgeAnalysis();
+    edgeAnalysis->analyze(mesh);
+  }
+  return edgeAnalysis;
+}
+
+const MeshValidation* StlFile::getValidation() {
+  if (validation == 0 && getMesh() != 0) {
+    validation = new MeshValidation();
+    validation->validate(mesh);
+  }
+  return validation;
+}
+
+MeshRepair StlFile::repair() {
+  MeshRepair repair;
+  if (getMesh() == 0)
+    return repair;
+  repair.repair(facets, mesh);
+  // The facets aren't those of the file anymore
+  delete pendingEntry;
+  pendingEntry = 0;
+  repaired = true;
+  // The vertices haven't moved but the facets going through them may have
+  // turned, the edge lengths are still right
+  delete mesh;
+  mesh = 0;
+  delete validation;
+  validation = 0;
+  delete shells;
+  shells = 0;
+  clearLevels();
+  StatsVisitor statsVisitor(&stats);
+  statsVisitor.visit(facets, stats.numFacets);
+  statsVisitor.finish();
+  return repair;
+}
+
+const MeshShells* StlFile::getShells() {
+  if (shells == 0 && getMesh() != 0) {
+    shells = new MeshShells();
+    shells->analyze(facets, mesh);
   }
-  ::std::sort(vectors.begin(), vectors.end(), compareVectors);
-  ::std::unique(vectors.begin(), vectors.end(), equalVectors);
-  return vectors.size();
-}
-
-float StlFile::getVolume() {
-  Vector p0;
-  Vector p;
-  float volume = 0.0;
-  // Choose a point, any point as the reference
-  p0.x = facets[0].vector[0].x;
-  p0.y = facets[0].vector[0].y;
-  p0.z = facets[0].vector[0].z;
-  for (int i = 0; i < stats.numFacets; i++) {
-    p.x = facets[i].vector[0].x - p0.x;
-    p.y = facets[i].vector[0].y - p0.y;
-    p.z = facets[i].vector[0].z - p0.z;
-    // Do dot product to get distance from point to plane
-    Normal n = facets[i].normal;
-    float height = (n.x * p.x) + (n.y * p.y) + (n.z * p.z);
-    float area = getArea(&facets[i]);
-    volume += (area * height) / 3.0;
-  }
-	if (volume < 0.0) {
-		volume = -volume;
-	}
-  return volume;
-}
-
-float StlFile::getSurface() {
-  float surface = 0.0;
-  for (int i = 0; i < stats.numFacets; i++) {
-    float area = getArea(&facets[i]);
-    surface += area;
-  }
-	if (surface < 0.0) {
-		surface = -surface;
-	}
-  return surface;
-}
-
-float StlFile::getArea(Facet *facet) {
-	float cross[3][3];
-	float sum[3];
-	float n[3];
-	for (int i = 0; i < 3; i++) {
-    cross[i][0] = ((facet->vector[i].y * facet->vector[(i + 1) % 3].z) -
-    (facet->vector[i].z * facet->vector[(i + 1) % 3].y));
-    cross[i][1] = ((facet->vector[i].z * facet->vector[(i + 1) % 3].x) -
-    (facet->vector[i].x * facet->vector[(i + 1) % 3].z));
-    cross[i][2] = ((facet->vector[i].x * facet->vector[(i + 1) % 3].y) -
-    (facet->vector[i].y * facet->vector[(i + 1) % 3].x));
-	}
-	sum[0] = cross[0][0] + cross[1][0] + cross[2][0];
-	sum[1] = cross[0][1] + cross[1][1] + cross[2][1];
-	sum[2] = cross[0][2] + cross[1][2] + cross[2][2];
-	// This should already be done.  But just in case, let's do it again
-	calculateNormal(n, facet);
-	normalizeVector(n);
-	float area = 0.5 * (n[0] * sum[0] + n[1] * sum[1] + n[2] * sum[2]);
-	return area;
-}
-
-void StlFile::calculateNormal(float normal[], Facet *facet) {
-  float v1[3];
-  float v2[3];
-  v1[0] = facet->vector[1].x - facet->vector[0].x;
-  v1[1] = facet->vector[1].y - facet->vector[0].y;
-  v1[2] = facet->vector[1].z - facet->vector[0].z;
-  v2[0] = facet->vector[2].x - facet->vector[0].x;
-  v2[1] = facet->vector[2].y - facet->vector[0].y;
-  v2[2] = facet->vector[2].z - facet->vector[0].z;
-  normal[0] = (float)((double)v1[1] * (double)v2[2])
-              - ((double)v1[2] * (double)v2[1]);
-  normal[1] = (float)((double)v1[2] * (double)v2[0])
-              - ((double)v1[0] * (double)v2[2]);
-  normal[2] = (float)((double)v1[0] * (double)v2[1])
-              - ((double)v1[1] * (double)v2[0]);
-}
-
-void StlFile::normalizeVector(float v[]) {
-  double length = sqrt((double)v[0] * (double)v[0]
-                       + (double)v[1] * (double)v[1]
-                          + (double)v[2] * (double)v[2]);
-  float minNormalLength = 0.000000000001;
-  if (length < minNormalLength) {
-    v[0] = 1.0;
-    v[1] = 0.0;
-    v[2] = 0.0;
+  return shells;
+}
+
+void StlFile::makeLevels(const ::std::vector<double>& fractions) {
+  clearLevels();
+  if (getMesh() == 0)
     return;
-  }  
-  double factor = 1.0 / length;
-  v[0] *= factor;
-  v[1] *= factor;
-  v[2] *= factor;
+  MeshDecimator decimator;
+  decimator.setMesh(mesh);
+  for (size_t i = 0; i < fractions.size(); i++) {
+    decimator.decimate(static_cast<int64_t>(stats.numFacets * fractions[i]));
+    ::std::vector<Facet> reduced = decimator.getFacets();
+    StlFile *level = new StlFile();
+    level->setFacets(reduced.data(), reduced.size());
+    levels.push_back(level);
+  }
+}
+
+StlFile* StlFile::getLevel(int level) {
+  if (level <= 0 || level > static_cast<int>(levels.size()))
+    return this;
+  return levels[level - 1];
+}
+
+void StlFile::clearLevels() {
+  for (size_t i = 0; i < levels.size(); i++)
+    delete levels[i];
+  levels.clear();
+}
+
+StlFile::StatsVisitor::StatsVisitor(Stats *stats) {
+  this->stats = stats;
+  first = true;
+}
+
+void StlFile::StatsVisitor::visit(const Facet *block, int64_t numFacets) {
+  if (numFacets <= 0)
+    return;
+  if (first) {
+    // Choose a point, any point as the reference for the volume
+    p0 = block[0].vector[0];
+    first = false;
+  }
+  // Complete the chunk started by the previous block
+  if (!pending.empty()) {
+    int64_t count = ::std::min(numFacets, static_cast<int64_t>(
+        STATS_CHUNK_SIZE - pending.size()));
+    pending.insert(pending.end(), block, block + count);
+    block += count;
+    numFacets -= count;
+    if (pending.size() == STATS_CHUNK_SIZE) {
+      addChunks(pending.data(), STATS_CHUNK_SIZE);
+      pending.clear();
+    }
+  }
+  int64_t numWhole = numFacets - numFacets % STATS_CHUNK_SIZE;
+  addChunks(block, numWhole);
+  pending.insert(pending.end(), block + numWhole, block + numFacets);
+}
+
+void StlFile::StatsVisitor::addChunks(const Facet *facets,
+                                      int64_t numFacets) {
+  int numChunks = static_cast<int>(
+      (numFacets + STATS_CHUNK_SIZE - 1) / STATS_CHUNK_SIZE);
+  size_t firstChunk = chunks.size();
+  chunks.resize(firstChunk + numChunks);
+  Parallel::run(numChunks, [&](int i) {
+    int64_t begin = static_cast<int64_t>(i) * STATS_CHUNK_SIZE;
+    int64_t count = ::std::min<int64_t>(STATS_CHUNK_SIZE, numFacets - begin);
+    StatsKernel::Sums &sums = chunks[firstChunk + i];
+    StatsKernel::clear(&sums);
+    StatsKernel::run(facets + begin, count, p0, &sums);
+  });
+}
+
+void StlFile::StatsVisitor::finish() {
+  addChunks(pending.data(), pending.size());
+  pending.clear();
+  StatsKernel::Sums sums;
+  StatsKernel::merge(chunks.data(), chunks.size(), &sums);
+  if (chunks.empty()) {
+    // No facets at all
+    for (int i = 0; i < 3; i++)
+      sums.min[i] = sums.max[i] = 0.0;
+  }
+  stats->min.x = sums.min[0];
+  stats->min.y = sums.min[1];
+  stats->min.z = sums.min[2];
+  stats->max.x = sums.max[0];
+  stats->max.y = sums.max[1];
+  stats->max.z = sums.max[2];
+  stats->size.x = stats->max.x - stats->min.x;
+  stats->size.y = stats->max.y - stats->min.y;
+  stats->size.z = stats->max.z - stats->min.z;
+  stats->boundingDiameter =  sqrt(stats->size.x * stats->size.x +
+                                  stats->size.y * stats->size.y +
+                                  stats->size.z * stats->size.z);
+  stats->shortestEdge = chunks.empty() ? 0.0 : sqrt(sums.shortestEdge2);
+  stats->longestEdge = sqrt(sums.longestEdge2);
+  stats->surface = sums.surface;
+  stats->volume = fabs(sums.volume6 / 6.0);
 }
\ No newline at end of file
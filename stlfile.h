@@ -21,16 +21,41 @@
 #ifndef STLFILE_H
 #define STLFILE_H
 
-#include <iostream>
+#include <stdint.h>
 #include <fstream>
 #include <exception>
+#include <string>
+#include <vector>
 
+#include "compressedfile.h"
+#include "mappedfile.h"
 #include "vector.h"
 
+class EdgeAnalysis;
+class IndexedMesh;
+class MeshCache;
+class MeshRepair;
+class MeshShells;
+class MeshValidation;
+
+// StlFile Class - Reads, writes and analyses STL files
+// It doesn't depend on Qt. Errors are thrown as the exceptions below, whose
+// what() tells what went wrong, and warnings are returned by getWarnings().
 class StlFile {
  public:
-  class wrong_header_size : public ::std::exception {};
-  class error_opening_file : public ::std::exception {};
+  class error : public ::std::exception {
+   public:
+    explicit error(const ::std::string& message = "") : message(message) {}
+    ~error() throw() {}
+    const char* what() const throw() { return message.c_str(); }
+   private:
+    ::std::string message;
+  };
+  class wrong_header_size : public error { using error::error; };
+  class error_opening_file : public error { using error::error; };
+  class wrong_file_format : public error { using error::error; };
+  class load_cancelled : public error { using error::error; };
+  class error_writing_file : public error { using error::error; };
   enum Format {
     ASCII,
     BINARY
@@ -40,53 +65,200 @@ class StlFile {
     float y;
     float z;
   } Normal;
+  // A packed position, Vector is only used for the maths
+  typedef struct {
+    float x;
+    float y;
+    float z;
+  } Vertex;
   typedef char Extra[2];
+  // 52 bytes in memory for the 50 bytes of a binary record
   typedef struct {
     Normal normal;
-    Vector vector[3];
+    Vertex vector[3];
     Extra extra;
   } Facet;
+  enum WarningCode {
+    FACET_COUNT_MISMATCH,  // The header doesn't match the size of the file
+    UNCERTAIN_FORMAT       // The format of the file was guessed
+  };
+  typedef struct {
+    WarningCode     code;
+    ::std::string   message;
+  } Warning;
+  typedef struct {
+    Format          format;
+    float           confidence;  // Between 0 (guess) and 1 (certain)
+    ::std::string   reason;
+  } FormatDetection;
   typedef struct {
     ::std::string   header;
     Format          type;
-    int             numFacets;
-    int             numPoints;
+    int64_t         numFacets;
+    int64_t         numPoints;  // -1 if not counted
     Vector          max;
     Vector          min;
     Vector          size;
     float           boundingDiameter;
     float           shortestEdge;
-    float           volume;
-    float           surface;
+    float           longestEdge;
+    double          volume;
+    double          surface;
   } Stats;
+  // Receives the facets of a file block by block, see StlFile::stream()
+  class FacetVisitor {
+   public:
+    virtual ~FacetVisitor() {}
+    virtual void visit(const Facet *block, int64_t numFacets) = 0;
+  };
+  // Follows the progress of StlFile::open(). The calls may come from any of
+  // the threads reading the file, but never two at a time.
+  class ProgressObserver {
+   public:
+    virtual ~ProgressObserver() {}
+    virtual void progress(int64_t bytesRead, int64_t facetsRead) = 0;
+    // Makes StlFile::open() throw load_cancelled when it returns true
+    virtual bool isCancelled() = 0;
+  };
   StlFile();
   ~StlFile();
-  void open(const ::std::string&);
+  // Loads a file. If a cache is set, a file read before is mapped from the
+  // cache with the mesh and what was found from it, if they were stored for
+  // the same weld tolerance. A file read for the first time is only stored
+  // into it by storeInCache().
+  void open(const ::std::string&, ProgressObserver *observer = 0);
+  // Reads a coarse preview of a binary file: every k-th facet, with k chosen
+  // so that at most maxFacets facets are read. Only these facets are read
+  // from the file, so this takes the same time whatever its size. Returns
+  // false, and reads nothing, if the file is ASCII or has no more than
+  // maxFacets facets.
+  bool openPreview(const ::std::string&, int64_t maxFacets);
+  // Writes the file atomically: the facets are written to a temporary file
+  // next to it, which then replaces it. The file is compressed if its name
+  // ends with .gz or .zst.
   void write(const ::std::string&);
+  // Replaces the file by a copy of the facets, as a new binary file with
+  // an empty header
+  void setFacets(const Facet *facets, int64_t numFacets);
   void close();
   void setFormat(const int format);
+  void setCache(MeshCache *cache) { this->cache = cache; };
+  // Stores the file read by the last call to open() into the cache, with
+  // the mesh and what was found from it if they are all known. Returns
+  // false if the file came from the cache, has been changed since it was
+  // read or couldn't be stored. Writing the entry takes a while, so like
+  // getMesh() it can be called from another thread. The stats stored are
+  // those the file was read with, setFormat() may be called meanwhile.
+  bool storeInCache();
   Stats getStats() const { return stats; };
   Facet* getFacets() const { return facets; };
+  // Returns the facets welded into shared vertices, built on the first
+  // call. Its number of vertices is the number of points of the file, which
+  // open() doesn't count. It can be called from another thread as long as
+  // the file isn't changed meanwhile.
+  const IndexedMesh* getMesh();
+  // Sets the distance within which getMesh() welds the vertices together,
+  // 0 to only weld those at the same position, see IndexedMesh. The mesh
+  // and all that was found from it are made again on their next call, so
+  // this mustn't be called while another thread uses them.
+  void setWeldTolerance(float tolerance);
+  float getWeldTolerance() const { return weldTolerance; };
+  // Returns the lengths of the edges of the mesh, measured on the first
+  // call. Like getMesh(), it can be called from another thread.
+  const EdgeAnalysis* getEdgeAnalysis();
+  // Returns the defects of the mesh, found on the first call. Like
+  // getMesh(), it can be called from another thread.
+  const MeshValidation* getValidation();
+  // Returns the disconnected parts of the mesh, found on the first call.
+  // Like getMesh(), it can be called from another thread.
+  const MeshShells* getShells();
+  // Makes reduced copies of the file, one per fraction of its facets, by
+  // decimating its mesh, see MeshDecimator. The fractions go from the
+  // finest to the coarsest, each level being decimated from the one before.
+  // Like getMesh(), it can be called from another thread.
+  void makeLevels(const ::std::vector<double>& fractions);
+  // The number of levels of detail, the file itself being level 0
+  int getNumLevels() const { return static_cast<int>(levels.size()) + 1; };
+  // Returns the file itself for level 0, a reduced copy otherwise
+  StlFile* getLevel(int level);
+  // Makes the winding of the facets consistent and outward, recomputes
+  // their normals and updates the stats, see MeshRepair. The mesh and the
+  // validation are made again on their next call, and the levels of detail
+  // are dropped, so this mustn't be called while another thread uses them.
+  MeshRepair repair();
+  FormatDetection getFormatDetection() const { return formatDetection; };
+  // Returns the warnings raised by the last call to open()
+  ::std::vector<Warning> getWarnings() const { return warnings; };
+  // Guesses the format of an STL file from its size, the number of facets
+  // in its header and a few kB at its beginning and at its end
+  static FormatDetection detectFormat(const char *data, size_t size);
+  static FormatDetection detectFormat(const char *head, size_t headSize,
+                                      const char *tail, size_t tailSize,
+                                      int64_t size);
+  // Reads a file and passes its facets to the visitor in blocks of at most
+  // blockSize facets. Only one block is held in memory at a time, whatever
+  // the size of the file. A compressed file is decompressed on the fly.
+  // Returns the header, the format and the number of facets of the file.
+  static Stats stream(const ::std::string& fileName, FacetVisitor *visitor,
+                      int64_t blockSize = 65536,
+                      ProgressObserver *observer = 0);
+  // Computes the stats of a file without loading all its facets in memory.
+  // The points can't be counted this way, numPoints is set to -1.
+  static Stats readStats(const ::std::string& fileName);
 
  private:
+  class StatsVisitor;
+  class PendingEntry;
   void initialize(const ::std::string&);
+  // Takes the mesh and what was found from it from the cache entry, if it
+  // holds them for the weld tolerance
+  void restoreFromCache();
+  void clearLevels();
   void allocate();
-  void readData(int, int);
-  int readIntFromBytes(::std::ifstream&);
-  float readFloatFromBytes(::std::ifstream&);
-  void writeBytesFromInt(::std::ofstream&, int);
-  void writeBytesFromFloat(::std::ofstream& file, float);
-  void writeBinary(const ::std::string&);
-  void writeAscii(const ::std::string&);
-  int getNumPoints();
-  float getVolume();
-  float getSurface();
-  float getArea(Facet *facet);
-  void calculateNormal(float normal[], Facet *facet);
-  void normalizeVector(float v[]);
-  ::std::ifstream file;
+  void readData();
+  void readBinaryData();
+  void readAsciiData();
+  void readCompressedData(const ::std::string&);
+  bool readCachedData(const ::std::string&);
+  void reportProgress(int64_t bytesRead, int64_t facetsRead);
+  void addWarning(WarningCode code, const ::std::string& message);
+  static void reportStreamProgress(ProgressObserver *observer,
+                                   int64_t bytesRead, int64_t facetsRead);
+  static Stats streamFile(const ::std::string& fileName,
+                          FacetVisitor *visitor, int64_t blockSize,
+                          ProgressObserver *observer,
+                          FormatDetection *detection);
+  static FormatDetection probeFormat(::std::ifstream& file, int64_t fileSize,
+                                     char head[]);
+  static int readIntFromBytes(const char*);
+  static void readFacetFromBytes(Facet*, const char*);
+  static void readFloatsFromBytes(float[], const char*, int);
+  static void writeBytesFromInt(char*, uint32_t);
+  static void writeBytesFromFacet(char*, const Facet*);
+  static void writeBytesFromFloats(char*, const float[], int);
+  void writeBinary(CompressedFile&);
+  void writeAscii(CompressedFile&);
+  MappedFile mappedFile;
+  MeshCache *cache;
+  // Holds the facets when they were read from the cache
+  MappedFile cacheEntry;
+  // The file to store into the cache, 0 unless it was read from the file
+  PendingEntry *pendingEntry;
+  // Whether the facets were repaired since they were read
+  bool repaired;
   Facet *facets;
+  IndexedMesh *mesh;
+  EdgeAnalysis *edgeAnalysis;
+  MeshValidation *validation;
+  MeshShells *shells;
+  // The reduced copies made by makeLevels()
+  ::std::vector<StlFile*> levels;
   Stats stats;
+  FormatDetection formatDetection;
+  ::std::vector<Warning> warnings;
+  ProgressObserver *observer;
+  CompressedFile::Compression compression;
+  float weldTolerance;
 };
 
 #endif  // STLFILE_H
\ No newline at end of file
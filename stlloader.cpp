@@ -0,0 +1,85 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <QtCore/QFileInfo>
+#include <exception>
+#include <new>
+
+#include "stlloader.h"
+
+// Maximum number of facets read for the preview of a file
+#define PREVIEW_MAX_FACETS 100000
+
+StlLoader::StlLoader(StlFile *stlFile, const QString &fileName,
+                     QObject *parent)
+    : QThread(parent), cancelRequested(0) {
+  this->stlFile = stlFile;
+  preview = new StlFile;
+  file = fileName;
+  size = QFileInfo(fileName).size();
+  cancelled = false;
+}
+
+StlLoader::~StlLoader() {
+  cancel();
+  wait();
+  delete preview;
+}
+
+void StlLoader::cancel() {
+  cancelRequested = 1;
+}
+
+void StlLoader::progress(int64_t bytesRead, int64_t facetsRead) {
+  emit progressChanged(bytesRead, facetsRead);
+}
+
+bool StlLoader::isCancelled() {
+  return cancelRequested != 0;
+}
+
+void StlLoader::run() {
+  try {
+    // The preview is only a head start, the file is read in full anyway
+    try {
+      if (preview->openPreview(file.toStdString(), PREVIEW_MAX_FACETS) &&
+          !isCancelled())
+        emit previewReady();
+    } catch (...) {
+      preview->close();
+    }
+    stlFile->open(file.toStdString(), this);
+  } catch (const StlFile::load_cancelled&) {
+    cancelled = true;
+  } catch (const ::std::bad_alloc&) {
+    error = tr("Problem allocating memory.");
+  } catch (const StlFile::wrong_header_size&) {
+    error = tr("The file %1 has a wrong size.").arg(file);
+  } catch (const StlFile::error_opening_file&) {
+    error = tr("The file %1 could not be opened.").arg(file);
+  } catch (const StlFile::wrong_file_format& e) {
+    // Tell what is wrong in the file
+    error = tr("The file %1 is not a valid STL file.\n%2").arg(file)
+        .arg(QString::fromStdString(e.what()));
+  } catch (...) {
+    error = tr("Error unknown.");
+  }
+}
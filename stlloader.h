@@ -0,0 +1,71 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifndef STLLOADER_H
+#define STLLOADER_H
+
+#include <QtCore/QThread>
+#include <QtCore/QAtomicInt>
+
+#include "stlfile.h"
+
+// Opens an STL file in a worker thread, so that the GUI stays responsive
+// while big files are read. A coarse preview of a big binary file is read
+// first, so that something can be shown right away.
+class StlLoader : public QThread, public StlFile::ProgressObserver {
+
+  Q_OBJECT
+
+ public:
+  StlLoader(StlFile *stlFile, const QString &fileName, QObject *parent = 0);
+  ~StlLoader();
+  QString fileName() const { return file; };
+  qint64 fileSize() const { return size; };
+  // Returns the reason why the file couldn't be loaded, empty on success
+  QString errorMessage() const { return error; };
+  // The preview is only valid once previewReady() has been emitted
+  StlFile* previewFile() const { return preview; };
+  bool wasCancelled() const { return cancelled; };
+  void progress(int64_t bytesRead, int64_t facetsRead);
+  bool isCancelled();
+
+ public slots:
+  // Stops the loading as soon as possible, the partial data is freed
+  void cancel();
+
+ signals:
+  void progressChanged(qlonglong bytesRead, qlonglong facetsRead);
+  void previewReady();
+
+ protected:
+  void run();
+
+ private:
+  StlFile *stlFile;
+  StlFile *preview;
+  QString file;
+  qint64 size;
+  QString error;
+  QAtomicInt cancelRequested;
+  bool cancelled;
+};
+
+#endif  // STLLOADER_H
@@ -0,0 +1,516 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+// stltest - Tests of the core, run by ctest
+// The defects are checked on tetrahedra crafted to have each of them, the
+// files are written then read back in every format, truncated files are
+// read, and the results of a larger mesh are compared across numbers of
+// threads. The files are written into the current directory.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "edgeanalysis.h"
+#include "indexedmesh.h"
+#include "meshrepair.h"
+#include "meshshells.h"
+#include "meshvalidation.h"
+#include "parallel.h"
+#include "stlfile.h"
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+typedef StlFile::Facet Facet;
+typedef StlFile::Vertex Vertex;
+
+// The results of a file that must not depend on the number of threads
+typedef struct {
+  ::std::vector<Facet> facets;
+  int64_t numPoints;
+  double volume;
+  double surface;
+  int64_t numFlippedEdges;
+  int64_t numFlaggedFacets;
+  ::std::vector<uint8_t> facetFlags;
+  double meanEdge;
+  float medianEdge;
+  int64_t binCounts[EdgeAnalysis::NUM_BINS];
+  ::std::vector<uint32_t> facetShells;
+  int64_t numFlippedFacets;
+  int64_t numInvertedShells;
+  ::std::vector<Facet> repairedFacets;
+} Results;
+
+static int numFailures = 0;
+
+static void check(bool passed, const char *condition, int line) {
+  if (!passed) {
+    fprintf(stderr, "stltest.cpp:%d: check failed: %s\n", line, condition);
+    numFailures++;
+  }
+}
+
+static Facet makeFacet(const Vertex& a, const Vertex& b, const Vertex& c) {
+  Facet facet;
+  memset(&facet, 0, sizeof(facet));
+  facet.vector[0] = a;
+  facet.vector[1] = b;
+  facet.vector[2] = c;
+  return facet;
+}
+
+static void flipFacet(Facet *facet) {
+  Vertex vertex = facet->vector[1];
+  facet->vector[1] = facet->vector[2];
+  facet->vector[2] = vertex;
+}
+
+// The corner of the unit cube at the origin, its facets facing outwards
+static ::std::vector<Facet> makeTetrahedron() {
+  Vertex p0 = {0.0, 0.0, 0.0};
+  Vertex p1 = {1.0, 0.0, 0.0};
+  Vertex p2 = {0.0, 1.0, 0.0};
+  Vertex p3 = {0.0, 0.0, 1.0};
+  ::std::vector<Facet> facets;
+  facets.push_back(makeFacet(p0, p2, p1));
+  facets.push_back(makeFacet(p0, p1, p3));
+  facets.push_back(makeFacet(p0, p3, p2));
+  facets.push_back(makeFacet(p1, p2, p3));
+  return facets;
+}
+
+// Pseudo-random numbers that are the same on every platform
+static uint32_t nextRandom(uint32_t *seed) {
+  *seed = *seed * 1664525 + 1013904223;
+  return *seed >> 8;
+}
+
+static Vertex getSpherePoint(const Vertex& point, float radius,
+                             const Vertex& center) {
+  float length = sqrtf(point.x * point.x + point.y * point.y +
+                       point.z * point.z);
+  Vertex result = {center.x + point.x / length * radius,
+                   center.y + point.y / length * radius,
+                   center.z + point.z / length * radius};
+  return result;
+}
+
+static Vertex getMiddle(const Vertex& a, const Vertex& b) {
+  Vertex middle = {(a.x + b.x) / 2, (a.y + b.y) / 2, (a.z + b.z) / 2};
+  return middle;
+}
+
+// Adds an octahedron subdivided depth times onto a sphere, 8 * 4^depth
+// facets facing outwards
+static void addSphere(::std::vector<Facet> *facets, const Vertex& center,
+                      float radius, int depth) {
+  Vertex p[6] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0},
+                 {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+  int corners[8][3] = {{0, 2, 4}, {2, 1, 4}, {1, 3, 4}, {3, 0, 4},
+                       {2, 0, 5}, {1, 2, 5}, {3, 1, 5}, {0, 3, 5}};
+  ::std::vector<Facet> sphere;
+  for (int i = 0; i < 8; i++) {
+    sphere.push_back(makeFacet(p[corners[i][0]], p[corners[i][1]],
+                               p[corners[i][2]]));
+  }
+  for (int level = 0; level < depth; level++) {
+    ::std::vector<Facet> finer;
+    for (size_t i = 0; i < sphere.size(); i++) {
+      const Vertex *v = sphere[i].vector;
+      Vertex ab = getMiddle(v[0], v[1]);
+      Vertex bc = getMiddle(v[1], v[2]);
+      Vertex ca = getMiddle(v[2], v[0]);
+      finer.push_back(makeFacet(v[0], ab, ca));
+      finer.push_back(makeFacet(ab, v[1], bc));
+      finer.push_back(makeFacet(ca, bc, v[2]));
+      finer.push_back(makeFacet(ab, bc, ca));
+    }
+    sphere.swap(finer);
+  }
+  for (size_t i = 0; i < sphere.size(); i++) {
+    Facet facet = sphere[i];
+    for (int j = 0; j < 3; j++)
+      facet.vector[j] = getSpherePoint(facet.vector[j], radius, center);
+    facets->push_back(facet);
+  }
+}
+
+// Two spheres, one inside the other, and a third one apart. Some facets
+// are flipped, and the normals and the extra bytes are filled with values
+// that survive a round trip.
+static ::std::vector<Facet> makeSpheres(int depth) {
+  ::std::vector<Facet> facets;
+  Vertex origin = {0.0, 0.0, 0.0};
+  Vertex apart = {30.0, 0.0, 0.0};
+  addSphere(&facets, origin, 10.0, depth);
+  addSphere(&facets, origin, 5.0, depth);
+  addSphere(&facets, apart, 3.0, depth);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < facets.size(); i++) {
+    if (nextRandom(&seed) % 3 == 0)
+      flipFacet(&facets[i]);
+    facets[i].normal.x = static_cast<float>(nextRandom(&seed) % 1000) / 7;
+    facets[i].normal.y = -0.125;
+    facets[i].normal.z = 3e-7f;
+    facets[i].extra[0] = static_cast<char>(i);
+    facets[i].extra[1] = static_cast<char>(i >> 8);
+  }
+  return facets;
+}
+
+// Compares the members one by one, the padding of a facet being undefined
+static bool isSameFacet(const Facet& a, const Facet& b, bool extra) {
+  return memcmp(&a.normal, &b.normal, sizeof(a.normal)) == 0 &&
+         memcmp(a.vector, b.vector, sizeof(a.vector)) == 0 &&
+         (!extra || memcmp(a.extra, b.extra, sizeof(a.extra)) == 0);
+}
+
+static bool isSameFacets(const ::std::vector<Facet>& facets,
+                         const StlFile& stlFile, bool extra) {
+  if (stlFile.getStats().numFacets != static_cast<int64_t>(facets.size()))
+    return false;
+  for (size_t i = 0; i < facets.size(); i++) {
+    if (!isSameFacet(facets[i], stlFile.getFacets()[i], extra))
+      return false;
+  }
+  return true;
+}
+
+static bool hasWarning(const StlFile& stlFile, StlFile::WarningCode code) {
+  ::std::vector<StlFile::Warning> warnings = stlFile.getWarnings();
+  for (size_t i = 0; i < warnings.size(); i++) {
+    if (warnings[i].code == code)
+      return true;
+  }
+  return false;
+}
+
+static bool writeFile(const ::std::string& fileName,
+                      const ::std::vector<Facet>& facets, int format) {
+  try {
+    StlFile stlFile;
+    stlFile.setFacets(facets.data(), facets.size());
+    stlFile.setFormat(format);
+    stlFile.write(fileName);
+    return true;
+  } catch (const ::std::exception& e) {
+    fprintf(stderr, "stltest: %s: %s\n", fileName.c_str(), e.what());
+    return false;
+  }
+}
+
+static ::std::string readBytes(const ::std::string& fileName) {
+  ::std::string bytes;
+  FILE *file = fopen(fileName.c_str(), "rb");
+  if (file == 0)
+    return bytes;
+  char buffer[65536];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    bytes.append(buffer, size);
+  fclose(file);
+  return bytes;
+}
+
+static bool writeBytes(const ::std::string& fileName,
+                       const ::std::string& bytes) {
+  FILE *file = fopen(fileName.c_str(), "wb");
+  if (file == 0)
+    return false;
+  bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+  return fclose(file) == 0 && written;
+}
+
+// Opens a file, returning false instead of throwing
+static bool openFile(StlFile *stlFile, const ::std::string& fileName) {
+  try {
+    stlFile->open(fileName);
+    return true;
+  } catch (const StlFile::error&) {
+    return false;
+  }
+}
+
+static void testClosedTetrahedron() {
+  ::std::vector<Facet> facets = makeTetrahedron();
+  StlFile stlFile;
+  stlFile.setFacets(facets.data(), facets.size());
+  const MeshValidation *validation = stlFile.getValidation();
+  CHECK(stlFile.getMesh()->getNumVertices() == 4);
+  CHECK(validation->getNumEdges() == 6);
+  CHECK(validation->getNumBoundaryEdges() == 0);
+  CHECK(validation->getNumNonManifoldEdges() == 0);
+  CHECK(validation->getNumHoles() == 0);
+  CHECK(validation->getNumFlippedEdges() == 0);
+  CHECK(validation->getNumFlaggedFacets() == 0);
+  CHECK(validation->isWatertight());
+  CHECK(fabs(stlFile.getStats().volume - 1.0 / 6.0) < 1e-6);
+  CHECK(stlFile.getShells()->getNumShells() == 1);
+  MeshRepair repair = stlFile.repair();
+  CHECK(repair.getNumClosedShells() == 1);
+  CHECK(repair.getNumFlippedFacets() == 0);
+}
+
+static void testTetrahedronWithHole() {
+  ::std::vector<Facet> facets = makeTetrahedron();
+  facets.pop_back();
+  StlFile stlFile;
+  stlFile.setFacets(facets.data(), facets.size());
+  const MeshValidation *validation = stlFile.getValidation();
+  CHECK(validation->getNumEdges() == 6);
+  CHECK(validation->getNumBoundaryEdges() == 3);
+  CHECK(validation->getNumHoles() == 1);
+  CHECK(validation->getNumFlippedEdges() == 0);
+  CHECK(validation->getNumFlaggedFacets() == 3);
+  CHECK(!validation->isWatertight());
+  MeshRepair repair = stlFile.repair();
+  CHECK(repair.getNumShells() == 1);
+  CHECK(repair.getNumClosedShells() == 0);
+}
+
+static void testFlippedTetrahedron() {
+  ::std::vector<Facet> facets = makeTetrahedron();
+  flipFacet(&facets[3]);
+  StlFile stlFile;
+  stlFile.setFacets(facets.data(), facets.size());
+  const MeshValidation *validation = stlFile.getValidation();
+  CHECK(validation->getNumFlippedEdges() == 3);
+  CHECK(validation->getNumBoundaryEdges() == 0);
+  CHECK(validation->getNumFlaggedFacets() == 4);
+  CHECK((validation->getFacetFlags()[3] & MeshValidation::FLIPPED) != 0);
+  MeshRepair repair = stlFile.repair();
+  CHECK(repair.getNumFlippedFacets() == 1);
+  CHECK(repair.getNumInvertedShells() == 0);
+  CHECK(stlFile.getValidation()->getNumFlippedEdges() == 0);
+  CHECK(fabs(stlFile.getStats().volume - 1.0 / 6.0) < 1e-6);
+
+  // Turned inside out as a whole, the shell must be inverted
+  facets = makeTetrahedron();
+  for (size_t i = 0; i < facets.size(); i++)
+    flipFacet(&facets[i]);
+  stlFile.setFacets(facets.data(), facets.size());
+  CHECK(stlFile.getValidation()->getNumFlippedEdges() == 0);
+  CHECK(stlFile.getShells()->getShell(0).volume < 0.0);
+  repair = stlFile.repair();
+  CHECK(repair.getNumInvertedShells() == 1);
+  CHECK(repair.getNumFlippedFacets() == 4);
+  CHECK(fabs(stlFile.getStats().volume - 1.0 / 6.0) < 1e-6);
+}
+
+static void testDuplicateFacet() {
+  ::std::vector<Facet> facets = makeTetrahedron();
+  facets.push_back(facets[1]);
+  StlFile stlFile;
+  stlFile.setFacets(facets.data(), facets.size());
+  const MeshValidation *validation = stlFile.getValidation();
+  CHECK(validation->getNumDuplicateFacets() == 1);
+  CHECK((validation->getFacetFlags()[4] & MeshValidation::DUPLICATE) != 0);
+  CHECK((validation->getFacetFlags()[1] & MeshValidation::DUPLICATE) == 0);
+  CHECK(validation->getNumNonManifoldEdges() == 3);
+  CHECK(!validation->isWatertight());
+}
+
+static void testDegenerateFacet() {
+  ::std::vector<Facet> facets = makeTetrahedron();
+  // A sliver apart from the tetrahedron, its corners on a line
+  Vertex a = {5.0, 5.0, 5.0};
+  Vertex b = {6.0, 5.0, 5.0};
+  Vertex c = {7.0, 5.0, 5.0};
+  facets.push_back(makeFacet(a, b, c));
+  StlFile stlFile;
+  stlFile.setFacets(facets.data(), facets.size());
+  const MeshValidation *validation = stlFile.getValidation();
+  CHECK(validation->getNumDegenerateFacets() == 1);
+  CHECK((validation->getFacetFlags()[4] & MeshValidation::DEGENERATE) != 0);
+  CHECK((validation->getFacetFlags()[0] & MeshValidation::DEGENERATE) == 0);
+  CHECK(stlFile.getShells()->getNumShells() == 2);
+}
+
+static void testRoundTrips() {
+  ::std::vector<Facet> facets = makeSpheres(4);
+  const char *fileNames[3] = {"stltest_binary.stl", "stltest_ascii.stl",
+                              "stltest_gzip.stl.gz"};
+  int formats[3] = {StlFile::BINARY, StlFile::ASCII, StlFile::BINARY};
+  for (int i = 0; i < 3; i++) {
+    CHECK(writeFile(fileNames[i], facets, formats[i]));
+    StlFile stlFile;
+    CHECK(openFile(&stlFile, fileNames[i]));
+    CHECK(stlFile.getStats().type == formats[i]);
+    CHECK(stlFile.getWarnings().empty());
+    // The extra bytes have no place in an ASCII file
+    CHECK(isSameFacets(facets, stlFile, formats[i] == StlFile::BINARY));
+    remove(fileNames[i]);
+  }
+}
+
+// The keywords are only keywords outside the name of the solid
+static void testAsciiSolidName() {
+  CHECK(writeBytes("stltest_name.stl",
+                   "solid endfacet\n"
+                   "  facet normal 0 0 1\n"
+                   "    outer loop\n"
+                   "      vertex 0 0 0\n"
+                   "      vertex 1 0 0\n"
+                   "      vertex 0 1 0\n"
+                   "    endloop\n"
+                   "  endfacet\n"
+                   "endsolid endfacet\n"));
+  StlFile stlFile;
+  CHECK(openFile(&stlFile, "stltest_name.stl"));
+  CHECK(stlFile.getStats().numFacets == 1);
+  CHECK(stlFile.getStats().header == "solid endfacet");
+  CHECK(stlFile.getFacets()[0].vector[1].x == 1.0);
+  remove("stltest_name.stl");
+}
+
+static void testTruncatedFiles() {
+  ::std::vector<Facet> facets = makeSpheres(3);
+  int64_t numFacets = facets.size();
+
+  // A binary file missing its last records is read with a warning, but
+  // not one cut in the middle of a record
+  CHECK(writeFile("stltest_cut.stl", facets, StlFile::BINARY));
+  ::std::string bytes = readBytes("stltest_cut.stl");
+  CHECK(writeBytes("stltest_cut.stl", bytes.substr(0, bytes.size() - 100)));
+  StlFile stlFile;
+  CHECK(openFile(&stlFile, "stltest_cut.stl"));
+  CHECK(stlFile.getStats().numFacets == numFacets - 2);
+  CHECK(hasWarning(stlFile, StlFile::FACET_COUNT_MISMATCH));
+  CHECK(writeBytes("stltest_cut.stl", bytes.substr(0, bytes.size() - 20)));
+  CHECK(!openFile(&stlFile, "stltest_cut.stl"));
+  remove("stltest_cut.stl");
+
+  // An ASCII file cut in the middle of a facet
+  CHECK(writeFile("stltest_cut.stl", facets, StlFile::ASCII));
+  bytes = readBytes("stltest_cut.stl");
+  size_t cut = bytes.rfind("vertex");
+  CHECK(writeBytes("stltest_cut.stl", bytes.substr(0, cut + 8)));
+  CHECK(!openFile(&stlFile, "stltest_cut.stl"));
+  remove("stltest_cut.stl");
+
+  // A gzip stream cut in half
+  CHECK(writeFile("stltest_cut.stl.gz", facets, StlFile::BINARY));
+  bytes = readBytes("stltest_cut.stl.gz");
+  CHECK(writeBytes("stltest_cut.stl.gz", bytes.substr(0, bytes.size() / 2)));
+  CHECK(!openFile(&stlFile, "stltest_cut.stl.gz"));
+  remove("stltest_cut.stl.gz");
+}
+
+static Results getResults(const ::std::string& fileName) {
+  Results results;
+  StlFile stlFile;
+  stlFile.open(fileName);
+  StlFile::Stats stats = stlFile.getStats();
+  results.facets.assign(stlFile.getFacets(),
+                        stlFile.getFacets() + stats.numFacets);
+  results.numPoints = stlFile.getMesh()->getNumVertices();
+  results.volume = stats.volume;
+  results.surface = stats.surface;
+  const MeshValidation *validation = stlFile.getValidation();
+  results.numFlippedEdges = validation->getNumFlippedEdges();
+  results.numFlaggedFacets = validation->getNumFlaggedFacets();
+  results.facetFlags.assign(validation->getFacetFlags(),
+                            validation->getFacetFlags() + stats.numFacets);
+  const EdgeAnalysis *edgeAnalysis = stlFile.getEdgeAnalysis();
+  results.meanEdge = edgeAnalysis->getMean();
+  results.medianEdge = edgeAnalysis->getMedian();
+  for (int bin = 0; bin < EdgeAnalysis::NUM_BINS; bin++)
+    results.binCounts[bin] = edgeAnalysis->getBinCount(bin);
+  const MeshShells *shells = stlFile.getShells();
+  results.facetShells.assign(shells->getFacetShells(),
+                             shells->getFacetShells() + stats.numFacets);
+  MeshRepair repair = stlFile.repair();
+  results.numFlippedFacets = repair.getNumFlippedFacets();
+  results.numInvertedShells = repair.getNumInvertedShells();
+  results.repairedFacets.assign(stlFile.getFacets(),
+                                stlFile.getFacets() + stats.numFacets);
+  return results;
+}
+
+static bool isSameResults(const Results& a, const Results& b) {
+  if (a.facets.size() != b.facets.size() ||
+      a.repairedFacets.size() != b.repairedFacets.size())
+    return false;
+  for (size_t i = 0; i < a.facets.size(); i++) {
+    if (!isSameFacet(a.facets[i], b.facets[i], true) ||
+        !isSameFacet(a.repairedFacets[i], b.repairedFacets[i], true))
+      return false;
+  }
+  return a.numPoints == b.numPoints && a.volume == b.volume &&
+         a.surface == b.surface && a.numFlippedEdges == b.numFlippedEdges &&
+         a.numFlaggedFacets == b.numFlaggedFacets &&
+         a.facetFlags == b.facetFlags && a.meanEdge == b.meanEdge &&
+         a.medianEdge == b.medianEdge &&
+         memcmp(a.binCounts, b.binCounts, sizeof(a.binCounts)) == 0 &&
+         a.facetShells == b.facetShells &&
+         a.numFlippedFacets == b.numFlippedFacets &&
+         a.numInvertedShells == b.numInvertedShells;
+}
+
+static void testThreadCounts() {
+  // Enough facets for several blocks, and several chunks of ASCII
+  ::std::vector<Facet> facets = makeSpheres(6);
+  const char *fileNames[2] = {"stltest_threads.stl",
+                              "stltest_threads_ascii.stl"};
+  int formats[2] = {StlFile::BINARY, StlFile::ASCII};
+  int threads[3] = {2, 3, 8};
+  for (int i = 0; i < 2; i++) {
+    CHECK(writeFile(fileNames[i], facets, formats[i]));
+    try {
+      Parallel::setNumThreads(1);
+      Results expected = getResults(fileNames[i]);
+      CHECK(expected.numFlippedFacets > 0);
+      CHECK(expected.numInvertedShells > 0);
+      for (int k = 0; k < 3; k++) {
+        Parallel::setNumThreads(threads[k]);
+        CHECK(isSameResults(getResults(fileNames[i]), expected));
+      }
+    } catch (const ::std::exception& e) {
+      fprintf(stderr, "stltest: %s: %s\n", fileNames[i], e.what());
+      numFailures++;
+    }
+    Parallel::setNumThreads(0);
+    remove(fileNames[i]);
+  }
+}
+
+int main() {
+  testClosedTetrahedron();
+  testTetrahedronWithHole();
+  testFlippedTetrahedron();
+  testDuplicateFacet();
+  testDegenerateFacet();
+  testRoundTrips();
+  testAsciiSolidName();
+  testTruncatedFiles();
+  testThreadCounts();
+  if (numFailures > 0) {
+    fprintf(stderr, "stltest: %d checks failed\n", numFailures);
+    return 1;
+  }
+  printf("stltest: all checks passed\n");
+  return 0;
+}
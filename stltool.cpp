@@ -0,0 +1,676 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+// stltool - Converts STL files and reports their stats from the command line
+// The files are processed on a pool of threads, one file per thread at a
+// time. The stats are written to the standard output as JSON Lines or CSV,
+// with the time taken by each file.
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <glob.h>
+#endif
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "compressedfile.h"
+#include "parallel.h"
+#include "indexedmesh.h"
+#include "meshrepair.h"
+#include "meshslicer.h"
+#include "stlfile.h"
+
+typedef struct {
+  ::std::string outputDir;
+  bool convert;
+  bool repair;
+  float weldTolerance;
+  float layerHeight;  // 0 if the files aren't sliced
+  enum {CLI, SVG} sliceFormat;
+  double fraction;  // 0 if the files aren't decimated
+  StlFile::Format format;
+  CompressedFile::Compression compression;
+  enum {NONE, JSONL, CSV} statsFormat;
+  int jobs;
+  int threads;
+  bool recursive;
+} Options;
+
+typedef struct {
+  ::std::string fileName;
+  // The path of the outputs below the output directory, without their
+  // extension. It keeps the subdirectories the file was found in.
+  ::std::string outputName;
+  // The file whose outputs have the same names, if any. They aren't
+  // written twice.
+  ::std::string clash;
+} Input;
+
+typedef struct {
+  ::std::string fileName;
+  ::std::string outputFileName;
+  ::std::string error;
+  ::std::vector<StlFile::Warning> warnings;
+  StlFile::Stats stats;
+  MeshRepair repair;
+  int64_t numLayers;
+  int64_t numPolygons;
+  int64_t numOpenPolygons;
+  ::std::string sliceFileName;
+  int64_t numDecimatedFacets;
+  ::std::string decimatedFileName;
+  CompressedFile::Compression compression;
+  int64_t fileSize;
+  double seconds;
+} Result;
+
+static void printUsage() {
+  fprintf(stderr,
+      "Usage: stltool [options] <file|directory|pattern>...\n"
+      "Converts STL files and reports their stats.\n"
+      "\n"
+      "  -s, --stats jsonl|csv   Write the stats of each file to the\n"
+      "                          standard output\n"
+      "  -f, --format binary|ascii\n"
+      "                          Convert the files to this format\n"
+      "  -c, --compress none|gzip|zstd\n"
+      "                          Compress the converted files\n"
+      "  -R, --repair            Orient the facets consistently and\n"
+      "                          recompute their normals before\n"
+      "                          converting the files\n"
+      "  -w, --weld TOLERANCE    Weld the vertices closer than TOLERANCE\n"
+      "                          before counting the points, repairing,\n"
+      "                          slicing or decimating the files\n"
+      "  -l, --slice HEIGHT      Slice the files into layers of HEIGHT\n"
+      "      --slice-format cli|svg\n"
+      "                          Write the layers into a CLI file, the\n"
+      "                          default, or into an SVG file per layer\n"
+      "  -d, --decimate FRACTION Write a copy of the files reduced to\n"
+      "                          FRACTION of their facets\n"
+      "  -o, --output-dir DIR    Write the converted files into DIR\n"
+      "  -j, --jobs N            Number of files processed at a time,\n"
+      "                          one per core by default\n"
+      "  -t, --threads N         Number of threads used for a single file\n"
+      "                          when only one is processed at a time\n"
+      "  -r, --recursive         Look for files in subdirectories too\n"
+      "  -h, --help              Show this help\n"
+      "\n"
+      "Directories are searched for *.stl, *.stl.gz and *.stl.zst files.\n"
+      "The outputs keep the subdirectories the files were found in.\n");
+}
+
+static ::std::string toLower(::std::string s) {
+  for (size_t i = 0; i < s.size(); i++)
+    s[i] = tolower(static_cast<unsigned char>(s[i]));
+  return s;
+}
+
+static bool endsWith(const ::std::string& s, const char *suffix) {
+  size_t length = strlen(suffix);
+  return s.size() >= length &&
+         s.compare(s.size() - length, length, suffix) == 0;
+}
+
+static bool isStlFileName(const ::std::string& fileName) {
+  ::std::string name = toLower(fileName);
+  return endsWith(name, ".stl") || endsWith(name, ".stl.gz") ||
+         endsWith(name, ".stl.zst");
+}
+
+static bool isDirectory(const ::std::string& path) {
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 && (info.st_mode & S_IFDIR) != 0;
+}
+
+// Returns the name of a file without its directory nor its extensions
+static ::std::string getBaseName(const ::std::string& fileName) {
+  ::std::string name = fileName;
+  size_t separator = name.find_last_of("/\\");
+  if (separator != ::std::string::npos)
+    name = name.substr(separator + 1);
+  ::std::string lowerName = toLower(name);
+  if (endsWith(lowerName, ".gz"))
+    name.resize(name.size() - 3);
+  else if (endsWith(lowerName, ".zst"))
+    name.resize(name.size() - 4);
+  if (endsWith(toLower(name), ".stl"))
+    name.resize(name.size() - 4);
+  return name;
+}
+
+static void addInput(const ::std::string& fileName,
+                     const ::std::string& subdirectory,
+                     ::std::vector<Input>& files) {
+  Input input;
+  input.fileName = fileName;
+  input.outputName = subdirectory + getBaseName(fileName);
+  files.push_back(input);
+}
+
+// The subdirectory is the path of the directory below the one given on the
+// command line, ending with a separator
+static void listDirectory(const ::std::string& directory,
+                          const ::std::string& subdirectory, bool recursive,
+                          ::std::vector<Input>& files) {
+  ::std::vector< ::std::string> names;
+#ifdef _WIN32
+  WIN32_FIND_DATAA findData;
+  HANDLE find = FindFirstFileA((directory + "/*").c_str(), &findData);
+  if (find != INVALID_HANDLE_VALUE) {
+    do {
+      names.push_back(findData.cFileName);
+    } while (FindNextFileA(find, &findData));
+    FindClose(find);
+  }
+#else
+  DIR *dir = opendir(directory.c_str());
+  if (dir != 0) {
+    while (struct dirent *entry = readdir(dir))
+      names.push_back(entry->d_name);
+    closedir(dir);
+  }
+#endif
+  // List the files in a stable order
+  ::std::sort(names.begin(), names.end());
+  for (size_t i = 0; i < names.size(); i++) {
+    if (names[i] == "." || names[i] == "..")
+      continue;
+    ::std::string path = directory + "/" + names[i];
+    if (isDirectory(path)) {
+      if (recursive)
+        listDirectory(path, subdirectory + names[i] + "/", recursive, files);
+    } else if (isStlFileName(names[i])) {
+      addInput(path, subdirectory, files);
+    }
+  }
+}
+
+// Expands a pattern the shell didn't expand, as Windows shells don't
+static void expandPattern(const ::std::string& pattern,
+                          ::std::vector<Input>& files) {
+#ifdef _WIN32
+  ::std::string directory;
+  size_t separator = pattern.find_last_of("/\\");
+  if (separator != ::std::string::npos)
+    directory = pattern.substr(0, separator + 1);
+  ::std::vector< ::std::string> names;
+  WIN32_FIND_DATAA findData;
+  HANDLE find = FindFirstFileA(pattern.c_str(), &findData);
+  if (find != INVALID_HANDLE_VALUE) {
+    do {
+      if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        names.push_back(directory + findData.cFileName);
+    } while (FindNextFileA(find, &findData));
+    FindClose(find);
+  }
+  ::std::sort(names.begin(), names.end());
+  for (size_t i = 0; i < names.size(); i++)
+    addInput(names[i], "", files);
+#else
+  glob_t matches;
+  if (glob(pattern.c_str(), 0, 0, &matches) == 0) {
+    for (size_t i = 0; i < matches.gl_pathc; i++)
+      addInput(matches.gl_pathv[i], "", files);
+  }
+  globfree(&matches);
+#endif
+}
+
+// Creates the subdirectories of the output directory an output name goes
+// into, if they don't exist yet
+static void makeOutputDirectories(const ::std::string& outputDir,
+                                  const ::std::string& outputName) {
+  for (size_t separator = outputName.find('/');
+       separator != ::std::string::npos;
+       separator = outputName.find('/', separator + 1)) {
+    ::std::string path = outputDir + "/" + outputName.substr(0, separator);
+#ifdef _WIN32
+    CreateDirectoryA(path.c_str(), 0);
+#else
+    mkdir(path.c_str(), 0777);
+#endif
+  }
+}
+
+static ::std::string getOutputFileName(const Input& input,
+                                       const Options& options,
+                                       const char *suffix = "") {
+  // Replace the directory, the compression extension and the format
+  ::std::string name = input.outputName + suffix + ".stl";
+  if (options.compression == CompressedFile::GZIP)
+    name += ".gz";
+  else if (options.compression == CompressedFile::ZSTD)
+    name += ".zst";
+  return options.outputDir + "/" + name;
+}
+
+static ::std::string escapeJson(const ::std::string& s) {
+  ::std::string escaped;
+  for (size_t i = 0; i < s.size(); i++) {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c < 0x20) {
+      char code[8];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      escaped += code;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+static ::std::string escapeCsv(const ::std::string& s) {
+  if (s.find_first_of(",\"\r\n") == ::std::string::npos)
+    return s;
+  ::std::string escaped = "\"";
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '"')
+      escaped += '"';
+    escaped += s[i];
+  }
+  return escaped + "\"";
+}
+
+static const char* getCompressionName(CompressedFile::Compression c) {
+  if (c == CompressedFile::GZIP)
+    return "gzip";
+  if (c == CompressedFile::ZSTD)
+    return "zstd";
+  return "none";
+}
+
+static double getThroughput(const Result& result) {
+  return result.seconds > 0 ?
+      result.fileSize / (1024.0 * 1024.0) / result.seconds : 0.0;
+}
+
+static void printCsvHeader() {
+  printf("file,status,error,format,compression,facets,points,"
+         "min_x,min_y,min_z,max_x,max_y,max_z,size_x,size_y,size_z,"
+         "surface,volume,warnings,bytes,seconds,mb_per_s,output\n");
+}
+
+static void printCsv(const Result& result) {
+  const StlFile::Stats& s = result.stats;
+  bool ok = result.error.empty();
+  printf("%s,%s,%s,", escapeCsv(result.fileName).c_str(),
+         ok ? "ok" : "error", escapeCsv(result.error).c_str());
+  if (ok) {
+    printf("%s,%s,%lld,%lld,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,"
+           "%.17g,%.17g,", s.type == StlFile::ASCII ? "ascii" : "binary",
+           getCompressionName(result.compression),
+           static_cast<long long>(s.numFacets),
+           static_cast<long long>(s.numPoints), s.min.x, s.min.y, s.min.z,
+           s.max.x, s.max.y, s.max.z, s.size.x, s.size.y, s.size.z,
+           s.surface, s.volume);
+  } else {
+    printf(",,,,,,,,,,,,,,,");
+  }
+  ::std::string warnings;
+  for (size_t i = 0; i < result.warnings.size(); i++)
+    warnings += (i > 0 ? " " : "") + result.warnings[i].message;
+  printf("%s,", escapeCsv(warnings).c_str());
+  printf("%lld,%.6f,%.3f,%s\n", static_cast<long long>(result.fileSize),
+         result.seconds, getThroughput(result),
+         escapeCsv(result.outputFileName).c_str());
+}
+
+static void printJson(const Result& result) {
+  const StlFile::Stats& s = result.stats;
+  printf("{\"file\":\"%s\"", escapeJson(result.fileName).c_str());
+  if (result.error.empty()) {
+    printf(",\"status\":\"ok\",\"format\":\"%s\",\"compression\":\"%s\","
+           "\"header\":\"%s\",\"facets\":%lld,\"points\":%lld,"
+           "\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g],"
+           "\"size\":[%.9g,%.9g,%.9g],\"surface\":%.17g,\"volume\":%.17g",
+           s.type == StlFile::ASCII ? "ascii" : "binary",
+           getCompressionName(result.compression),
+           escapeJson(s.header).c_str(), static_cast<long long>(s.numFacets),
+           static_cast<long long>(s.numPoints), s.min.x, s.min.y, s.min.z,
+           s.max.x, s.max.y, s.max.z, s.size.x, s.size.y, s.size.z,
+           s.surface, s.volume);
+  } else {
+    printf(",\"status\":\"error\",\"error\":\"%s\"",
+           escapeJson(result.error).c_str());
+  }
+  if (!result.warnings.empty()) {
+    printf(",\"warnings\":[");
+    for (size_t i = 0; i < result.warnings.size(); i++)
+      printf("%s\"%s\"", i > 0 ? "," : "",
+             escapeJson(result.warnings[i].message).c_str());
+    printf("]");
+  }
+  if (result.error.empty() && result.repair.getNumShells() > 0) {
+    const MeshRepair& r = result.repair;
+    printf(",\"repair\":{\"shells\":%lld,\"closed_shells\":%lld,"
+           "\"flipped_facets\":%lld,\"inverted_shells\":%lld,"
+           "\"non_orientable_shells\":%lld}",
+           static_cast<long long>(r.getNumShells()),
+           static_cast<long long>(r.getNumClosedShells()),
+           static_cast<long long>(r.getNumFlippedFacets()),
+           static_cast<long long>(r.getNumInvertedShells()),
+           static_cast<long long>(r.getNumNonOrientableShells()));
+  }
+  if (!result.sliceFileName.empty()) {
+    printf(",\"slice\":{\"layers\":%lld,\"polygons\":%lld,"
+           "\"open_polygons\":%lld,\"output\":\"%s\"}",
+           static_cast<long long>(result.numLayers),
+           static_cast<long long>(result.numPolygons),
+           static_cast<long long>(result.numOpenPolygons),
+           escapeJson(result.sliceFileName).c_str());
+  }
+  if (!result.decimatedFileName.empty()) {
+    printf(",\"decimate\":{\"facets\":%lld,\"output\":\"%s\"}",
+           static_cast<long long>(result.numDecimatedFacets),
+           escapeJson(result.decimatedFileName).c_str());
+  }
+  if (!result.outputFileName.empty())
+    printf(",\"output\":\"%s\"", escapeJson(result.outputFileName).c_str());
+  printf(",\"bytes\":%lld,\"seconds\":%.6f,\"mb_per_s\":%.3f}\n",
+         static_cast<long long>(result.fileSize), result.seconds,
+         getThroughput(result));
+}
+
+static void processFile(const Input& input, const Options& options,
+                        Result *result) {
+  const ::std::string& fileName = input.fileName;
+  ::std::chrono::steady_clock::time_point start =
+      ::std::chrono::steady_clock::now();
+  result->fileName = fileName;
+  result->fileSize = 0;
+  result->compression = CompressedFile::NONE;
+  struct stat info;
+  if (stat(fileName.c_str(), &info) == 0)
+    result->fileSize = info.st_size;
+  try {
+    if (!input.clash.empty())
+      throw StlFile::error("Its outputs would overwrite those of " +
+                           input.clash + ".");
+    CompressedFile file;
+    if (file.openForReading(fileName))
+      result->compression = file.getCompression();
+    file.close();
+    StlFile stlFile;
+    stlFile.open(fileName);
+    stlFile.setWeldTolerance(options.weldTolerance);
+    if (options.repair)
+      result->repair = stlFile.repair();
+    result->stats = stlFile.getStats();
+    result->stats.numPoints = stlFile.getMesh()->getNumVertices();
+    result->warnings = stlFile.getWarnings();
+    if (options.convert) {
+      result->outputFileName = getOutputFileName(input, options);
+      stlFile.setFormat(options.format);
+      stlFile.write(result->outputFileName);
+    }
+    if (options.layerHeight > 0.0) {
+      MeshSlicer slicer;
+      slicer.slice(stlFile.getMesh(), result->stats.min.z,
+                   result->stats.max.z, options.layerHeight);
+      ::std::string name = options.outputDir + "/" + input.outputName;
+      if (options.sliceFormat == Options::SVG) {
+        result->sliceFileName = name + "_";
+        slicer.writeSvg(result->sliceFileName);
+      } else {
+        result->sliceFileName = name + ".cli";
+        slicer.writeCli(result->sliceFileName);
+      }
+      result->numLayers = slicer.getNumLayers();
+      result->numPolygons = slicer.getNumPolygons();
+      result->numOpenPolygons = slicer.getNumOpenPolygons();
+    }
+    if (options.fraction > 0.0) {
+      stlFile.makeLevels(::std::vector<double>(1, options.fraction));
+      StlFile *level = stlFile.getLevel(1);
+      result->decimatedFileName = getOutputFileName(input, options,
+                                                    "_decimated");
+      level->setFormat(options.format);
+      level->write(result->decimatedFileName);
+      result->numDecimatedFacets = level->getStats().numFacets;
+    }
+  } catch (const ::std::bad_alloc&) {
+    result->error = "Problem allocating memory.";
+  } catch (const ::std::exception& e) {
+    result->error = e.what();
+    if (result->error.empty())
+      result->error = "Error unknown.";
+  }
+  result->seconds = ::std::chrono::duration<double>(
+      ::std::chrono::steady_clock::now() - start).count();
+}
+
+static bool parseOptions(int argc, char *argv[], Options *options,
+                         ::std::vector< ::std::string>& inputs) {
+  options->convert = false;
+  options->repair = false;
+  options->weldTolerance = 0.0;
+  options->layerHeight = 0.0;
+  options->sliceFormat = Options::CLI;
+  options->fraction = 0.0;
+  options->format = StlFile::BINARY;
+  options->compression = CompressedFile::NONE;
+  options->statsFormat = Options::NONE;
+  options->jobs = 0;
+  options->threads = 0;
+  options->recursive = false;
+  bool hasFormat = false;
+  bool hasCompression = false;
+  for (int i = 1; i < argc; i++) {
+    ::std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    ::std::string value = hasValue ? argv[i + 1] : "";
+    if (arg == "-h" || arg == "--help") {
+      printUsage();
+      exit(0);
+    } else if (arg == "-r" || arg == "--recursive") {
+      options->recursive = true;
+    } else if (arg == "-R" || arg == "--repair") {
+      options->repair = true;
+    } else if ((arg == "-s" || arg == "--stats") && hasValue) {
+      if (value == "jsonl")
+        options->statsFormat = Options::JSONL;
+      else if (value == "csv")
+        options->statsFormat = Options::CSV;
+      else
+        return false;
+      i++;
+    } else if ((arg == "-f" || arg == "--format") && hasValue) {
+      if (value == "binary")
+        options->format = StlFile::BINARY;
+      else if (value == "ascii")
+        options->format = StlFile::ASCII;
+      else
+        return false;
+      hasFormat = true;
+      i++;
+    } else if ((arg == "-c" || arg == "--compress") && hasValue) {
+      if (value == "none")
+        options->compression = CompressedFile::NONE;
+      else if (value == "gzip")
+        options->compression = CompressedFile::GZIP;
+      else if (value == "zstd")
+        options->compression = CompressedFile::ZSTD;
+      else
+        return false;
+      if (!CompressedFile::isSupported(options->compression)) {
+        fprintf(stderr, "stltool: %s compression is not supported by this "
+                "build.\n", value.c_str());
+        exit(2);
+      }
+      hasCompression = true;
+      i++;
+    } else if ((arg == "-w" || arg == "--weld") && hasValue) {
+      options->weldTolerance = static_cast<float>(atof(value.c_str()));
+      if (!(options->weldTolerance >= 0.0))
+        return false;
+      i++;
+    } else if ((arg == "-l" || arg == "--slice") && hasValue) {
+      options->layerHeight = static_cast<float>(atof(value.c_str()));
+      if (!(options->layerHeight > 0.0))
+        return false;
+      i++;
+    } else if (arg == "--slice-format" && hasValue) {
+      if (value == "cli")
+        options->sliceFormat = Options::CLI;
+      else if (value == "svg")
+        options->sliceFormat = Options::SVG;
+      else
+        return false;
+      i++;
+    } else if ((arg == "-d" || arg == "--decimate") && hasValue) {
+      options->fraction = atof(value.c_str());
+      if (!(options->fraction > 0.0 && options->fraction < 1.0))
+        return false;
+      i++;
+    } else if ((arg == "-o" || arg == "--output-dir") && hasValue) {
+      options->outputDir = value;
+      i++;
+    } else if ((arg == "-j" || arg == "--jobs") && hasValue) {
+      options->jobs = atoi(value.c_str());
+      i++;
+    } else if ((arg == "-t" || arg == "--threads") && hasValue) {
+      options->threads = atoi(value.c_str());
+      i++;
+    } else if (!arg.empty() && arg[0] == '-') {
+      return false;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+  options->convert = hasFormat || hasCompression || options->repair;
+  // The files are converted into another directory, never over themselves
+  if (options->convert && options->outputDir.empty()) {
+    fprintf(stderr, "stltool: --output-dir is needed to convert files.\n");
+    return false;
+  }
+  if (options->layerHeight > 0.0 && options->outputDir.empty()) {
+    fprintf(stderr, "stltool: --output-dir is needed to slice files.\n");
+    return false;
+  }
+  if (options->fraction > 0.0 && options->outputDir.empty()) {
+    fprintf(stderr,
+            "stltool: --output-dir is needed to decimate files.\n");
+    return false;
+  }
+  if (!options->convert && options->layerHeight == 0.0 &&
+      options->fraction == 0.0 && options->statsFormat == Options::NONE)
+    options->statsFormat = Options::JSONL;
+  return !inputs.empty();
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  ::std::vector< ::std::string> inputs;
+  if (!parseOptions(argc, argv, &options, inputs)) {
+    printUsage();
+    return 2;
+  }
+  ::std::vector<Input> files;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (isDirectory(inputs[i])) {
+      listDirectory(inputs[i], "", options.recursive, files);
+    } else if (inputs[i].find_first_of("*?[") != ::std::string::npos) {
+      expandPattern(inputs[i], files);
+    } else {
+      addInput(inputs[i], "", files);
+    }
+  }
+  bool hasOutputs = options.convert || options.layerHeight > 0.0 ||
+                    options.fraction > 0.0;
+  if (hasOutputs && !isDirectory(options.outputDir)) {
+    fprintf(stderr, "stltool: %s is not a directory.\n",
+            options.outputDir.c_str());
+    return 2;
+  }
+  if (hasOutputs) {
+    // The files processed at the same time mustn't write the same outputs,
+    // whose names only differ by their case on some file systems
+    ::std::map< ::std::string, size_t> outputs;
+    for (size_t i = 0; i < files.size(); i++) {
+      ::std::pair< ::std::map< ::std::string, size_t>::iterator, bool>
+          output = outputs.insert(::std::make_pair(
+              toLower(files[i].outputName), i));
+      if (!output.second)
+        files[i].clash = files[output.first->second].fileName;
+      else
+        makeOutputDirectories(options.outputDir, files[i].outputName);
+    }
+  }
+  if (options.statsFormat == Options::CSV)
+    printCsvHeader();
+  // The files are spread over the jobs. A single job runs the parallel
+  // parts of the loading on the threads given by --threads instead.
+  int jobs = options.jobs > 0 ? options.jobs : Parallel::getNumThreads();
+  int threadsPerFile = options.threads > 0 ? options.threads :
+                                             Parallel::getNumThreads();
+  ::std::chrono::steady_clock::time_point start =
+      ::std::chrono::steady_clock::now();
+  ::std::mutex outputMutex;
+  ::std::atomic<int> numFailed(0);
+  ::std::atomic<int64_t> numBytes(0);
+  Parallel::setNumThreads(jobs);
+  auto processTask = [&](int i) {
+    Result result;
+    processFile(files[i], options, &result);
+    numBytes += result.fileSize;
+    ::std::lock_guard< ::std::mutex> lock(outputMutex);
+    if (!result.error.empty()) {
+      numFailed++;
+      fprintf(stderr, "stltool: %s: %s\n", result.fileName.c_str(),
+              result.error.c_str());
+    }
+    if (options.statsFormat == Options::JSONL)
+      printJson(result);
+    else if (options.statsFormat == Options::CSV)
+      printCsv(result);
+    fflush(stdout);
+  };
+  if (jobs == 1) {
+    Parallel::setNumThreads(threadsPerFile);
+    for (size_t i = 0; i < files.size(); i++)
+      processTask(static_cast<int>(i));
+  } else {
+    Parallel::run(static_cast<int>(files.size()), processTask);
+  }
+  double seconds = ::std::chrono::duration<double>(
+      ::std::chrono::steady_clock::now() - start).count();
+  fprintf(stderr, "stltool: %d files, %d failed, %.1f MB in %.3f s "
+          "(%.1f MB/s, %.1f files/s)\n", static_cast<int>(files.size()),
+          static_cast<int>(numFailed), numBytes / (1024.0 * 1024.0), seconds,
+          seconds > 0 ? numBytes / (1024.0 * 1024.0) / seconds : 0.0,
+          seconds > 0 ? files.size() / seconds : 0.0);
+  return numFailed > 0 ? 1 : 0;
+}
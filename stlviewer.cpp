@@ -26,11 +26,17 @@
 #include "stlviewer.h"
 #include "axisgroupbox.h"
 #include "dimensionsgroupbox.h"
+#include "meshcache.h"
 #include "meshinformationgroupbox.h"
 #include "propertiesgroupbox.h"
+#include "sectiongroupbox.h"
+#include "shellsgroupbox.h"
+#include "validationgroupbox.h"
 
 STLViewer::STLViewer(QWidget *parent, Qt::WFlags flags)
     : QMainWindow(parent, flags) {
+  meshCache = 0;
+  weldTolerance = 0.0;
   mdiArea = new QMdiArea;
   mdiArea->setHorizontalScrollBarPolicy(Qt::ScrollBarAsNeeded);
   mdiArea->setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
@@ -54,7 +60,10 @@ STLViewer::STLViewer(QWidget *parent, Qt::WFlags flags)
   setUnifiedTitleAndToolBarOnMac(true);
 }
 
-STLViewer::~STLViewer() {}
+STLViewer::~STLViewer() {
+  // The windows, and so their loaders, are closed at this point
+  delete meshCache;
+}
 
 void STLViewer::closeEvent(QCloseEvent *event) {
   mdiArea->closeAllSubWindows();
@@ -79,7 +88,7 @@ void STLViewer::newFile() {
 
 void STLViewer::open() {
   QString fileName = QFileDialog::getOpenFileName(this, tr("Open a file"),
-    curDir, tr("STL Files (*.stl);;All Files (*.*)"));
+    curDir, tr("STL Files (*.stl *.stl.gz *.stl.zst);;All Files (*.*)"));
   if (!fileName.isEmpty()) {
     curDir = QFileInfo(fileName).filePath();
     QMdiSubWindow *existing = findGLMdiChild(fileName);
@@ -89,7 +98,8 @@ void STLViewer::open() {
     }
     GLMdiChild *child = createGLMdiChild();
     if (child->loadFile(fileName)) {
-      statusBar()->showMessage(tr("File loaded"), 2000);
+      // The file is loaded in the background, see loadingFinished()
+      statusBar()->showMessage(tr("Loading file..."), 2000);
       child->show();
     } else {
       setActiveSubWindow(child);
@@ -114,6 +124,32 @@ void STLViewer::saveImage() {
     statusBar()->showMessage(tr("Image saved"), 2000);
 }
 
+void STLViewer::cancelLoading() {
+  if (activeGLMdiChild())
+    activeGLMdiChild()->cancelLoading();
+}
+
+void STLViewer::updateLoadingProgress(int percent, qlonglong facetsRead) {
+  // Only follow the loading of the active window
+  if (sender() != activeGLMdiChild())
+    return;
+  loadingProgressBar->setValue(percent);
+  loadingProgressBar->setFormat(tr("%p% (%1 facets)").arg(facetsRead));
+}
+
+void STLViewer::loadingFinished(bool loaded) {
+  GLMdiChild *child = qobject_cast<GLMdiChild *>(sender());
+  if (!child)
+    return;
+  if (loaded) {
+    statusBar()->showMessage(tr("File loaded"), 2000);
+  } else {
+    // Close the window of a file that couldn't be loaded
+    child->parentWidget()->close();
+  }
+  updateMenus();
+}
+
 void STLViewer::rotate() {
   if (rotateAct->isChecked()) {
     panningAct->setChecked(false);
@@ -139,6 +175,92 @@ void STLViewer::wireframe() {
   //emit wireframeStatusChanged(wireframeAct->isChecked());
 }
 
+void STLViewer::highlightDefects() {
+  activeGLMdiChild()->setHighlightMode(highlightDefectsAct->isChecked());
+}
+
+void STLViewer::setLevel(QAction *action) {
+  if (activeGLMdiChild())
+    activeGLMdiChild()->setLevel(levelActs.indexOf(action));
+  updateMenus();
+}
+
+void STLViewer::repair() {
+  // The child tells what was repaired once it's done
+  if (activeGLMdiChild() && activeGLMdiChild()->repair())
+    statusBar()->showMessage(tr("Repairing the mesh..."), 2000);
+}
+
+void STLViewer::slice() {
+  if (activeGLMdiChild() && activeGLMdiChild()->slice())
+    statusBar()->showMessage(tr("Layers exported"), 2000);
+}
+
+void STLViewer::setWeldTolerance() {
+  bool ok;
+  double tolerance = QInputDialog::getDouble(
+      this, tr("Weld Tolerance"),
+      tr("Weld the vertices closer than:"), weldTolerance, 0.0,
+      1.0e6, 6, &ok);
+  if (!ok)
+    return;
+  // It applies to the window shown and to the files opened from now on
+  weldTolerance = static_cast<float>(tolerance);
+  if (activeGLMdiChild() &&
+      !activeGLMdiChild()->setWeldTolerance(weldTolerance)) {
+    statusBar()->showMessage(tr("The tolerance applies to the files opened "
+                                "from now on"), 2000);
+  }
+  updateMenus();
+}
+
+void STLViewer::hideShells(const QList<int> &shells) {
+  if (activeGLMdiChild())
+    activeGLMdiChild()->setShellsHidden(shells, true);
+}
+
+void STLViewer::showShells(const QList<int> &shells) {
+  if (activeGLMdiChild())
+    activeGLMdiChild()->setShellsHidden(shells, false);
+}
+
+void STLViewer::isolateShells(const QList<int> &shells) {
+  if (activeGLMdiChild())
+    activeGLMdiChild()->isolateShells(shells);
+}
+
+void STLViewer::showAllShells() {
+  if (activeGLMdiChild())
+    activeGLMdiChild()->showAllShells();
+}
+
+void STLViewer::exportShells(const QList<int> &shells) {
+  if (activeGLMdiChild() && activeGLMdiChild()->exportShells(shells))
+    statusBar()->showMessage(tr("Shells exported"), 2000);
+}
+
+void STLViewer::exportLevel() {
+  if (activeGLMdiChild() && activeGLMdiChild()->exportLevel())
+    statusBar()->showMessage(tr("Level exported"), 2000);
+}
+
+void STLViewer::showSection(int axis, double position) {
+  if (activeGLMdiChild()) {
+    activeGLMdiChild()->showSection(axis, position);
+    sectionGroupBox->setValues(activeGLMdiChild()->getStats(),
+                               activeGLMdiChild()->getSection(),
+                               activeGLMdiChild()->isComputingStats());
+  }
+}
+
+void STLViewer::hideSection() {
+  if (activeGLMdiChild()) {
+    activeGLMdiChild()->hideSection();
+    sectionGroupBox->setValues(activeGLMdiChild()->getStats(), 0,
+                               activeGLMdiChild()->isComputingStats());
+  }
+}
+
 void STLViewer::zoom() {
   activeGLMdiChild()->zoom();
 }
@@ -189,7 +311,8 @@ void STLViewer::about() {
 
 void STLViewer::updateMenus() {
   bool hasGLMdiChild = (activeGLMdiChild() != 0);
-  if (hasGLMdiChild && !activeGLMdiChild()->isUntitled) {
+  if (hasGLMdiChild && !activeGLMdiChild()->isUntitled &&
+      !activeGLMdiChild()->isRepairing()) {
     saveAct->setEnabled(true);
     saveAsAct->setEnabled(true);
   } else {
@@ -208,6 +331,40 @@ void STLViewer::updateMenus() {
     wireframeAct->setChecked(activeGLMdiChild()->isWireframeModeActivated());
   else
     wireframeAct->setChecked(false);
+  highlightDefectsAct->setEnabled(hasGLMdiChild);
+  if (hasGLMdiChild)
+    highlightDefectsAct->setChecked(
+        activeGLMdiChild()->isHighlightModeActivated());
+  else
+    highlightDefectsAct->setChecked(false);
+  // The workers can't be interrupted, the repair and the weld would wait
+  // for them on this thread
+  repairAct->setEnabled(hasGLMdiChild && !activeGLMdiChild()->isUntitled &&
+                        !activeGLMdiChild()->isLoading() &&
+                        !activeGLMdiChild()->isComputingStats() &&
+                        !activeGLMdiChild()->isMakingLevels() &&
+                        !activeGLMdiChild()->isRepairing());
+  weldToleranceAct->setEnabled(!hasGLMdiChild ||
+                               (!activeGLMdiChild()->isComputingStats() &&
+                                !activeGLMdiChild()->isMakingLevels() &&
+                                !activeGLMdiChild()->isRepairing()));
+  // The slicer shares the mesh the stats are computed from
+  sliceAct->setEnabled(hasGLMdiChild && !activeGLMdiChild()->isUntitled &&
+                       !activeGLMdiChild()->isLoading() &&
+                       !activeGLMdiChild()->isComputingStats() &&
+                       !activeGLMdiChild()->isRepairing());
+  // So are the levels of detail
+  levelGroup->setEnabled(hasGLMdiChild && !activeGLMdiChild()->isUntitled &&
+                         !activeGLMdiChild()->isLoading() &&
+                         !activeGLMdiChild()->isComputingStats() &&
+                         !activeGLMdiChild()->isMakingLevels() &&
+                         !activeGLMdiChild()->isRepairing());
+  levelActs[hasGLMdiChild ? activeGLMdiChild()->getLevel() : 0]
+      ->setChecked(true);
+  exportLevelAct->setEnabled(hasGLMdiChild &&
+                             !activeGLMdiChild()->isUntitled &&
+                             !activeGLMdiChild()->isLoading() &&
+                             !activeGLMdiChild()->isRepairing());
   backViewAct->setEnabled(hasGLMdiChild);
   frontViewAct->setEnabled(hasGLMdiChild);
   leftViewAct->setEnabled(hasGLMdiChild);
@@ -220,18 +377,44 @@ void STLViewer::updateMenus() {
   nextAct->setEnabled(hasGLMdiChild);
   previousAct->setEnabled(hasGLMdiChild);
   separatorAct->setVisible(hasGLMdiChild);
+  // Show the progress of the active window if it is being loaded
+  bool isLoading = hasGLMdiChild && activeGLMdiChild()->isLoading();
+  cancelLoadingAct->setEnabled(isLoading);
+  loadingProgressBar->setVisible(isLoading);
+  cancelLoadingButton->setVisible(isLoading);
+  if (isLoading) {
+    loadingProgressBar->setValue(activeGLMdiChild()->loadingProgress());
+    loadingProgressBar->setFormat(tr("%p% (%1 facets)")
+        .arg(activeGLMdiChild()->loadingFacets()));
+  }
   if (hasGLMdiChild && !activeGLMdiChild()->isUntitled) {
     axisGroupBox->setXRotation(activeGLMdiChild()->getXRot());
     axisGroupBox->setYRotation(activeGLMdiChild()->getYRot());
     axisGroupBox->setZRotation(activeGLMdiChild()->getZRot());
     dimensionsGroupBox->setValues(activeGLMdiChild()->getStats());
-    meshInformationGroupBox->setValues(activeGLMdiChild()->getStats());
+    // The values still being computed are shown as such
+    bool computing = activeGLMdiChild()->isComputingStats() ||
+                     activeGLMdiChild()->isRepairing();
+    meshInformationGroupBox->setValues(activeGLMdiChild()->getStats(),
+                                       computing);
     propertiesGroupBox->setValues(activeGLMdiChild()->getStats());
+    propertiesGroupBox->setEdges(activeGLMdiChild()->getEdgeAnalysis(),
+                                 computing);
+    validationGroupBox->setValues(activeGLMdiChild()->getValidation(),
+                                  computing);
+    shellsGroupBox->setValues(activeGLMdiChild()->getShells(),
+                              activeGLMdiChild()->getHiddenShells(),
+                              computing);
+    sectionGroupBox->setValues(activeGLMdiChild()->getStats(),
+                               activeGLMdiChild()->getSection(), computing);
   } else {
     axisGroupBox->reset();
     dimensionsGroupBox->reset();
     meshInformationGroupBox->reset();
     propertiesGroupBox->reset();
+    validationGroupBox->reset();
+    shellsGroupBox->reset();
+    sectionGroupBox->reset();
   }
 }
 
@@ -284,6 +467,8 @@ void STLViewer::setMouseReleased(Qt::MouseButtons button) {
 
 GLMdiChild *STLViewer::createGLMdiChild() {
   GLMdiChild *child = new GLMdiChild;
+  child->setMeshCache(meshCache);
+  child->setWeldTolerance(weldTolerance);
   mdiArea->addSubWindow(child);
   child->setLeftMouseButtonMode(leftMouseButtonMode);
   connect(child, SIGNAL(mouseButtonPressed(Qt::MouseButtons)), this,
@@ -294,6 +479,11 @@ GLMdiChild *STLViewer::createGLMdiChild() {
     SIGNAL(leftMouseButtonModeChanged(GLWidget::LeftMouseButtonMode)), child,
     SLOT(setLeftMouseButtonMode(GLWidget::LeftMouseButtonMode)));
   connect(child, SIGNAL(destroyed()), this, SLOT(destroyGLMdiChild()));
+  connect(child, SIGNAL(loadingProgressChanged(int, qlonglong)), this,
+          SLOT(updateLoadingProgress(int, qlonglong)));
+  connect(child, SIGNAL(loadingFinished(bool)), this,
+          SLOT(loadingFinished(bool)));
+  connect(child, SIGNAL(statsChanged()), this, SLOT(updateMenus()));
   connect(child, SIGNAL(xRotationChanged(const int)), axisGroupBox,
           SLOT(setXRotation(const int)));
   connect(child, SIGNAL(yRotationChanged(const int)), axisGroupBox,
@@ -342,6 +532,11 @@ void STLViewer::createActions() {
   saveAsAct->setStatusTip(tr("Save the document under a new name"));
   connect(saveAsAct, SIGNAL(triggered()), this, SLOT(saveAs()));
 
+  cancelLoadingAct = new QAction(tr("&Cancel Loading"), this);
+  cancelLoadingAct->setShortcut(tr("Esc"));
+  cancelLoadingAct->setStatusTip(tr("Stop loading the active window"));
+  connect(cancelLoadingAct, SIGNAL(triggered()), this, SLOT(cancelLoading()));
+
   saveImageAct = new QAction(tr("Save Image..."), this);
   saveImageAct->setShortcut(tr("Ctrl+I"));
   saveImageAct->setStatusTip(tr("Save the current view to disk"));
@@ -462,6 +657,52 @@ void STLViewer::createActions() {
   connect(wireframeAct, SIGNAL(triggered()), this, SLOT(wireframe()));
   wireframeAct->setChecked(false);
 
+  highlightDefectsAct = new QAction(tr("&Highlight Defects"), this);
+  highlightDefectsAct->setShortcut(tr("D"));
+  highlightDefectsAct->setStatusTip(tr("Show the defective facets in red"));
+  highlightDefectsAct->setCheckable(true);
+  connect(highlightDefectsAct, SIGNAL(triggered()), this,
+          SLOT(highlightDefects()));
+  highlightDefectsAct->setChecked(true);
+
+  levelGroup = new QActionGroup(this);
+  levelActs << new QAction(tr("&Full"), this) << new QAction(tr("&50%"), this)
+            << new QAction(tr("&10%"), this) << new QAction(tr("&1%"), this);
+  levelActs[0]->setStatusTip(tr("Show all the facets"));
+  for (int i = 1; i < levelActs.size(); i++)
+    levelActs[i]->setStatusTip(tr("Show a reduced mesh with %1 of the "
+                                  "facets").arg(levelActs[i]->text()
+                                                .remove('&')));
+  for (int i = 0; i < levelActs.size(); i++) {
+    levelActs[i]->setCheckable(true);
+    levelGroup->addAction(levelActs[i]);
+  }
+  levelActs[0]->setChecked(true);
+  connect(levelGroup, SIGNAL(triggered(QAction*)), this,
+          SLOT(setLevel(QAction*)));
+
+  repairAct = new QAction(tr("&Repair Orientation"), this);
+  repairAct->setShortcut(tr("Ctrl+R"));
+  repairAct->setStatusTip(tr("Orient the facets consistently and "
+                             "recompute their normals"));
+  connect(repairAct, SIGNAL(triggered()), this, SLOT(repair()));
+
+  sliceAct = new QAction(tr("&Slice..."), this);
+  sliceAct->setStatusTip(tr("Cut the model into layers and export their "
+                            "contours"));
+  connect(sliceAct, SIGNAL(triggered()), this, SLOT(slice()));
+
+  weldToleranceAct = new QAction(tr("&Weld Tolerance..."), this);
+  weldToleranceAct->setStatusTip(tr("Set the distance within which the "
+                                    "vertices are welded"));
+  connect(weldToleranceAct, SIGNAL(triggered()), this,
+          SLOT(setWeldTolerance()));
+
+  exportLevelAct = new QAction(tr("&Export Level..."), this);
+  exportLevelAct->setStatusTip(tr("Write the level of detail shown into a "
+                                  "new file"));
+  connect(exportLevelAct, SIGNAL(triggered()), this, SLOT(exportLevel()));
+
   exitAct = new QAction(tr("E&xit"), this);
   exitAct->setShortcut(tr("Ctrl+Q"));
   exitAct->setStatusTip(tr("Exit the application"));
@@ -479,6 +720,7 @@ void STLViewer::createMenus() {
   fileMenu->addAction(saveAct);
   fileMenu->addAction(saveAsAct);
   fileMenu->addAction(saveImageAct);
+  fileMenu->addAction(cancelLoadingAct);
   fileMenu->addSeparator();
   fileMenu->addAction(exitAct);
 
@@ -488,6 +730,7 @@ void STLViewer::createMenus() {
   viewMenu->addAction(zoomAct);
   viewMenu->addAction(unzoomAct);
   viewMenu->addAction(wireframeAct);
+  viewMenu->addAction(highlightDefectsAct);
 
   defaultViewsMenu = viewMenu->addMenu(tr("&Default Views"));
   defaultViewsMenu->addAction(backViewAct);
@@ -498,8 +741,18 @@ void STLViewer::createMenus() {
   defaultViewsMenu->addAction(bottomViewAct);
   defaultViewsMenu->addAction(topFrontLeftViewAct);
 
+  levelMenu = viewMenu->addMenu(tr("&Level of Detail"));
+  levelMenu->addActions(levelActs);
+
   viewMenu->addSeparator();
 
+  toolsMenu = menuBar()->addMenu(tr("&Tools"));
+  toolsMenu->addAction(repairAct);
+  toolsMenu->addAction(sliceAct);
+  toolsMenu->addAction(exportLevelAct);
+  toolsMenu->addSeparator();
+  toolsMenu->addAction(weldToleranceAct);
+
   windowMenu = menuBar()->addMenu(tr("&Window"));
   updateWindowMenu();
   connect(windowMenu, SIGNAL(aboutToShow()), this, SLOT(updateWindowMenu()));
@@ -533,6 +786,17 @@ void STLViewer::createToolBars() {
 
 void STLViewer::createStatusBar() {
   statusBar()->showMessage(tr("Ready"));
+  // Progress of the file being loaded in the active window
+  loadingProgressBar = new QProgressBar;
+  loadingProgressBar->setRange(0, 100);
+  loadingProgressBar->setMaximumWidth(200);
+  loadingProgressBar->hide();
+  statusBar()->addPermanentWidget(loadingProgressBar);
+  cancelLoadingButton = new QToolButton;
+  cancelLoadingButton->setDefaultAction(cancelLoadingAct);
+  cancelLoadingButton->setAutoRaise(true);
+  cancelLoadingButton->hide();
+  statusBar()->addPermanentWidget(cancelLoadingButton);
 }
 
 void STLViewer::createDockWindows() {
@@ -543,6 +807,12 @@ void STLViewer::createDockWindows() {
   dimensionsGroupBox = new DimensionsGroupBox(this);
   meshInformationGroupBox = new MeshInformationGroupBox(this);
   propertiesGroupBox = new PropertiesGroupBox(this);
+  validationGroupBox = new ValidationGroupBox(this);
+  sectionGroupBox = new SectionGroupBox(this);
+  connect(sectionGroupBox, SIGNAL(sectionShown(int, double)), this,
+          SLOT(showSection(int, double)));
+  connect(sectionGroupBox, SIGNAL(sectionHidden()), this,
+          SLOT(hideSection()));
   // Create a layout inside a widget to display all GroupBoxes in one layout
   QWidget *wi = new QWidget;
   wi->setSizePolicy(QSizePolicy(QSizePolicy::MinimumExpanding,
@@ -551,6 +821,8 @@ void STLViewer::createDockWindows() {
   layout->addWidget(dimensionsGroupBox);
   layout->addWidget(meshInformationGroupBox);
   layout->addWidget(propertiesGroupBox);
+  layout->addWidget(validationGroupBox);
+  layout->addWidget(sectionGroupBox);
   wi->setLayout(layout);
   // Embed the widget that contains all GroupBoxes into the DockWidget
   dock->setWidget(wi);
@@ -577,6 +849,24 @@ void STLViewer::createDockWindows() {
   addDockWidget(Qt::RightDockWidgetArea, dock);
   // Add a button in the view menu to show/hide the DockWidget
   viewMenu->addAction(dock->toggleViewAction());
+
+  // Create a DockWidget named "Shells", its table takes the space left
+  dock = new QDockWidget(tr("Shells"), this);
+  dock->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
+  shellsGroupBox = new ShellsGroupBox(this);
+  connect(shellsGroupBox, SIGNAL(hideRequested(QList<int>)), this,
+          SLOT(hideShells(QList<int>)));
+  connect(shellsGroupBox, SIGNAL(showRequested(QList<int>)), this,
+          SLOT(showShells(QList<int>)));
+  connect(shellsGroupBox, SIGNAL(isolateRequested(QList<int>)), this,
+          SLOT(isolateShells(QList<int>)));
+  connect(shellsGroupBox, SIGNAL(showAllRequested()), this,
+          SLOT(showAllShells()));
+  connect(shellsGroupBox, SIGNAL(exportRequested(QList<int>)), this,
+          SLOT(exportShells(QList<int>)));
+  dock->setWidget(shellsGroupBox);
+  addDockWidget(Qt::RightDockWidgetArea, dock);
+  viewMenu->addAction(dock->toggleViewAction());
 }
 
 void STLViewer::readSettings() {
@@ -586,6 +876,20 @@ void STLViewer::readSettings() {
   QSize size = settings.value("size", QSize(400, 400)).toSize();
   resize(size);
   move(pos);
+  // Files opened before are mapped from the cache instead of being parsed
+  QString cacheLocation =
+      QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+  if (cacheLocation.isEmpty())
+    cacheLocation = QDir::tempPath() + "/STLViewer";
+  QString cacheDir = settings.value("cacheDir",
+                                    cacheLocation + "/meshes").toString();
+  // The maximum size of the cache is in MB
+  qint64 cacheSize = settings.value("cacheSize", 1024).toLongLong();
+  weldTolerance = static_cast<float>(
+      settings.value("weldTolerance", 0.0).toDouble());
+  QDir().mkpath(cacheDir);
+  meshCache = new MeshCache(QFile::encodeName(cacheDir).constData(),
+                            cacheSize * 1024 * 1024);
 }
 
 void STLViewer::writeSettings() {
@@ -593,6 +897,10 @@ void STLViewer::writeSettings() {
   settings.setValue("dir", curDir);
   settings.setValue("pos", pos());
   settings.setValue("size", size());
+  settings.setValue("cacheDir",
+                    QFile::decodeName(meshCache->getDirectory().c_str()));
+  settings.setValue("cacheSize", meshCache->getMaxSize() / (1024 * 1024));
+  settings.setValue("weldTolerance", weldTolerance);
 }
 
 GLMdiChild *STLViewer::activeGLMdiChild() {
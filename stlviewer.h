@@ -28,14 +28,21 @@
 
 class AxisGroupBox;
 class DimensionsGroupBox;
+class MeshCache;
 class MeshInformationGroupBox;
 class PropertiesGroupBox;
+class SectionGroupBox;
+class ShellsGroupBox;
+class ValidationGroupBox;
 class QAction;
 class QMenu;
 class QLabel;
+class QActionGroup;
 class QMdiArea;
 class QMdiSubWindow;
+class QProgressBar;
 class QSignalMapper;
+class QToolButton;
 
 class STLViewer : public QMainWindow {
 
@@ -69,11 +76,27 @@ class STLViewer : public QMainWindow {
   void bottomView();
   void topFrontLeftView();
   void wireframe();
+  void highlightDefects();
+  void setLevel(QAction *action);
+  void repair();
+  void slice();
+  void setWeldTolerance();
+  void hideShells(const QList<int> &shells);
+  void showShells(const QList<int> &shells);
+  void isolateShells(const QList<int> &shells);
+  void showAllShells();
+  void exportShells(const QList<int> &shells);
+  void exportLevel();
+  void showSection(int axis, double position);
+  void hideSection();
   void about();
   void updateMenus();
   void updateWindowMenu();
   void setMousePressed(Qt::MouseButtons button);
   void setMouseReleased(Qt::MouseButtons button);
+  void cancelLoading();
+  void updateLoadingProgress(int percent, qlonglong facetsRead);
+  void loadingFinished(bool loaded);
   GLMdiChild *createGLMdiChild();
   void setActiveSubWindow(QWidget *window);
   void destroyGLMdiChild();
@@ -91,11 +114,16 @@ class STLViewer : public QMainWindow {
   GLMdiChild *activeGLMdiChild();
   QMdiSubWindow *findGLMdiChild(const QString &fileName);
   QMdiArea *mdiArea;
+  MeshCache *meshCache;
+  // The tolerance the vertices of the files opened are welded within
+  float weldTolerance;
   QSignalMapper *windowMapper;
   QMenu *fileMenu;
   QMenu *windowMenu;
   QMenu *viewMenu;
   QMenu *defaultViewsMenu;
+  QMenu *levelMenu;
+  QMenu *toolsMenu;
   QMenu *helpMenu;
   QToolBar *fileToolBar;
   QToolBar *viewToolBar;
@@ -123,14 +151,28 @@ class STLViewer : public QMainWindow {
   QAction *bottomViewAct;
   QAction *topFrontLeftViewAct;
   QAction *wireframeAct;
+  QAction *highlightDefectsAct;
+  // Level i of detail is levelActs[i], the full mesh being level 0
+  QActionGroup *levelGroup;
+  QList<QAction*> levelActs;
+  QAction *repairAct;
+  QAction *sliceAct;
+  QAction *weldToleranceAct;
+  QAction *exportLevelAct;
   QAction *exitAct;
   QAction *aboutAct;
+  QAction *cancelLoadingAct;
+  QProgressBar *loadingProgressBar;
+  QToolButton *cancelLoadingButton;
   QString curDir;
   GLWidget::LeftMouseButtonMode leftMouseButtonMode;
   AxisGroupBox *axisGroupBox;
   DimensionsGroupBox *dimensionsGroupBox;
   MeshInformationGroupBox *meshInformationGroupBox;
   PropertiesGroupBox *propertiesGroupBox;
+  ValidationGroupBox *validationGroupBox;
+  ShellsGroupBox *shellsGroupBox;
+  SectionGroupBox *sectionGroupBox;
 };
 
 #endif // STLVIEWER_H
\ No newline at end of file
@@ -0,0 +1,109 @@
+// Copyright (c) 2009 Olivier Crave
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <QtGui/QtGui>
+
+#include "meshvalidation.h"
+#include "validationgroupbox.h"
+
+ValidationGroupBox::ValidationGroupBox(QWidget *parent)
+    : QGroupBox(tr("Validation"), parent) {
+
+  QGridLayout *layout = new QGridLayout;
+  // Write labels and values
+  layout->addWidget(new QLabel("Watertight:"), 0, 0);
+  watertight = new QLabel("");
+  watertight->setAlignment(Qt::AlignRight);
+  layout->addWidget(watertight, 0, 1);
+  layout->addWidget(new QLabel("Non-manifold edges:"), 1, 0);
+  nonManifoldEdges = new QLabel("");
+  nonManifoldEdges->setAlignment(Qt::AlignRight);
+  layout->addWidget(nonManifoldEdges, 1, 1);
+  layout->addWidget(new QLabel("Holes:"), 2, 0);
+  holes = new QLabel("");
+  holes->setAlignment(Qt::AlignRight);
+  layout->addWidget(holes, 2, 1);
+  layout->addWidget(new QLabel("Flipped edges:"), 3, 0);
+  flippedEdges = new QLabel("");
+  flippedEdges->setAlignment(Qt::AlignRight);
+  layout->addWidget(flippedEdges, 3, 1);
+  layout->addWidget(new QLabel("Degenerate facets:"), 4, 0);
+  degenerateFacets = new QLabel("");
+  degenerateFacets->setAlignment(Qt::AlignRight);
+  layout->addWidget(degenerateFacets, 4, 1);
+  layout->addWidget(new QLabel("Duplicate facets:"), 5, 0);
+  duplicateFacets = new QLabel("");
+  duplicateFacets->setAlignment(Qt::AlignRight);
+  layout->addWidget(duplicateFacets, 5, 1);
+  setLayout(layout);
+}
+
+ValidationGroupBox::~ValidationGroupBox() {}
+
+void ValidationGroupBox::reset() {
+  // Reset values
+  watertight->setText("");
+  watertight->setToolTip("");
+  nonManifoldEdges->setText("");
+  holes->setText("");
+  flippedEdges->setText("");
+  degenerateFacets->setText("");
+  duplicateFacets->setText("");
+}
+
+void ValidationGroupBox::setValues(const MeshValidation *validation,
+                                   bool computing) {
+  if (validation == 0) {
+    QString state = computing ? tr("computing...") : tr("unavailable");
+    watertight->setText(state);
+    watertight->setToolTip("");
+    nonManifoldEdges->setText(state);
+    holes->setText(state);
+    flippedEdges->setText(state);
+    degenerateFacets->setText(state);
+    duplicateFacets->setText(state);
+    return;
+  }
+  // The volume of a mesh that isn't closed doesn't mean anything
+  if (validation->isWatertight()) {
+    watertight->setText(tr("Yes"));
+    watertight->setToolTip("");
+  } else {
+    watertight->setText(tr("No"));
+    watertight->setToolTip(tr("The volume is not reliable"));
+  }
+  QString data;
+  data.setNum(validation->getNumNonManifoldEdges());
+  nonManifoldEdges->setText(data);
+  if (validation->getNumHoles() > 0) {
+    data = tr("%1 (%2 edges)").arg(validation->getNumHoles())
+        .arg(validation->getNumBoundaryEdges());
+  } else {
+    data.setNum(validation->getNumHoles());
+  }
+  holes->setText(data);
+  data.setNum(validation->getNumFlippedEdges());
+  flippedEdges->setText(data);
+  data.setNum(validation->getNumDegenerateFacets());
+  degenerateFacets->setText(data);
+  data.setNum(validation->getNumDuplicateFacets());
+  duplicateFacets->setText(data);
+}